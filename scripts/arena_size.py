@@ -0,0 +1,113 @@
+#!/usr/bin/env python3
+"""Size the TFLite tensor arena of a board and model from a measurement.
+
+Reads the arena size the model needed from a board's init log, or runs a
+native_sim build, takes the size plus a margin and records it as the
+CONFIG_GROW_TFLITE_ARENA_SIZE default for that board and model in
+
+    config/arena/<board>.kconfig
+
+which the application Kconfig sources. The board and model are read from
+the build's .config. Optimized kernels such as CMSIS-NN and ESP-NN keep
+scratch buffers in the arena, so every board is measured on its own; the
+native_sim figure only holds for native_sim.
+"""
+
+import argparse
+import os
+import re
+import subprocess
+import sys
+
+# Printed by a native_sim build with CONFIG_GROW_TFLITE_ARENA_RECORD=y
+REQUIRED = re.compile(r"tflite arena required: (\d+) bytes")
+# Logged at init by every board
+USED = re.compile(r"arena used: (\d+) of \d+ bytes")
+
+ENTRY = re.compile(r'\t# (.*)\n\tdefault (\d+) if GROW_MODEL_FILE = "([^"]*)"')
+
+APP_DIR = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+
+def run(exe, seconds):
+    # The model is loaded by the deferred init, a few seconds after boot
+    result = subprocess.run([exe, f"-stop_at={seconds}"], capture_output=True,
+                            text=True, errors="replace", check=False)
+    return result.stdout + result.stderr
+
+
+def read_config(path):
+    values = {}
+    with open(path) as f:
+        for line in f:
+            match = re.match(r'(CONFIG_\w+)=(.*)', line.strip())
+            if match:
+                values[match.group(1)] = match.group(2).strip('"')
+    for name in ("CONFIG_BOARD", "CONFIG_GROW_MODEL_FILE"):
+        if name not in values:
+            sys.exit(f"{name} not set in {path}")
+    return values["CONFIG_BOARD"], values["CONFIG_GROW_MODEL_FILE"]
+
+
+def read_entries(path):
+    if not os.path.exists(path):
+        return {}
+    with open(path) as f:
+        text = f.read()
+    return {model: (comment, int(size))
+            for comment, size, model in ENTRY.findall(text)}
+
+
+def write_entries(path, entries):
+    os.makedirs(os.path.dirname(path), exist_ok=True)
+    with open(path, "w") as f:
+        f.write("# Generated by scripts/arena_size.py, one default per model\n")
+        f.write("config GROW_TFLITE_ARENA_SIZE\n")
+        for model in sorted(entries):
+            comment, size = entries[model]
+            f.write(f"\t# {comment}\n")
+            f.write(f'\tdefault {size} if GROW_MODEL_FILE = "{model}" && '
+                    "!GROW_TFLITE_ARENA_RECORD\n")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    source = parser.add_mutually_exclusive_group(required=True)
+    source.add_argument("--exe", help="native_sim zephyr.exe to run")
+    source.add_argument("--log", help="saved console output of the board")
+    parser.add_argument("--config", default="build/zephyr/.config",
+                        help="the measured build's .config (default build/zephyr/.config)")
+    parser.add_argument("--seconds", type=int, default=10,
+                        help="how long to run the executable (default 10)")
+    parser.add_argument("--margin", type=int, default=20,
+                        help="safety margin in percent (default 20)")
+    parser.add_argument("--align", type=int, default=1024,
+                        help="round the size up to this many bytes (default 1024)")
+    args = parser.parse_args()
+
+    board, model = read_config(args.config)
+
+    if args.exe:
+        text = run(args.exe, args.seconds)
+    else:
+        with open(args.log, errors="replace") as f:
+            text = f.read()
+
+    match = REQUIRED.search(text) or USED.search(text)
+    if not match:
+        sys.exit("no arena measurement found, did the model load?")
+
+    required = int(match.group(1))
+    size = required * (100 + args.margin) // 100
+    size = -(-size // args.align) * args.align
+
+    path = os.path.join(APP_DIR, "config", "arena", f"{board}.kconfig")
+    entries = read_entries(path)
+    entries[model] = (f"{model}: {required} bytes measured, {args.margin}% margin", size)
+    write_entries(path, entries)
+
+    print(f"{board} {model}: arena required {required} bytes, configured {size} bytes")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,169 @@
+#!/usr/bin/env python3
+"""Generate the TFLite Micro op resolver for a model.
+
+Reads the operator codes of a .tflite flatbuffer and writes a header that
+registers exactly those operators:
+
+    TFLITE_MODEL_OP_COUNT       number of operators, the resolver capacity
+    TFLITE_MODEL_ADD_OPS(r)     registers them on a MicroMutableOpResolver
+    TFLITE_MODEL_FILE_SIZE      size of the model the header was made from
+
+usage: gen_op_resolver.py MODEL OUTPUT
+"""
+
+import struct
+import sys
+
+# BuiltinOperator values from the TFLite schema and the resolver method
+# that registers each of them. Operators missing here stop the build.
+RESOLVER_METHODS = {
+    0: "AddAdd",
+    1: "AddAveragePool2D",
+    2: "AddConcatenation",
+    3: "AddConv2D",
+    4: "AddDepthwiseConv2D",
+    6: "AddDequantize",
+    8: "AddFloor",
+    9: "AddFullyConnected",
+    11: "AddL2Normalization",
+    14: "AddLogistic",
+    17: "AddMaxPool2D",
+    18: "AddMul",
+    19: "AddRelu",
+    21: "AddRelu6",
+    22: "AddReshape",
+    25: "AddSoftmax",
+    28: "AddTanh",
+    34: "AddPad",
+    39: "AddTranspose",
+    40: "AddMean",
+    41: "AddSub",
+    42: "AddDiv",
+    43: "AddSqueeze",
+    45: "AddStridedSlice",
+    47: "AddExp",
+    53: "AddCast",
+    55: "AddMaximum",
+    56: "AddArgMax",
+    57: "AddMinimum",
+    65: "AddSlice",
+    70: "AddExpandDims",
+    74: "AddSum",
+    82: "AddReduceMax",
+    83: "AddPack",
+    88: "AddUnpack",
+    98: "AddLeakyRelu",
+    114: "AddQuantize",
+    117: "AddHardSwish",
+}
+
+BUILTIN_CUSTOM = 32
+
+# Table field indices in the schema
+MODEL_OPERATOR_CODES = 1
+OPCODE_DEPRECATED_BUILTIN_CODE = 0
+OPCODE_BUILTIN_CODE = 3
+
+
+class FlatBuffer:
+    def __init__(self, data):
+        self.data = data
+
+    def u8(self, pos):
+        return self.data[pos]
+
+    def u16(self, pos):
+        return struct.unpack_from("<H", self.data, pos)[0]
+
+    def u32(self, pos):
+        return struct.unpack_from("<I", self.data, pos)[0]
+
+    def i32(self, pos):
+        return struct.unpack_from("<i", self.data, pos)[0]
+
+    def root(self):
+        return self.u32(0)
+
+    def field(self, table, index):
+        """Position of a table field, or None if it is not present."""
+        vtable = table - self.i32(table)
+        entry = 4 + 2 * index
+        if entry >= self.u16(vtable):
+            return None
+        offset = self.u16(vtable + entry)
+        return table + offset if offset else None
+
+    def tables(self, table, index):
+        """Tables of a vector field."""
+        pos = self.field(table, index)
+        if pos is None:
+            return []
+        vector = pos + self.u32(pos)
+        return [vector + 4 + 4 * i + self.u32(vector + 4 + 4 * i)
+                for i in range(self.u32(vector))]
+
+
+def model_ops(data):
+    if len(data) < 8 or data[4:8] != b"TFL3":
+        raise ValueError("not a TFLite flatbuffer")
+
+    fb = FlatBuffer(data)
+    ops = []
+    for opcode in fb.tables(fb.root(), MODEL_OPERATOR_CODES):
+        # Operators below 127 are also kept in the deprecated byte field
+        pos = fb.field(opcode, OPCODE_DEPRECATED_BUILTIN_CODE)
+        code = fb.u8(pos) if pos is not None else 0
+        pos = fb.field(opcode, OPCODE_BUILTIN_CODE)
+        if pos is not None:
+            code = max(code, fb.i32(pos))
+
+        if code == BUILTIN_CUSTOM:
+            raise ValueError("custom operators are not supported")
+        if code not in RESOLVER_METHODS:
+            raise ValueError(f"no resolver method for builtin operator {code}")
+        if RESOLVER_METHODS[code] not in ops:
+            ops.append(RESOLVER_METHODS[code])
+
+    if not ops:
+        raise ValueError("model has no operators")
+    return ops
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit(__doc__.strip().splitlines()[-1])
+
+    model, output = sys.argv[1:]
+    with open(model, "rb") as f:
+        data = f.read()
+
+    try:
+        ops = model_ops(data)
+    except (ValueError, struct.error, IndexError) as e:
+        sys.exit(f"{model}: {e}")
+
+    lines = [
+        "/* Generated by gen_op_resolver.py, do not edit */",
+        "#ifndef TFLITE_MODEL_OPS_H",
+        "#define TFLITE_MODEL_OPS_H",
+        "",
+        f"#define TFLITE_MODEL_FILE_SIZE {len(data)}",
+        f"#define TFLITE_MODEL_OP_COUNT {len(ops)}",
+        "",
+        "#define TFLITE_MODEL_ADD_OPS(resolver) \\",
+        "    do { \\",
+    ]
+    lines += [f"        (resolver).{op}(); \\" for op in ops]
+    lines += [
+        "    } while (0)",
+        "",
+        "#endif /* TFLITE_MODEL_OPS_H */",
+        "",
+    ]
+
+    with open(output, "w") as f:
+        f.write("\n".join(lines))
+
+
+if __name__ == "__main__":
+    main()
@@ -10,6 +10,9 @@
 
 #include "ble.h"
 #include "serial_number.h"
+#include "scheduler.h"
+#include "boot_stats.h"
+#include "mem_monitor.h"
 
 LOG_MODULE_REGISTER(ble, CONFIG_LOG_DEFAULT_LEVEL);
 
@@ -34,6 +37,15 @@ LOG_MODULE_REGISTER(ble, CONFIG_LOG_DEFAULT_LEVEL);
     
 #define DEVICE_INFO_CHAR_UUID \
     BT_UUID_128_ENCODE(0x12345678, 0x1234, 0x5678, 0x1234, 0x56789abcdef6)
+    
+#define SAMPLING_STATS_CHAR_UUID \
+    BT_UUID_128_ENCODE(0x12345678, 0x1234, 0x5678, 0x1234, 0x56789abcdef7)
+    
+#define BOOT_STATS_CHAR_UUID \
+    BT_UUID_128_ENCODE(0x12345678, 0x1234, 0x5678, 0x1234, 0x56789abcdef8)
+    
+#define MEM_STATS_CHAR_UUID \
+    BT_UUID_128_ENCODE(0x12345678, 0x1234, 0x5678, 0x1234, 0x56789abcdef9)
 
 /* Maximum length for each characteristic */
 #define MAX_WIFI_SSID_LEN 32
@@ -197,6 +209,39 @@ static ssize_t read_device_info(struct bt_conn *conn, const struct bt_gatt_attr
     return bt_gatt_attr_read(conn, attr, buf, len, offset, value, strlen(value));
 }
 
+/* Sampling Stats characteristic read callback */
+static ssize_t read_sampling_stats(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+                                  void *buf, uint16_t len, uint16_t offset)
+{
+    struct scheduler_stats stats;
+
+    scheduler_get_stats(&stats);
+
+    return bt_gatt_attr_read(conn, attr, buf, len, offset, &stats, sizeof(stats));
+}
+
+/* Boot Stats characteristic read callback */
+static ssize_t read_boot_stats(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+                              void *buf, uint16_t len, uint16_t offset)
+{
+    struct boot_stats stats;
+
+    boot_stats_get(&stats);
+
+    return bt_gatt_attr_read(conn, attr, buf, len, offset, &stats, sizeof(stats));
+}
+
+/* Memory Stats characteristic read callback */
+static ssize_t read_mem_stats(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+                             void *buf, uint16_t len, uint16_t offset)
+{
+    struct mem_stats stats;
+
+    mem_monitor_get_stats(&stats);
+
+    return bt_gatt_attr_read(conn, attr, buf, len, offset, &stats, sizeof(stats));
+}
+
 /* Define our GATT service */
 BT_GATT_SERVICE_DEFINE(grow_svc,
     BT_GATT_PRIMARY_SERVICE(BT_UUID_DECLARE_128(GROW_SERVICE_UUID)),
@@ -206,6 +251,22 @@ BT_GATT_SERVICE_DEFINE(grow_svc,
                           BT_GATT_PERM_READ,
                           read_device_info, NULL, device_info),
                           
+    BT_GATT_CHARACTERISTIC(BT_UUID_DECLARE_128(SAMPLING_STATS_CHAR_UUID),
+                          BT_GATT_CHRC_READ,
+                          BT_GATT_PERM_READ,
+                          read_sampling_stats, NULL, NULL),
+                          
+    BT_GATT_CHARACTERISTIC(BT_UUID_DECLARE_128(BOOT_STATS_CHAR_UUID),
+                          BT_GATT_CHRC_READ,
+                          BT_GATT_PERM_READ,
+                          read_boot_stats, NULL, NULL),
+                          
+    BT_GATT_CHARACTERISTIC(BT_UUID_DECLARE_128(MEM_STATS_CHAR_UUID),
+                          BT_GATT_CHRC_READ | BT_GATT_CHRC_NOTIFY,
+                          BT_GATT_PERM_READ,
+                          read_mem_stats, NULL, NULL),
+    BT_GATT_CCC(NULL, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
+                          
     BT_GATT_CHARACTERISTIC(BT_UUID_DECLARE_128(WIFI_SSID_CHAR_UUID),
                           BT_GATT_CHRC_WRITE,
                           BT_GATT_PERM_WRITE,
@@ -320,4 +381,25 @@ int ble_restart_advertising(void)
     ble_advertising = true;
     
     return 0;
-}
\ No newline at end of file
+}
+
+/**
+ * @brief Notify a memory alarm on the Memory Stats characteristic
+ *
+ * @param stats Memory summary to send
+ * @return 0 on success, negative errno on failure
+ */
+int ble_notify_mem_stats(const struct mem_stats *stats)
+{
+    if (!stats) {
+        return -EINVAL;
+    }
+    
+    /* Nothing to notify without a subscribed central */
+    if (!current_conn) {
+        return 0;
+    }
+    
+    return bt_gatt_notify_uuid(current_conn, BT_UUID_DECLARE_128(MEM_STATS_CHAR_UUID),
+                               grow_svc.attrs, stats, sizeof(*stats));
+}
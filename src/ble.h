@@ -2,6 +2,11 @@
 #define BLE_H
 
 #include <stdbool.h>
+#include <zephyr/sys/util.h>
+
+#include "mem_monitor.h"
+
+#if defined(CONFIG_BT)
 
 /**
  * @brief Initialize BLE subsystem
@@ -20,4 +25,34 @@ int ble_init(bool *provisioned);
  */
 int ble_restart_advertising(void);
 
+/**
+ * @brief Notify a memory alarm on the Memory Stats characteristic
+ *
+ * @param stats Memory summary to send
+ * @return 0 on success, negative errno on failure
+ */
+int ble_notify_mem_stats(const struct mem_stats *stats);
+
+#else
+
+/* Builds without Bluetooth (e.g. native_sim) provision from Kconfig */
+static inline int ble_init(bool *provisioned)
+{
+    ARG_UNUSED(provisioned);
+    return 0;
+}
+
+static inline int ble_restart_advertising(void)
+{
+    return 0;
+}
+
+static inline int ble_notify_mem_stats(const struct mem_stats *stats)
+{
+    ARG_UNUSED(stats);
+    return 0;
+}
+
+#endif /* CONFIG_BT */
+
 #endif /* BLE_H */
\ No newline at end of file
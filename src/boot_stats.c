@@ -0,0 +1,71 @@
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/atomic.h>
+
+#include "boot_stats.h"
+
+LOG_MODULE_REGISTER(boot_stats, CONFIG_LOG_DEFAULT_LEVEL);
+
+/* Phase timestamps in microseconds, written once */
+static atomic_t phase_us[BOOT_PHASE_COUNT];
+
+static const char *const phase_names[BOOT_PHASE_COUNT] = {
+    [BOOT_PHASE_STORAGE] = "storage",
+    [BOOT_PHASE_SENSORS] = "sensors",
+    [BOOT_PHASE_PIPELINE] = "pipeline",
+    [BOOT_PHASE_FIRST_READING] = "first reading",
+    [BOOT_PHASE_FIRST_UPLINK] = "first uplink",
+    [BOOT_PHASE_CONNECTIVITY] = "connectivity",
+    [BOOT_PHASE_ANALYSIS_READY] = "analysis ready",
+};
+
+/**
+ * @brief Record that a boot phase was reached
+ *
+ * @param phase Boot phase reached
+ */
+void boot_stats_mark(enum boot_phase phase)
+{
+    if (phase < 0 || phase >= BOOT_PHASE_COUNT) {
+        return;
+    }
+
+    /* 0 means not reached, so never store it */
+    uint32_t now_us = MAX(k_ticks_to_us_floor32(k_uptime_ticks()), 1U);
+
+    if (atomic_cas(&phase_us[phase], 0, now_us)) {
+        LOG_DBG("Boot phase %s at %u us", phase_names[phase], now_us);
+    }
+}
+
+/**
+ * @brief Get the boot phase timestamps
+ *
+ * @param stats Pointer to store the timestamps
+ */
+void boot_stats_get(struct boot_stats *stats)
+{
+    if (!stats) {
+        return;
+    }
+
+    for (int i = 0; i < BOOT_PHASE_COUNT; i++) {
+        stats->phase_us[i] = atomic_get(&phase_us[i]);
+    }
+}
+
+/**
+ * @brief Log the boot phase timestamps
+ */
+void boot_stats_log(void)
+{
+    for (int i = 0; i < BOOT_PHASE_COUNT; i++) {
+        uint32_t us = atomic_get(&phase_us[i]);
+
+        if (us == 0) {
+            LOG_INF("Boot phase %-14s not reached", phase_names[i]);
+        } else {
+            LOG_INF("Boot phase %-14s %u.%03u ms", phase_names[i], us / 1000U, us % 1000U);
+        }
+    }
+}
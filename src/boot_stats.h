@@ -0,0 +1,45 @@
+#ifndef BOOT_STATS_H
+#define BOOT_STATS_H
+
+#include <stdint.h>
+#include <zephyr/toolchain.h>
+
+/* Boot phases, in the order they are normally reached */
+enum boot_phase {
+    BOOT_PHASE_STORAGE,        /* Storage mounted */
+    BOOT_PHASE_SENSORS,        /* Sensors initialized */
+    BOOT_PHASE_PIPELINE,       /* Pipeline threads started */
+    BOOT_PHASE_FIRST_READING,  /* First sensor reading taken */
+    BOOT_PHASE_FIRST_UPLINK,   /* First reading published or cached */
+    BOOT_PHASE_CONNECTIVITY,   /* Network stack, buttons and BLE initialized */
+    BOOT_PHASE_ANALYSIS_READY, /* TFLite, history and habitat data restored */
+    BOOT_PHASE_COUNT
+};
+
+/* Time of each boot phase since kernel start, 0 if not reached yet */
+struct boot_stats {
+    uint32_t phase_us[BOOT_PHASE_COUNT];
+} __packed;
+
+/**
+ * @brief Record that a boot phase was reached
+ *
+ * Only the first call for each phase is recorded.
+ *
+ * @param phase Boot phase reached
+ */
+void boot_stats_mark(enum boot_phase phase);
+
+/**
+ * @brief Get the boot phase timestamps
+ *
+ * @param stats Pointer to store the timestamps
+ */
+void boot_stats_get(struct boot_stats *stats);
+
+/**
+ * @brief Log the boot phase timestamps
+ */
+void boot_stats_log(void);
+
+#endif /* BOOT_STATS_H */
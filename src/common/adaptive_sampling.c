@@ -0,0 +1,182 @@
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <math.h>
+
+#include "adaptive_sampling.h"
+#include "../storage.h"
+
+LOG_MODULE_REGISTER(adaptive_sampling, CONFIG_LOG_DEFAULT_LEVEL);
+
+/* History slots used for hourly trends */
+#define HISTORY_SOIL_MOISTURE 0
+#define HISTORY_TEMPERATURE 2
+#define HISTORY_LEN 24
+
+/* Change thresholds (Kconfig values are in hundredths) */
+#define MOISTURE_STEP (CONFIG_GROW_ADAPTIVE_MOISTURE_STEP / 100.0f)
+#define TEMPERATURE_STEP (CONFIG_GROW_ADAPTIVE_TEMPERATURE_STEP / 100.0f)
+
+/* Controller state */
+static uint32_t interval_sec = CONFIG_GROW_SAMPLE_INTERVAL_SEC;
+static float last_moisture;
+static float last_temperature;
+static bool have_last_reading = false;
+static int stable_samples = 0;
+
+/**
+ * @brief Clamp an interval to the configured range
+ */
+static uint32_t clamp_interval(uint32_t interval)
+{
+    if (interval < CONFIG_GROW_SAMPLE_INTERVAL_MIN_SEC) {
+        return CONFIG_GROW_SAMPLE_INTERVAL_MIN_SEC;
+    }
+
+    if (interval > CONFIG_GROW_SAMPLE_INTERVAL_MAX_SEC) {
+        return CONFIG_GROW_SAMPLE_INTERVAL_MAX_SEC;
+    }
+
+    return interval;
+}
+
+/**
+ * @brief Get the change between the two most recent hourly history values
+ */
+static float hourly_delta(const struct sensor_data_with_history *sensor_data, int slot)
+{
+    int index = sensor_data->history[slot].index;
+
+    if (!sensor_data->history[slot].filled && index < 2) {
+        return 0.0f;
+    }
+
+    int last = (index + HISTORY_LEN - 1) % HISTORY_LEN;
+    int prev = (index + HISTORY_LEN - 2) % HISTORY_LEN;
+
+    return fabsf(sensor_data->history[slot].values[last] -
+                 sensor_data->history[slot].values[prev]);
+}
+
+/**
+ * @brief Persist the current interval
+ */
+static void save_interval(void)
+{
+    int ret = storage_save_key(STORAGE_KEY_SAMPLING_INTERVAL, &interval_sec, sizeof(interval_sec));
+    if (ret < 0) {
+        LOG_WRN("Failed to save sampling interval: %d", ret);
+    }
+}
+
+/**
+ * @brief Initialize adaptive sampling controller
+ *
+ * @return 0 on success, negative errno on failure
+ */
+int adaptive_sampling_init(void)
+{
+    uint32_t saved;
+    size_t len = sizeof(saved);
+
+    interval_sec = clamp_interval(CONFIG_GROW_SAMPLE_INTERVAL_SEC);
+    have_last_reading = false;
+    stable_samples = 0;
+
+    if (storage_load_key(STORAGE_KEY_SAMPLING_INTERVAL, &saved, &len) == 0 &&
+        len == sizeof(saved)) {
+        interval_sec = clamp_interval(saved);
+    }
+
+    LOG_INF("Adaptive sampling initialized (interval %u s)", interval_sec);
+    return 0;
+}
+
+/**
+ * @brief Update the sampling interval from the latest readings
+ *
+ * @param sensor_data Current sensor readings with history
+ * @return New sampling interval in seconds
+ */
+uint32_t adaptive_sampling_update(const struct sensor_data_with_history *sensor_data)
+{
+    if (!IS_ENABLED(CONFIG_GROW_ADAPTIVE_SAMPLING) || !sensor_data) {
+        return interval_sec;
+    }
+
+    uint32_t new_interval = interval_sec;
+    float moisture_delta = 0.0f;
+    float temperature_delta = 0.0f;
+
+    if (have_last_reading) {
+        moisture_delta = fabsf(sensor_data->soil_moisture - last_moisture);
+        temperature_delta = fabsf(sensor_data->temperature - last_temperature);
+    }
+
+    last_moisture = sensor_data->soil_moisture;
+    last_temperature = sensor_data->temperature;
+    have_last_reading = true;
+
+    if (moisture_delta >= MOISTURE_STEP || temperature_delta >= TEMPERATURE_STEP) {
+        /* Change detected (e.g. watering event), sample fast */
+        new_interval = CONFIG_GROW_SAMPLE_INTERVAL_MIN_SEC;
+        stable_samples = 0;
+    } else if (moisture_delta < MOISTURE_STEP / 2 && temperature_delta < TEMPERATURE_STEP / 2) {
+        stable_samples++;
+
+        /* Stretch the interval after a run of flat readings */
+        if (stable_samples >= CONFIG_GROW_ADAPTIVE_STABLE_SAMPLES) {
+            new_interval = interval_sec * 2;
+            stable_samples = 0;
+        }
+    } else {
+        stable_samples = 0;
+    }
+
+    /* Do not stretch past the nominal interval while the hourly trend moves */
+    if (hourly_delta(sensor_data, HISTORY_SOIL_MOISTURE) >= MOISTURE_STEP ||
+        hourly_delta(sensor_data, HISTORY_TEMPERATURE) >= TEMPERATURE_STEP) {
+        new_interval = MIN(new_interval, CONFIG_GROW_SAMPLE_INTERVAL_SEC);
+    }
+
+    new_interval = clamp_interval(new_interval);
+
+    if (new_interval != interval_sec) {
+        LOG_INF("Sampling interval %u s -> %u s (moisture delta %.2f, temp delta %.2f)",
+               interval_sec, new_interval, moisture_delta, temperature_delta);
+        interval_sec = new_interval;
+        save_interval();
+    }
+
+    return interval_sec;
+}
+
+/**
+ * @brief Get the current sampling interval
+ *
+ * @return Sampling interval in seconds
+ */
+uint32_t adaptive_sampling_get_interval(void)
+{
+    return interval_sec;
+}
+
+/**
+ * @brief Set the sampling interval
+ *
+ * @param interval Sampling interval in seconds, within the configured range
+ * @return 0 on success, negative errno on failure
+ */
+int adaptive_sampling_set_interval(uint32_t interval)
+{
+    if (interval < CONFIG_GROW_SAMPLE_INTERVAL_MIN_SEC ||
+        interval > CONFIG_GROW_SAMPLE_INTERVAL_MAX_SEC) {
+        return -EINVAL;
+    }
+
+    LOG_INF("Sampling interval set to %u s", interval);
+    interval_sec = interval;
+    stable_samples = 0;
+    save_interval();
+
+    return 0;
+}
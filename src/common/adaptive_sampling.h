@@ -0,0 +1,47 @@
+#ifndef ADAPTIVE_SAMPLING_H
+#define ADAPTIVE_SAMPLING_H
+
+#include <stdint.h>
+
+#include "ml_analysis.h"
+
+/**
+ * @brief Initialize adaptive sampling controller
+ *
+ * Restores the last persisted sampling interval, if any.
+ *
+ * @return 0 on success, negative errno on failure
+ */
+int adaptive_sampling_init(void);
+
+/**
+ * @brief Update the sampling interval from the latest readings
+ *
+ * Stretches the interval while soil moisture and temperature are flat
+ * and drops back to the minimum interval as soon as change is detected.
+ * The interval is persisted whenever it changes.
+ *
+ * @param sensor_data Current sensor readings with history
+ * @return New sampling interval in seconds
+ */
+uint32_t adaptive_sampling_update(const struct sensor_data_with_history *sensor_data);
+
+/**
+ * @brief Get the current sampling interval
+ *
+ * @return Sampling interval in seconds
+ */
+uint32_t adaptive_sampling_get_interval(void);
+
+/**
+ * @brief Set the sampling interval
+ *
+ * The interval is persisted. With adaptive sampling enabled it keeps
+ * adapting from the new value.
+ *
+ * @param interval Sampling interval in seconds, within the configured range
+ * @return 0 on success, negative errno on failure
+ */
+int adaptive_sampling_set_interval(uint32_t interval);
+
+#endif /* ADAPTIVE_SAMPLING_H */
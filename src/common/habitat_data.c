@@ -9,6 +9,8 @@
 #include "habitat_data.h"
 #include "../storage.h"
 #include "../connectivity.h"
+#include "../perf.h"
+#include "../mem_monitor.h"
 
 LOG_MODULE_REGISTER(habitat_data, CONFIG_LOG_DEFAULT_LEVEL);
 
@@ -25,9 +27,9 @@ static struct http_client_request http_req;
 static struct http_client_response http_resp;
 static struct k_sem http_sem;
 
-/* Cache keys */
-#define HABITAT_CACHE_KEY_PREFIX "habitat/"
-#define HABITAT_CACHE_KEY_MAX 128
+/* Cache names, older firmware hashed them behind the prefix */
+#define HABITAT_CACHE_LEGACY_PREFIX "habitat/"
+#define HABITAT_CACHE_NAME_MAX (STORAGE_NAME_MAX + 1)
 
 /* JSON parsing */
 static int json_parse_handler(const char *key, size_t key_len,
@@ -114,15 +116,19 @@ static void http_response_cb(struct http_response *rsp, enum http_final_call fin
 int habitat_data_init(void)
 {
     k_sem_init(&http_sem, 0, 1);
+    
+    mem_monitor_register("habitat_data", "http_rx_buf", sizeof(http_rx_buf));
+    mem_monitor_register("habitat_data", "http_header_buf", sizeof(http_header_buf));
+    
     return 0;
 }
 
 /**
- * @brief Generate cache key for habitat data
+ * @brief Generate cache name for habitat data
  */
-static void generate_cache_key(const char *plant_name, const char *plant_variety, char *key_out, size_t key_size)
+static void generate_cache_name(const char *plant_name, const char *plant_variety, char *name_out, size_t name_size)
 {
-    snprintf(key_out, key_size, "%s%s_%s", HABITAT_CACHE_KEY_PREFIX, plant_name, plant_variety);
+    snprintf(name_out, name_size, "%s_%s", plant_name, plant_variety);
 }
 
 /**
@@ -160,7 +166,9 @@ int habitat_data_fetch(const char *plant_name, const char *plant_variety,
     hints.ai_family = AF_INET;
     hints.ai_socktype = SOCK_STREAM;
     
+    uint32_t start = perf_begin();
     ret = zsock_getaddrinfo(host, port, &hints, &addr);
+    perf_end(PERF_DNS, start);
     if (ret) {
         LOG_ERR("Failed to resolve '%s': %d", host, ret);
         return -EHOSTUNREACH;
@@ -174,8 +182,10 @@ int habitat_data_fetch(const char *plant_name, const char *plant_variety,
         return -errno;
     }
     
-    /* Connect to server */
+    /* Connect to server, TLS sockets complete the handshake here */
+    start = perf_begin();
     ret = zsock_connect(sock, addr->ai_addr, addr->ai_addrlen);
+    perf_end(PERF_TLS_CONNECT, start);
     zsock_freeaddrinfo(addr);
     if (ret < 0) {
         LOG_ERR("Failed to connect: %d", errno);
@@ -202,7 +212,9 @@ int habitat_data_fetch(const char *plant_name, const char *plant_variety,
     http_resp.header_buf_len = sizeof(http_header_buf);
     
     /* Send request */
+    start = perf_begin();
     ret = http_client_req(sock, &http_req, &http_resp, 10000);
+    perf_end(PERF_HTTP_REQUEST, start);
     if (ret < 0) {
         LOG_ERR("Failed to send HTTP request: %d", ret);
         zsock_close(sock);
@@ -257,15 +269,20 @@ int habitat_data_cache(const struct habitat_data *data)
         return -EINVAL;
     }
     
-    char key[HABITAT_CACHE_KEY_MAX];
-    generate_cache_key(data->plant_id, data->native_region, key, sizeof(key));
+    char name[HABITAT_CACHE_NAME_MAX];
+    char legacy_key[sizeof(HABITAT_CACHE_LEGACY_PREFIX) + HABITAT_CACHE_NAME_MAX];
+    generate_cache_name(data->plant_id, data->native_region, name, sizeof(name));
     
-    int ret = storage_save_value(key, data, sizeof(struct habitat_data));
+    int ret = storage_save_dynamic(STORAGE_NS_HABITAT, name, data, sizeof(struct habitat_data));
     if (ret < 0) {
         LOG_ERR("Failed to save habitat data to cache: %d", ret);
         return ret;
     }
     
+    /* Drop the copy older firmware cached under the hashed key */
+    snprintf(legacy_key, sizeof(legacy_key), "%s%s", HABITAT_CACHE_LEGACY_PREFIX, name);
+    storage_delete_value(legacy_key);
+    
     return 0;
 }
 
@@ -280,11 +297,11 @@ int habitat_data_cache(const struct habitat_data *data)
 int habitat_data_load_cache(const char *plant_name, const char *plant_variety,
                            struct habitat_data *data_out)
 {
-    char key[HABITAT_CACHE_KEY_MAX];
-    generate_cache_key(plant_name, plant_variety, key, sizeof(key));
+    char name[HABITAT_CACHE_NAME_MAX];
+    generate_cache_name(plant_name, plant_variety, name, sizeof(name));
     
     size_t data_size = sizeof(struct habitat_data);
-    int ret = storage_load_value(key, data_out, &data_size);
+    int ret = storage_load_dynamic(STORAGE_NS_HABITAT, name, data_out, &data_size);
     if (ret < 0) {
         LOG_ERR("Failed to load habitat data from cache: %d", ret);
         data_out->data_valid = false;
@@ -5,18 +5,83 @@
 #include <math.h>
 
 #include "ml_analysis.h"
+#include "ts_compress.h"
 #include "../tflite_interface.h"
 #include "../storage.h"
+#include "../perf.h"
+#include "../mem_monitor.h"
 
 LOG_MODULE_REGISTER(ml_analysis, CONFIG_LOG_DEFAULT_LEVEL);
 
 /* TensorFlow Lite context */
 static struct tflite_context tflite_ctx;
 
-/* History storage */
-#define SENSOR_HISTORY_KEY_PREFIX "sensor_history/"
+/*
+ * String keys of older firmware, by serial number. The hashed key held
+ * the current format, the legacy key the raw structure.
+ */
+#define SENSOR_HISTORY_HASHED_KEY_PREFIX "sensor_history2/"
+#define SENSOR_HISTORY_LEGACY_KEY_PREFIX "sensor_history/"
 #define SENSOR_HISTORY_KEY_MAX 128
 
+/* Sensor channels and history length */
+#define SENSOR_CHANNELS 5
+#define SENSOR_HISTORY_LEN 24
+
+BUILD_ASSERT(ARRAY_SIZE(((struct sensor_data_with_history *)0)->history) == SENSOR_CHANNELS,
+             "one history per channel");
+BUILD_ASSERT(ARRAY_SIZE(((struct sensor_data_with_history *)0)->history[0].values) ==
+             SENSOR_HISTORY_LEN, "history length mismatch");
+
+/* Model inputs (current values, ideal differences and history averages
+ * of each channel) and outputs (health class probabilities) */
+#define MODEL_INPUTS (3 * SENSOR_CHANNELS)
+#define MODEL_OUTPUTS 3
+
+/* Fixed-point scale of each channel when persisted */
+static const int32_t channel_scale[SENSOR_CHANNELS] = {
+    GROW_CENTI_SCALE, /* Soil moisture */
+    GROW_CENTI_SCALE, /* Light level */
+    GROW_CENTI_SCALE, /* Temperature */
+    GROW_CENTI_SCALE, /* Humidity */
+    GROW_DECI_SCALE,  /* Air movement */
+};
+
+/* Persisted current values, followed by the compressed history */
+struct sensor_history_header {
+    int64_t timestamp;
+    int32_t values[SENSOR_CHANNELS];
+} __packed;
+
+/* Persisted history buffer */
+static uint8_t history_buf[sizeof(struct sensor_history_header) +
+                           TSC_BOUND(SENSOR_HISTORY_LEN, SENSOR_CHANNELS)];
+
+/* The legacy key is deleted once the history is saved under the new one */
+static bool legacy_key_present;
+
+/* Counters reported by ml_get_stats() */
+static atomic_t stat_inferences;
+static atomic_t stat_cache_hits;
+
+#if defined(CONFIG_GROW_ML_CACHE)
+/* Tolerance of each channel, applied to all of its model inputs */
+static const float input_tolerance[SENSOR_CHANNELS] = {
+    CONFIG_GROW_ML_CACHE_TOL_SOIL_MOISTURE / 100.0f,
+    CONFIG_GROW_ML_CACHE_TOL_LIGHT_LEVEL / 100.0f,
+    CONFIG_GROW_ML_CACHE_TOL_TEMPERATURE / 100.0f,
+    CONFIG_GROW_ML_CACHE_TOL_HUMIDITY / 100.0f,
+    CONFIG_GROW_ML_CACHE_TOL_AIR_MOVEMENT / 100.0f,
+};
+
+/* Last inference, reused while the quantized inputs are unchanged */
+static struct {
+    bool valid;
+    int32_t key[MODEL_INPUTS];
+    float output[MODEL_OUTPUTS];
+} inference_cache;
+#endif
+
 /* Helper functions for environmental mismatch detection */
 static bool is_temp_mismatch(float temp, const struct habitat_data *habitat)
 {
@@ -63,39 +128,62 @@ static float compute_light_diff(float light, const struct habitat_data *habitat)
     return light - ideal_mid;
 }
 
-/* Generate recommendations based on mismatches */
-static void generate_recommendations(struct ml_analysis_result *result)
+#if defined(CONFIG_GROW_ML_CACHE)
+/**
+ * @brief Quantize the model inputs to steps of their channel tolerance
+ */
+static void quantize_inputs(const float *input, int32_t *key)
 {
-    char *recommendation = result->recommendation;
-    size_t rec_size = sizeof(result->recommendation);
-    size_t written = 0;
-    
-    if (result->health_status == ML_HEALTH_HEALTHY) {
-        written += snprintf(recommendation + written, rec_size - written,
-                          "Plant is healthy. ");
-    } else {
-        /* Add specific recommendations for each mismatch */
-        if (result->environmental_mismatch.temperature) {
-            written += snprintf(recommendation + written, rec_size - written,
-                              "Adjust temperature. ");
-        }
-        
-        if (result->environmental_mismatch.humidity) {
-            written += snprintf(recommendation + written, rec_size - written,
-                              "Adjust humidity level. ");
-        }
+    for (int i = 0; i < MODEL_INPUTS; i++) {
+        float tolerance = input_tolerance[i % SENSOR_CHANNELS];
         
-        if (result->environmental_mismatch.soil_moisture) {
-            written += snprintf(recommendation + written, rec_size - written,
-                              "Adjust watering schedule. ");
-        }
-        
-        if (result->environmental_mismatch.light_level) {
-            written += snprintf(recommendation + written, rec_size - written,
-                              "Adjust light exposure. ");
+        if (tolerance > 0.0f) {
+            key[i] = (int32_t)floorf(input[i] / tolerance);
+        } else {
+            /* No tolerance, only identical values match */
+            memcpy(&key[i], &input[i], sizeof(key[i]));
         }
     }
 }
+#endif
+
+/**
+ * @brief Run the model, or reuse the last inference for the same inputs
+ * 
+ * @param input Model inputs
+ * @param output Buffer to store the model outputs
+ * @return 0 on success, negative errno on failure
+ */
+static int run_model(const float *input, float *output)
+{
+#if defined(CONFIG_GROW_ML_CACHE)
+    int32_t key[MODEL_INPUTS];
+    
+    quantize_inputs(input, key);
+    if (inference_cache.valid && memcmp(key, inference_cache.key, sizeof(key)) == 0) {
+        memcpy(output, inference_cache.output, sizeof(inference_cache.output));
+        atomic_inc(&stat_cache_hits);
+        return 0;
+    }
+#endif
+    
+    uint32_t start = perf_begin();
+    int ret = tflite_run_inference(&tflite_ctx, input, MODEL_INPUTS, output, MODEL_OUTPUTS);
+    perf_end(PERF_INFERENCE, start);
+    if (ret < 0) {
+        return ret;
+    }
+    
+    atomic_inc(&stat_inferences);
+    
+#if defined(CONFIG_GROW_ML_CACHE)
+    memcpy(inference_cache.key, key, sizeof(key));
+    memcpy(inference_cache.output, output, sizeof(inference_cache.output));
+    inference_cache.valid = true;
+#endif
+    
+    return 0;
+}
 
 /**
  * @brief Initialize ML analysis module
@@ -104,6 +192,8 @@ static void generate_recommendations(struct ml_analysis_result *result)
  */
 int ml_analysis_init(void)
 {
+    mem_monitor_register("ml_analysis", "history_buf", sizeof(history_buf));
+    
     int ret = tflite_init(&tflite_ctx);
     if (ret < 0) {
         LOG_ERR("Failed to initialize TFLite: %d", ret);
@@ -114,33 +204,51 @@ int ml_analysis_init(void)
     return 0;
 }
 
+/**
+ * @brief Get the tensor arena usage of the loaded model
+ * 
+ * @param used_out Pointer to store the arena bytes used
+ * @param size_out Pointer to store the arena size
+ * @return 0 on success, -ENODEV if the model is not loaded
+ */
+int ml_get_arena_usage(size_t *used_out, size_t *size_out)
+{
+    if (!tflite_ctx.interpreter) {
+        return -ENODEV;
+    }
+    
+    *used_out = tflite_ctx.arena_used;
+    *size_out = tflite_ctx.arena_size;
+    return 0;
+}
+
 /**
  * @brief Add sensor reading to history
  * 
  * @param sensor_data Pointer to sensor data structure
- * @param soil_moisture Current soil moisture reading
- * @param light_level Current light level reading
- * @param temperature Current temperature reading
- * @param humidity Current humidity reading
- * @param air_movement Current air movement reading
+ * @param reading Current sensor reading
  * @return 0 on success, negative errno on failure
  */
 int ml_add_sensor_reading(struct sensor_data_with_history *sensor_data,
-                         float soil_moisture, float light_level,
-                         float temperature, float humidity,
-                         float air_movement)
+                         const struct grow_reading *reading)
 {
-    if (!sensor_data) {
+    if (!sensor_data || !reading) {
         return -EINVAL;
     }
     
     /* Update current values */
+    float soil_moisture = grow_soil_moisture(reading);
+    float light_level = grow_light_level(reading);
+    float temperature = grow_temperature(reading);
+    float humidity = grow_humidity(reading);
+    float air_movement = grow_air_movement(reading);
+
     sensor_data->soil_moisture = soil_moisture;
     sensor_data->light_level = light_level;
     sensor_data->temperature = temperature;
     sensor_data->humidity = humidity;
     sensor_data->air_movement = air_movement;
-    sensor_data->timestamp = k_uptime_get() / 1000;
+    sensor_data->timestamp = reading->timestamp;
     
     /* Update history arrays */
     static int64_t last_hourly_update = 0;
@@ -206,7 +314,7 @@ int ml_analyze_plant_health(const struct sensor_data_with_history *sensor_data,
     }
     
     /* Prepare input data for the model (15 values total) */
-    float model_input[15];
+    float model_input[MODEL_INPUTS];
     
     /* Current sensor values (5) */
     model_input[0] = sensor_data->soil_moisture;
@@ -237,10 +345,10 @@ int ml_analyze_plant_health(const struct sensor_data_with_history *sensor_data,
     }
     
     /* Output buffer for the model */
-    float model_output[3]; /* Health classification probabilities */
+    float model_output[MODEL_OUTPUTS]; /* Health classification probabilities */
     
     /* Run inference */
-    int ret = tflite_run_inference(&tflite_ctx, model_input, 15, model_output, 3);
+    int ret = run_model(model_input, model_output);
     if (ret < 0) {
         LOG_ERR("ML inference failed: %d", ret);
         return ret;
@@ -251,7 +359,7 @@ int ml_analyze_plant_health(const struct sensor_data_with_history *sensor_data,
     float max_prob = model_output[0];
     int health_class = ML_HEALTH_HEALTHY;
     
-    for (int i = 1; i < 3; i++) {
+    for (int i = 1; i < MODEL_OUTPUTS; i++) {
         if (model_output[i] > max_prob) {
             max_prob = model_output[i];
             health_class = i;
@@ -259,39 +367,69 @@ int ml_analyze_plant_health(const struct sensor_data_with_history *sensor_data,
     }
     
     /* Check for environmental mismatches */
-    result_out->environmental_mismatch.temperature = 
-        is_temp_mismatch(sensor_data->temperature, habitat_data);
+    result_out->environmental_mismatch = 0;
     
-    result_out->environmental_mismatch.humidity = 
-        is_humidity_mismatch(sensor_data->humidity, habitat_data);
+    if (is_temp_mismatch(sensor_data->temperature, habitat_data)) {
+        result_out->environmental_mismatch |= GROW_MISMATCH_TEMPERATURE;
+    }
+    
+    if (is_humidity_mismatch(sensor_data->humidity, habitat_data)) {
+        result_out->environmental_mismatch |= GROW_MISMATCH_HUMIDITY;
+    }
     
-    result_out->environmental_mismatch.soil_moisture = 
-        is_moisture_mismatch(sensor_data->soil_moisture, habitat_data);
+    if (is_moisture_mismatch(sensor_data->soil_moisture, habitat_data)) {
+        result_out->environmental_mismatch |= GROW_MISMATCH_SOIL_MOISTURE;
+    }
     
-    result_out->environmental_mismatch.light_level = 
-        is_light_mismatch(sensor_data->light_level, habitat_data);
+    if (is_light_mismatch(sensor_data->light_level, habitat_data)) {
+        result_out->environmental_mismatch |= GROW_MISMATCH_LIGHT_LEVEL;
+    }
     
     /* Fill result structure */
     result_out->health_status = health_class;
     result_out->confidence = max_prob;
     
-    /* Generate recommendations based on mismatches */
-    generate_recommendations(result_out);
-    
     return 0;
 }
 
+/**
+ * @brief Get the inference statistics
+ * 
+ * @param stats_out Pointer to store the statistics
+ */
+void ml_get_stats(struct ml_stats *stats_out)
+{
+    if (!stats_out) {
+        return;
+    }
+    
+    stats_out->inferences = atomic_get(&stat_inferences);
+    stats_out->cache_hits = atomic_get(&stat_cache_hits);
+}
+
 /**
  * @brief Generate storage key for sensor history
  */
-static void generate_history_key(const char *serial_number, char *key_out, size_t key_size)
+static void generate_history_key(const char *prefix, const char *serial_number,
+                                 char *key_out, size_t key_size)
 {
-    snprintf(key_out, key_size, "%s%s", SENSOR_HISTORY_KEY_PREFIX, serial_number);
+    snprintf(key_out, key_size, "%s%s", prefix, serial_number);
+}
+
+/**
+ * @brief Convert a value to its persisted fixed point
+ */
+static int32_t to_fixed(float value, int channel)
+{
+    return grow_fixed_from_float(value, channel_scale[channel], INT32_MIN, INT32_MAX);
 }
 
 /**
  * @brief Save sensor data history to storage
  * 
+ * The current values are stored in fixed point, followed by the hourly
+ * history as a compressed block, oldest first.
+ * 
  * @param serial_number Device serial number
  * @param sensor_data Sensor data with history
  * @return 0 on success, negative errno on failure
@@ -299,21 +437,121 @@ static void generate_history_key(const char *serial_number, char *key_out, size_
 int ml_save_sensor_history(const char *serial_number,
                          const struct sensor_data_with_history *sensor_data)
 {
-    char key[SENSOR_HISTORY_KEY_MAX];
-    generate_history_key(serial_number, key, sizeof(key));
+    struct sensor_history_header header;
+    struct tsc_encoder enc;
+    int32_t values[SENSOR_CHANNELS];
+    
+    header.timestamp = sensor_data->timestamp;
+    header.values[0] = to_fixed(sensor_data->soil_moisture, 0);
+    header.values[1] = to_fixed(sensor_data->light_level, 1);
+    header.values[2] = to_fixed(sensor_data->temperature, 2);
+    header.values[3] = to_fixed(sensor_data->humidity, 3);
+    header.values[4] = to_fixed(sensor_data->air_movement, 4);
+    memcpy(history_buf, &header, sizeof(header));
+    
+    /* All channels are updated together, so they share one position */
+    int count = sensor_data->history[0].filled ? SENSOR_HISTORY_LEN : sensor_data->history[0].index;
+    int oldest = sensor_data->history[0].filled ? sensor_data->history[0].index : 0;
+    
+    int ret = tsc_encoder_init(&enc, history_buf + sizeof(header),
+                               sizeof(history_buf) - sizeof(header), SENSOR_CHANNELS);
+    
+    for (int i = 0; ret == 0 && i < count; i++) {
+        int idx = (oldest + i) % SENSOR_HISTORY_LEN;
+        
+        for (int ch = 0; ch < SENSOR_CHANNELS; ch++) {
+            values[ch] = to_fixed(sensor_data->history[ch].values[idx], ch);
+        }
+        
+        /* Samples are hourly, the sample number serves as timestamp */
+        ret = tsc_encoder_add(&enc, i, values);
+    }
+    
+    if (ret < 0) {
+        LOG_ERR("Failed to compress sensor history: %d", ret);
+        return ret;
+    }
+    
+    size_t len = sizeof(header) + tsc_encoder_finish(&enc);
     
-    int ret = storage_save_value(key, sensor_data, sizeof(struct sensor_data_with_history));
+    ret = storage_save_key(STORAGE_KEY_SENSOR_HISTORY, history_buf, len);
     if (ret < 0) {
         LOG_ERR("Failed to save sensor history: %d", ret);
         return ret;
     }
     
+    if (legacy_key_present) {
+        char key[SENSOR_HISTORY_KEY_MAX];
+        
+        generate_history_key(SENSOR_HISTORY_LEGACY_KEY_PREFIX, serial_number,
+                             key, sizeof(key));
+        storage_delete_value(key);
+        legacy_key_present = false;
+    }
+    
+    return 0;
+}
+
+/**
+ * @brief Restore sensor data from its persisted form
+ */
+static int restore_history(const uint8_t *buf, size_t len,
+                           struct sensor_data_with_history *sensor_data)
+{
+    struct sensor_history_header header;
+    struct tsc_decoder dec;
+    int32_t values[SENSOR_CHANNELS];
+    int64_t sample;
+    int count = 0;
+    
+    if (len < sizeof(header)) {
+        return -EBADMSG;
+    }
+    
+    memcpy(&header, buf, sizeof(header));
+    
+    int ret = tsc_decoder_init(&dec, buf + sizeof(header), len - sizeof(header));
+    if (ret < 0) {
+        return ret;
+    }
+    
+    if (tsc_decoder_channels(&dec) != SENSOR_CHANNELS ||
+        tsc_decoder_count(&dec) > SENSOR_HISTORY_LEN) {
+        return -EBADMSG;
+    }
+    
+    sensor_data->timestamp = header.timestamp;
+    sensor_data->soil_moisture = header.values[0] / (float)channel_scale[0];
+    sensor_data->light_level = header.values[1] / (float)channel_scale[1];
+    sensor_data->temperature = header.values[2] / (float)channel_scale[2];
+    sensor_data->humidity = header.values[3] / (float)channel_scale[3];
+    sensor_data->air_movement = header.values[4] / (float)channel_scale[4];
+    
+    while ((ret = tsc_decoder_next(&dec, &sample, values)) == 0) {
+        for (int ch = 0; ch < SENSOR_CHANNELS; ch++) {
+            sensor_data->history[ch].values[count] = values[ch] / (float)channel_scale[ch];
+        }
+        count++;
+    }
+    
+    if (ret != -ENODATA) {
+        return ret;
+    }
+    
+    for (int ch = 0; ch < SENSOR_CHANNELS; ch++) {
+        sensor_data->history[ch].index = count % SENSOR_HISTORY_LEN;
+        sensor_data->history[ch].filled = (count == SENSOR_HISTORY_LEN);
+    }
+    
     return 0;
 }
 
 /**
  * @brief Load sensor data history from storage
  * 
+ * Falls back to the raw structure older firmware stored under the
+ * legacy key.
+ * 
  * @param serial_number Device serial number
  * @param sensor_data Pointer to store sensor data with history
  * @return 0 on success, negative errno on failure
@@ -322,10 +560,32 @@ int ml_load_sensor_history(const char *serial_number,
                          struct sensor_data_with_history *sensor_data)
 {
     char key[SENSOR_HISTORY_KEY_MAX];
-    generate_history_key(serial_number, key, sizeof(key));
+    generate_history_key(SENSOR_HISTORY_HASHED_KEY_PREFIX, serial_number, key, sizeof(key));
+    
+    memset(sensor_data, 0, sizeof(struct sensor_data_with_history));
     
-    size_t data_size = sizeof(struct sensor_data_with_history);
-    int ret = storage_load_value(key, sensor_data, &data_size);
+    size_t data_size = sizeof(history_buf);
+    int ret = storage_load_key_legacy(STORAGE_KEY_SENSOR_HISTORY, key,
+                                      history_buf, &data_size);
+    if (ret == 0) {
+        ret = data_size <= sizeof(history_buf) ?
+              restore_history(history_buf, data_size, sensor_data) : -EBADMSG;
+        if (ret < 0) {
+            LOG_ERR("Invalid sensor history: %d", ret);
+            memset(sensor_data, 0, sizeof(struct sensor_data_with_history));
+        }
+        return ret;
+    }
+    
+    if (ret != -ENOENT) {
+        LOG_ERR("Failed to load sensor history: %d", ret);
+        return ret;
+    }
+    
+    generate_history_key(SENSOR_HISTORY_LEGACY_KEY_PREFIX, serial_number, key, sizeof(key));
+    
+    data_size = sizeof(struct sensor_data_with_history);
+    ret = storage_load_value(key, sensor_data, &data_size);
     if (ret < 0) {
         /* Initialize fresh history if not found */
         if (ret == -ENOENT) {
@@ -337,5 +597,6 @@ int ml_load_sensor_history(const char *serial_number,
         return ret;
     }
     
+    legacy_key_present = true;
     return 0;
-}
\ No newline at end of file
+}
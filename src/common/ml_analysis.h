@@ -2,6 +2,7 @@
 #define ML_ANALYSIS_H
 
 #include "habitat_data.h"
+#include "../grow_reading.h"
 
 /* Plant health status definitions */
 #define ML_HEALTH_HEALTHY 0
@@ -30,13 +31,13 @@ struct sensor_data_with_history {
 struct ml_analysis_result {
     int health_status;  /* HEALTHY, STRESSED, CRITICAL */
     float confidence;
-    struct {
-        bool temperature;
-        bool humidity;
-        bool soil_moisture;
-        bool light_level;
-    } environmental_mismatch;
-    char recommendation[256];
+    uint8_t environmental_mismatch; /* GROW_MISMATCH_* bits */
+};
+
+/* Inference statistics */
+struct ml_stats {
+    uint32_t inferences;    /* Interpreter runs */
+    uint32_t cache_hits;    /* Analyses that reused the last inference */
 };
 
 /**
@@ -46,21 +47,24 @@ struct ml_analysis_result {
  */
 int ml_analysis_init(void);
 
+/**
+ * @brief Get the tensor arena usage of the loaded model
+ * 
+ * @param used_out Pointer to store the arena bytes used
+ * @param size_out Pointer to store the arena size
+ * @return 0 on success, -ENODEV if the model is not loaded
+ */
+int ml_get_arena_usage(size_t *used_out, size_t *size_out);
+
 /**
  * @brief Add sensor reading to history
  * 
  * @param sensor_data Pointer to sensor data structure
- * @param soil_moisture Current soil moisture reading
- * @param light_level Current light level reading
- * @param temperature Current temperature reading
- * @param humidity Current humidity reading
- * @param air_movement Current air movement reading
+ * @param reading Current sensor reading
  * @return 0 on success, negative errno on failure
  */
 int ml_add_sensor_reading(struct sensor_data_with_history *sensor_data,
-                         float soil_moisture, float light_level,
-                         float temperature, float humidity,
-                         float air_movement);
+                         const struct grow_reading *reading);
 
 /**
  * @brief Analyze plant health based on sensor and habitat data
@@ -74,6 +78,13 @@ int ml_analyze_plant_health(const struct sensor_data_with_history *sensor_data,
                            const struct habitat_data *habitat_data,
                            struct ml_analysis_result *result_out);
 
+/**
+ * @brief Get the inference statistics
+ * 
+ * @param stats_out Pointer to store the statistics
+ */
+void ml_get_stats(struct ml_stats *stats_out);
+
 /**
  * @brief Save sensor data history to storage
  * 
@@ -7,12 +7,49 @@
 #include "ml_analysis.h"
 #include "habitat_data.h"
 #include "../connectivity.h"
+#include "../perf.h"
+#include "../mem_monitor.h"
 
 LOG_MODULE_REGISTER(plant_analysis, CONFIG_LOG_DEFAULT_LEVEL);
 
+BUILD_ASSERT(ML_HEALTH_HEALTHY == GROW_HEALTH_HEALTHY &&
+             ML_HEALTH_STRESSED == GROW_HEALTH_STRESSED &&
+             ML_HEALTH_CRITICAL == GROW_HEALTH_CRITICAL,
+             "ML health classes must match enum grow_health");
+
+/* Habitat data is fetched again after this many seconds */
+#define HABITAT_REFRESH_SEC 86400
+
 /* Static sensor data buffer */
 static struct sensor_data_with_history sensor_data;
 static struct habitat_data habitat_data;
+static bool history_loaded = false;
+
+/* Plant the habitat data belongs to, and when it was last fetched */
+static char habitat_plant[128];
+static int64_t habitat_fetch_time = -1;
+
+/**
+ * @brief Check whether habitat data must be fetched again
+ */
+static bool habitat_refresh_due(const char *plant_name, const char *plant_variety)
+{
+    char plant[sizeof(habitat_plant)];
+
+    snprintf(plant, sizeof(plant), "%s/%s", plant_name, plant_variety);
+    if (strcmp(plant, habitat_plant) != 0) {
+        /* Plant changed, e.g. after provisioning */
+        strcpy(habitat_plant, plant);
+        habitat_fetch_time = -1;
+        return true;
+    }
+
+    if (!habitat_data.data_valid || habitat_fetch_time < 0) {
+        return true;
+    }
+
+    return (k_uptime_get() / 1000) - habitat_fetch_time >= HABITAT_REFRESH_SEC;
+}
 
 /**
  * @brief Initialize plant analysis subsystem
@@ -23,6 +60,8 @@ int plant_analysis_init(void)
 {
     int ret;
     
+    mem_monitor_register("plant_analysis", "sensor_history", sizeof(sensor_data));
+    
     /* Initialize ML analysis */
     ret = ml_analysis_init();
     if (ret < 0) {
@@ -44,40 +83,64 @@ int plant_analysis_init(void)
     return 0;
 }
 
+/**
+ * @brief Restore sensor history and cached habitat data
+ * 
+ * @param serial_number Device serial number
+ * @param plant_name Plant name
+ * @param plant_variety Plant variety
+ * @return 0 on success, negative errno on failure
+ */
+int plant_analysis_restore(const char *serial_number,
+                         const char *plant_name,
+                         const char *plant_variety)
+{
+    int ret = ml_load_sensor_history(serial_number, &sensor_data);
+    if (ret < 0) {
+        LOG_WRN("Failed to load sensor history: %d", ret);
+        /* Continue anyway */
+    }
+    history_loaded = true;
+    
+    /* Habitat data from the cache saves a network round trip on the first reading */
+    snprintf(habitat_plant, sizeof(habitat_plant), "%s/%s", plant_name, plant_variety);
+    if (habitat_data_load_cache(plant_name, plant_variety, &habitat_data) == 0) {
+        habitat_fetch_time = k_uptime_get() / 1000;
+    }
+    
+    LOG_INF("Plant analysis state restored");
+    return 0;
+}
+
 /**
  * @brief Process new sensor readings
  * 
  * This function:
  * 1. Updates sensor history
- * 2. Fetches/loads habitat data if needed
+ * 2. Fetches habitat data when it is missing, stale or the plant changed
  * 3. Runs ML analysis
- * 4. Returns analysis results
+ * 4. Stores health, mismatch and confidence in the reading
  * 
  * @param serial_number Device serial number
  * @param plant_name Plant name
  * @param plant_variety Plant variety
- * @param soil_moisture Current soil moisture reading
- * @param light_level Current light level reading
- * @param temperature Current temperature reading
- * @param humidity Current humidity reading
- * @param air_movement Current air movement reading
- * @param result_out Pointer to store analysis results
+ * @param reading Current sensor reading, updated with the analysis results
  * @return 0 on success, negative errno on failure
  */
 int plant_analysis_process_reading(const char *serial_number,
                                  const char *plant_name,
                                  const char *plant_variety,
-                                 float soil_moisture,
-                                 float light_level,
-                                 float temperature,
-                                 float humidity,
-                                 float air_movement,
-                                 struct ml_analysis_result *result_out)
+                                 struct grow_reading *reading)
 {
     int ret;
+    uint32_t start;
+    struct ml_analysis_result result;
     
-    /* Load sensor history if not already loaded */
-    static bool history_loaded = false;
+    if (!reading) {
+        return -EINVAL;
+    }
+    
+    /* Load sensor history if not already restored */
     if (!history_loaded) {
         ret = ml_load_sensor_history(serial_number, &sensor_data);
         if (ret < 0 && ret != -ENOENT) {
@@ -88,8 +151,9 @@ int plant_analysis_process_reading(const char *serial_number,
     }
     
     /* Add new sensor reading to history */
-    ret = ml_add_sensor_reading(&sensor_data, soil_moisture, light_level,
-                               temperature, humidity, air_movement);
+    start = perf_begin();
+    ret = ml_add_sensor_reading(&sensor_data, reading);
+    perf_end(PERF_ML_ADD_READING, start);
     if (ret < 0) {
         LOG_ERR("Failed to add sensor reading: %d", ret);
         return ret;
@@ -103,7 +167,19 @@ int plant_analysis_process_reading(const char *serial_number,
     }
     
     /* Try to fetch habitat data if connected, otherwise use cached data */
-    ret = habitat_data_fetch(plant_name, plant_variety, &habitat_data);
+    if (habitat_refresh_due(plant_name, plant_variety)) {
+        bool online = connectivity_is_connected();
+
+        start = perf_begin();
+        ret = habitat_data_fetch(plant_name, plant_variety, &habitat_data);
+        perf_end(PERF_HABITAT_FETCH, start);
+        if (ret == 0 && online) {
+            habitat_fetch_time = k_uptime_get() / 1000;
+        }
+    } else {
+        ret = 0;
+    }
+    
     if (ret < 0) {
         LOG_WRN("Failed to fetch habitat data: %d", ret);
         
@@ -126,97 +202,29 @@ int plant_analysis_process_reading(const char *serial_number,
     }
     
     /* Perform ML analysis */
-    ret = ml_analyze_plant_health(&sensor_data, &habitat_data, result_out);
+    ret = ml_analyze_plant_health(&sensor_data, &habitat_data, &result);
     if (ret < 0) {
         LOG_ERR("Failed to analyze plant health: %d", ret);
         return ret;
     }
     
+    reading->health = result.health_status;
+    reading->mismatch = result.environmental_mismatch;
+    reading->confidence = grow_fixed_from_float(result.confidence, 100, 0, 100);
+    reading->flags |= GROW_READING_ANALYZED;
+    
     LOG_INF("Plant analysis completed - Health: %d, Confidence: %.2f",
-           result_out->health_status, result_out->confidence);
+           result.health_status, result.confidence);
     
     return 0;
 }
 
 /**
- * @brief Get environmental mismatch string
+ * @brief Get the sensor data history used by the analysis
  * 
- * @param result Analysis result
- * @param output_str Output string buffer
- * @param output_size Size of output buffer
- * @return 0 on success, negative errno on failure
+ * @return Pointer to the current sensor readings with history
  */
-int plant_analysis_get_mismatch_string(const struct ml_analysis_result *result,
-                                     char *output_str,
-                                     size_t output_size)
+const struct sensor_data_with_history *plant_analysis_get_sensor_data(void)
 {
-    if (!result || !output_str || output_size == 0) {
-        return -EINVAL;
-    }
-    
-    /* Build mismatch string */
-    int written = 0;
-    
-    if (result->environmental_mismatch.temperature) {
-        written += snprintf(output_str + written, output_size - written, "temp,");
-    }
-    
-    if (result->environmental_mismatch.humidity) {
-        written += snprintf(output_str + written, output_size - written, "humid,");
-    }
-    
-    if (result->environmental_mismatch.soil_moisture) {
-        written += snprintf(output_str + written, output_size - written, "moist,");
-    }
-    
-    if (result->environmental_mismatch.light_level) {
-        written += snprintf(output_str + written, output_size - written, "light,");
-    }
-    
-    /* Remove trailing comma if any */
-    if (written > 0 && output_str[written - 1] == ',') {
-        output_str[written - 1] = '\0';
-    } else if (written == 0) {
-        /* No mismatches */
-        strncpy(output_str, "none", output_size - 1);
-        output_str[output_size - 1] = '\0';
-    }
-    
-    return 0;
+    return &sensor_data;
 }
-
-/**
- * @brief Get plant status string based on analysis results
- * 
- * @param result Analysis result
- * @param output_str Output string buffer
- * @param output_size Size of output buffer
- * @return 0 on success, negative errno on failure
- */
-int plant_analysis_get_status_string(const struct ml_analysis_result *result, 
-                                  char *output_str, 
-                                  size_t output_size) 
-{
-    if (!result || !output_str || output_size == 0) {
-        return -EINVAL;
-    }
-    
-    if (result->health_status == ML_HEALTH_CRITICAL) {
-        strncpy(output_str, "Critical", output_size - 1);
-    } else if (result->health_status == ML_HEALTH_STRESSED) {
-        strncpy(output_str, "Stressed", output_size - 1);
-    } else {
-        /* Check for any mismatch */
-        if (result->environmental_mismatch.temperature || 
-            result->environmental_mismatch.humidity ||
-            result->environmental_mismatch.soil_moisture ||
-            result->environmental_mismatch.light_level) {
-            strncpy(output_str, "Adjustment Needed", output_size - 1);
-        } else {
-            strncpy(output_str, "Healthy", output_size - 1);
-        }
-    }
-    
-    output_str[output_size - 1] = '\0';
-    return 0;
-}
\ No newline at end of file
@@ -3,6 +3,7 @@
 
 #include "ml_analysis.h"
 #include "habitat_data.h"
+#include "../grow_reading.h"
 
 /**
  * @brief Initialize plant analysis subsystem
@@ -11,58 +12,46 @@
  */
 int plant_analysis_init(void);
 
+/**
+ * @brief Restore sensor history and cached habitat data
+ * 
+ * Called once during boot so the first analysed reading does not wait
+ * for storage or network access.
+ * 
+ * @param serial_number Device serial number
+ * @param plant_name Plant name
+ * @param plant_variety Plant variety
+ * @return 0 on success, negative errno on failure
+ */
+int plant_analysis_restore(const char *serial_number,
+                         const char *plant_name,
+                         const char *plant_variety);
+
 /**
  * @brief Process new sensor readings
  * 
  * This function:
  * 1. Updates sensor history
- * 2. Fetches/loads habitat data if needed
+ * 2. Fetches habitat data when it is missing, stale or the plant changed
  * 3. Runs ML analysis
- * 4. Returns analysis results
+ * 4. Stores health, mismatch and confidence in the reading
  * 
  * @param serial_number Device serial number
  * @param plant_name Plant name
  * @param plant_variety Plant variety
- * @param soil_moisture Current soil moisture reading
- * @param light_level Current light level reading
- * @param temperature Current temperature reading
- * @param humidity Current humidity reading
- * @param air_movement Current air movement reading
- * @param result_out Pointer to store analysis results
+ * @param reading Current sensor reading, updated with the analysis results
  * @return 0 on success, negative errno on failure
  */
 int plant_analysis_process_reading(const char *serial_number,
                                  const char *plant_name,
                                  const char *plant_variety,
-                                 float soil_moisture,
-                                 float light_level,
-                                 float temperature,
-                                 float humidity,
-                                 float air_movement,
-                                 struct ml_analysis_result *result_out);
+                                 struct grow_reading *reading);
 
 /**
- * @brief Get environmental mismatch string
+ * @brief Get the sensor data history used by the analysis
  * 
- * @param result Analysis result
- * @param output_str Output string buffer
- * @param output_size Size of output buffer
- * @return 0 on success, negative errno on failure
- */
-int plant_analysis_get_mismatch_string(const struct ml_analysis_result *result,
-                                     char *output_str,
-                                     size_t output_size);
-
-/**
- * @brief Get plant status string based on analysis results
- * 
- * @param result Analysis result
- * @param output_str Output string buffer
- * @param output_size Size of output buffer
- * @return 0 on success, negative errno on failure
+ * @return Pointer to the current sensor readings with history
  */
-int plant_analysis_get_status_string(const struct ml_analysis_result *result, 
-                                   char *output_str, 
-                                   size_t output_size);
+const struct sensor_data_with_history *plant_analysis_get_sensor_data(void);
 
 #endif /* PLANT_ANALYSIS_H */
\ No newline at end of file
@@ -0,0 +1,335 @@
+#include <zephyr/kernel.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+
+#include "ts_compress.h"
+
+/* Block format version */
+#define TSC_VERSION 1
+
+/* Prefix buckets, payload widths in bits */
+static const uint8_t bucket_bits[] = { 0, 7, 12, 18, 32 };
+
+/**
+ * @brief Write bits, most significant first
+ *
+ * Bits are set and cleared explicitly so a rolled back sample leaves no
+ * trace in the buffer.
+ */
+static int put_bits(struct tsc_encoder *enc, uint32_t value, uint8_t bits)
+{
+    if (enc->bit_pos + bits > enc->size * 8) {
+        return -ENOSPC;
+    }
+
+    for (int i = bits - 1; i >= 0; i--) {
+        uint8_t *byte = &enc->buf[enc->bit_pos / 8];
+        uint8_t mask = 0x80 >> (enc->bit_pos % 8);
+
+        if (value & BIT(i)) {
+            *byte |= mask;
+        } else {
+            *byte &= ~mask;
+        }
+        enc->bit_pos++;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Read bits, most significant first
+ */
+static int get_bits(struct tsc_decoder *dec, uint8_t bits, uint32_t *value)
+{
+    uint32_t result = 0;
+
+    if (dec->bit_pos + bits > dec->len * 8) {
+        return -EBADMSG;
+    }
+
+    for (int i = 0; i < bits; i++) {
+        uint8_t byte = dec->buf[dec->bit_pos / 8];
+
+        result = (result << 1) | ((byte >> (7 - dec->bit_pos % 8)) & 1);
+        dec->bit_pos++;
+    }
+
+    *value = result;
+    return 0;
+}
+
+static uint32_t zigzag(int32_t value)
+{
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static int32_t unzigzag(uint32_t value)
+{
+    return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+/**
+ * @brief Write a signed value behind its bucket prefix
+ */
+static int put_varbits(struct tsc_encoder *enc, int32_t value)
+{
+    uint32_t zz = zigzag(value);
+    int bucket = 0;
+
+    while (bucket < (int)ARRAY_SIZE(bucket_bits) - 1 &&
+           zz >= BIT64(bucket_bits[bucket])) {
+        bucket++;
+    }
+
+    /* Prefix is 'bucket' ones, ended by a zero except for the last bucket */
+    bool last = bucket == (int)ARRAY_SIZE(bucket_bits) - 1;
+    uint8_t prefix_bits = last ? bucket : bucket + 1;
+    uint32_t prefix = last ? BIT(bucket) - 1 : BIT(bucket + 1) - 2;
+
+    int ret = put_bits(enc, prefix, prefix_bits);
+    if (ret < 0) {
+        return ret;
+    }
+
+    return put_bits(enc, zz, bucket_bits[bucket]);
+}
+
+/**
+ * @brief Read a signed value behind its bucket prefix
+ */
+static int get_varbits(struct tsc_decoder *dec, int32_t *value)
+{
+    int bucket = 0;
+    uint32_t bit;
+    uint32_t zz;
+    int ret;
+
+    while (bucket < (int)ARRAY_SIZE(bucket_bits) - 1) {
+        ret = get_bits(dec, 1, &bit);
+        if (ret < 0) {
+            return ret;
+        }
+        if (!bit) {
+            break;
+        }
+        bucket++;
+    }
+
+    ret = get_bits(dec, bucket_bits[bucket], &zz);
+    if (ret < 0) {
+        return ret;
+    }
+
+    *value = unzigzag(zz);
+    return 0;
+}
+
+/**
+ * @brief Start a block
+ *
+ * @param enc Encoder
+ * @param buf Block buffer
+ * @param size Buffer size
+ * @param channels Values per sample, 1 to TSC_MAX_CHANNELS
+ * @return 0 on success, negative errno on failure
+ */
+int tsc_encoder_init(struct tsc_encoder *enc, uint8_t *buf, size_t size,
+                     uint8_t channels)
+{
+    if (!enc || !buf || channels == 0 || channels > TSC_MAX_CHANNELS) {
+        return -EINVAL;
+    }
+
+    if (size < TSC_HEADER_SIZE) {
+        return -ENOSPC;
+    }
+
+    memset(enc, 0, sizeof(*enc));
+    enc->buf = buf;
+    enc->size = size;
+    enc->channels = channels;
+    enc->bit_pos = TSC_HEADER_SIZE * 8;
+
+    return 0;
+}
+
+/**
+ * @brief Append a sample
+ *
+ * @param enc Encoder
+ * @param timestamp Sample timestamp
+ * @param values One value per channel
+ * @return 0 on success, -ENOSPC if the buffer is full, -ERANGE if the
+ *         timestamp step changed by more than 32 bits
+ */
+int tsc_encoder_add(struct tsc_encoder *enc, int64_t timestamp, const int32_t *values)
+{
+    size_t start = enc->bit_pos;
+    int64_t delta = 0;
+    int ret;
+
+    if (!values) {
+        return -EINVAL;
+    }
+
+    if (enc->count == UINT16_MAX) {
+        return -ENOSPC;
+    }
+
+    if (enc->count == 0) {
+        /* First sample raw */
+        ret = put_bits(enc, (uint32_t)((uint64_t)timestamp >> 32), 32);
+        if (ret == 0) {
+            ret = put_bits(enc, (uint32_t)timestamp, 32);
+        }
+        for (int i = 0; ret == 0 && i < enc->channels; i++) {
+            ret = put_bits(enc, (uint32_t)values[i], 32);
+        }
+    } else {
+        delta = timestamp - enc->prev_timestamp;
+        int64_t dod = delta - enc->prev_delta;
+
+        if (dod < INT32_MIN || dod > INT32_MAX) {
+            return -ERANGE;
+        }
+
+        ret = put_varbits(enc, (int32_t)dod);
+        for (int i = 0; ret == 0 && i < enc->channels; i++) {
+            /* Wrapping difference, decoded with the same wrap */
+            ret = put_varbits(enc, (int32_t)((uint32_t)values[i] -
+                                             (uint32_t)enc->prev_values[i]));
+        }
+    }
+
+    if (ret < 0) {
+        enc->bit_pos = start;
+        return ret;
+    }
+
+    enc->prev_delta = delta;
+    enc->prev_timestamp = timestamp;
+    memcpy(enc->prev_values, values, enc->channels * sizeof(values[0]));
+    enc->count++;
+
+    return 0;
+}
+
+/**
+ * @brief Finish a block
+ *
+ * @param enc Encoder
+ * @return Block length in bytes
+ */
+size_t tsc_encoder_finish(struct tsc_encoder *enc)
+{
+    size_t len = (enc->bit_pos + 7) / 8;
+
+    enc->buf[0] = TSC_VERSION;
+    enc->buf[1] = enc->channels;
+    enc->buf[2] = enc->count & 0xFF;
+    enc->buf[3] = enc->count >> 8;
+
+    /* Clear the padding of the last byte */
+    if (enc->bit_pos % 8) {
+        enc->buf[len - 1] &= 0xFF00 >> (enc->bit_pos % 8);
+    }
+
+    return len;
+}
+
+/**
+ * @brief Open a block for decoding
+ *
+ * @param dec Decoder
+ * @param buf Block
+ * @param len Block length
+ * @return 0 on success, -EBADMSG if the header is invalid
+ */
+int tsc_decoder_init(struct tsc_decoder *dec, const uint8_t *buf, size_t len)
+{
+    if (!dec || !buf) {
+        return -EINVAL;
+    }
+
+    if (len < TSC_HEADER_SIZE || buf[0] != TSC_VERSION ||
+        buf[1] == 0 || buf[1] > TSC_MAX_CHANNELS) {
+        return -EBADMSG;
+    }
+
+    memset(dec, 0, sizeof(*dec));
+    dec->buf = buf;
+    dec->len = len;
+    dec->channels = buf[1];
+    dec->count = buf[2] | (buf[3] << 8);
+    dec->bit_pos = TSC_HEADER_SIZE * 8;
+
+    return 0;
+}
+
+/**
+ * @brief Decode the next sample
+ *
+ * @param dec Decoder
+ * @param timestamp Pointer to store the timestamp
+ * @param values Array of tsc_decoder_channels() values to fill
+ * @return 0 on success, -ENODATA after the last sample, -EBADMSG if the
+ *         block is truncated
+ */
+int tsc_decoder_next(struct tsc_decoder *dec, int64_t *timestamp, int32_t *values)
+{
+    uint32_t high, low;
+    int32_t diff;
+    int ret;
+
+    if (!timestamp || !values) {
+        return -EINVAL;
+    }
+
+    if (dec->index >= dec->count) {
+        return -ENODATA;
+    }
+
+    if (dec->index == 0) {
+        ret = get_bits(dec, 32, &high);
+        if (ret == 0) {
+            ret = get_bits(dec, 32, &low);
+        }
+        if (ret < 0) {
+            return ret;
+        }
+
+        dec->prev_timestamp = (int64_t)(((uint64_t)high << 32) | low);
+
+        for (int i = 0; i < dec->channels; i++) {
+            ret = get_bits(dec, 32, &low);
+            if (ret < 0) {
+                return ret;
+            }
+            dec->prev_values[i] = (int32_t)low;
+        }
+    } else {
+        ret = get_varbits(dec, &diff);
+        if (ret < 0) {
+            return ret;
+        }
+
+        dec->prev_delta += diff;
+        dec->prev_timestamp += dec->prev_delta;
+
+        for (int i = 0; i < dec->channels; i++) {
+            ret = get_varbits(dec, &diff);
+            if (ret < 0) {
+                return ret;
+            }
+            dec->prev_values[i] = (int32_t)((uint32_t)dec->prev_values[i] + (uint32_t)diff);
+        }
+    }
+
+    dec->index++;
+    *timestamp = dec->prev_timestamp;
+    memcpy(values, dec->prev_values, dec->channels * sizeof(values[0]));
+
+    return 0;
+}
@@ -0,0 +1,135 @@
+#ifndef TS_COMPRESS_H
+#define TS_COMPRESS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Streaming time-series block compression
+ *
+ * A block holds samples of a timestamp and up to TSC_MAX_CHANNELS
+ * fixed-point values. Timestamps are stored as delta-of-delta and values
+ * as deltas to the previous sample, each zigzag encoded behind a prefix
+ * selecting 0, 7, 12, 18 or 32 bits. A fixed sampling interval costs one
+ * bit per timestamp and an unchanged value one bit per channel.
+ *
+ * Block layout: version, channel count, sample count (little-endian
+ * u16), then the bit stream, most significant bit first. The first
+ * sample is stored raw.
+ */
+
+/* Largest number of values per sample */
+#define TSC_MAX_CHANNELS 8
+
+/* Block header size */
+#define TSC_HEADER_SIZE 4
+
+/* Worst-case block size for a number of samples (at least one) */
+#define TSC_BOUND(samples, channels) \
+    (TSC_HEADER_SIZE + \
+     (64 + 32 * (channels) + ((samples) - 1) * 36 * ((channels) + 1) + 7) / 8)
+
+/* Block encoder */
+struct tsc_encoder {
+    uint8_t *buf;
+    size_t size;
+    size_t bit_pos;
+    uint16_t count;
+    uint8_t channels;
+    int64_t prev_timestamp;
+    int64_t prev_delta;
+    int32_t prev_values[TSC_MAX_CHANNELS];
+};
+
+/* Block decoder, iterates the samples in order */
+struct tsc_decoder {
+    const uint8_t *buf;
+    size_t len;
+    size_t bit_pos;
+    uint16_t count;
+    uint16_t index;
+    uint8_t channels;
+    int64_t prev_timestamp;
+    int64_t prev_delta;
+    int32_t prev_values[TSC_MAX_CHANNELS];
+};
+
+/**
+ * @brief Start a block
+ *
+ * @param enc Encoder
+ * @param buf Block buffer
+ * @param size Buffer size
+ * @param channels Values per sample, 1 to TSC_MAX_CHANNELS
+ * @return 0 on success, negative errno on failure
+ */
+int tsc_encoder_init(struct tsc_encoder *enc, uint8_t *buf, size_t size,
+                     uint8_t channels);
+
+/**
+ * @brief Append a sample
+ *
+ * The block is left unchanged when the sample does not fit.
+ *
+ * @param enc Encoder
+ * @param timestamp Sample timestamp
+ * @param values One value per channel
+ * @return 0 on success, -ENOSPC if the buffer is full, -ERANGE if the
+ *         timestamp step changed by more than 32 bits
+ */
+int tsc_encoder_add(struct tsc_encoder *enc, int64_t timestamp, const int32_t *values);
+
+/**
+ * @brief Finish a block
+ *
+ * Samples may still be appended after finishing.
+ *
+ * @param enc Encoder
+ * @return Block length in bytes
+ */
+size_t tsc_encoder_finish(struct tsc_encoder *enc);
+
+/**
+ * @brief Open a block for decoding
+ *
+ * @param dec Decoder
+ * @param buf Block
+ * @param len Block length
+ * @return 0 on success, -EBADMSG if the header is invalid
+ */
+int tsc_decoder_init(struct tsc_decoder *dec, const uint8_t *buf, size_t len);
+
+/**
+ * @brief Get the number of samples in a block
+ *
+ * @param dec Decoder
+ * @return Sample count
+ */
+static inline uint16_t tsc_decoder_count(const struct tsc_decoder *dec)
+{
+    return dec->count;
+}
+
+/**
+ * @brief Get the number of values per sample in a block
+ *
+ * @param dec Decoder
+ * @return Channel count
+ */
+static inline uint8_t tsc_decoder_channels(const struct tsc_decoder *dec)
+{
+    return dec->channels;
+}
+
+/**
+ * @brief Decode the next sample
+ *
+ * @param dec Decoder
+ * @param timestamp Pointer to store the timestamp
+ * @param values Array of tsc_decoder_channels() values to fill
+ * @return 0 on success, -ENODATA after the last sample, -EBADMSG if the
+ *         block is truncated
+ */
+int tsc_decoder_next(struct tsc_decoder *dec, int64_t *timestamp, int32_t *values);
+
+#endif /* TS_COMPRESS_H */
@@ -5,13 +5,29 @@
 #include <math.h>
 
 #include "water_analysis.h"
+#include "ts_compress.h"
+#include "../grow_reading.h"
 #include "../storage.h"
+#include "../mem_monitor.h"
 
 LOG_MODULE_REGISTER(water_analysis, CONFIG_LOG_DEFAULT_LEVEL);
 
+/*
+ * String keys of older firmware, by serial number. The hashed key held
+ * the current format, the legacy key the raw pattern structure.
+ */
+#define WATER_HASHED_KEY_FORMAT "water2/%s"
+#define WATER_LEGACY_KEY_FORMAT "water/%s"
+
 /* Static buffer for water pattern analysis */
 static struct water_consumption_pattern water_pattern;
 
+/* Compressed moisture history, as persisted */
+static uint8_t history_block[TSC_BOUND(WATER_HISTORY_SIZE, 1)];
+
+/* The legacy key is deleted once the history is saved under the new one */
+static bool legacy_key_present;
+
 /**
  * @brief Initialize water analysis module
  * 
@@ -21,6 +37,8 @@ int water_analysis_init(void)
 {
     /* Clear water pattern data */
     memset(&water_pattern, 0, sizeof(water_pattern));
+    mem_monitor_register("water_analysis", "water_pattern", sizeof(water_pattern));
+    mem_monitor_register("water_analysis", "history_block", sizeof(history_block));
     
     LOG_INF("Water analysis module initialized");
     return 0;
@@ -218,35 +236,124 @@ int water_analysis_predict_watering(struct water_consumption_pattern *pattern_ou
 /**
  * @brief Save water analysis data to storage
  * 
+ * The moisture history is stored as a compressed block of 0.01 %
+ * samples, oldest first. The prediction is derived from the history and
+ * is not stored.
+ * 
  * @param serial_number Device serial number
  * @return 0 on success, negative errno on failure
  */
 int water_analysis_save(const char *serial_number)
 {
-    char key[64];
-    snprintf(key, sizeof(key), "water/%s", serial_number);
+    struct tsc_encoder enc;
+    int count = water_pattern.history.filled ? WATER_HISTORY_SIZE : water_pattern.history.index;
+    int oldest = water_pattern.history.filled ? water_pattern.history.index : 0;
+    
+    int ret = tsc_encoder_init(&enc, history_block, sizeof(history_block), 1);
+    
+    for (int i = 0; ret == 0 && i < count; i++) {
+        int idx = (oldest + i) % WATER_HISTORY_SIZE;
+        int32_t moisture = grow_fixed_from_float(water_pattern.history.moisture[idx],
+                                                 GROW_CENTI_SCALE, INT32_MIN, INT32_MAX);
+        
+        ret = tsc_encoder_add(&enc, water_pattern.history.timestamps[idx], &moisture);
+    }
+    
+    if (ret < 0) {
+        LOG_ERR("Failed to compress water history: %d", ret);
+        return ret;
+    }
+    
+    size_t len = tsc_encoder_finish(&enc);
     
-    int ret = storage_save_value(key, &water_pattern, sizeof(water_pattern));
+    ret = storage_save_key(STORAGE_KEY_WATER_HISTORY, history_block, len);
     if (ret < 0) {
         LOG_ERR("Failed to save water analysis data: %d", ret);
+        return ret;
     }
     
-    return ret;
+    if (legacy_key_present) {
+        char key[64];
+        
+        snprintf(key, sizeof(key), WATER_LEGACY_KEY_FORMAT, serial_number);
+        storage_delete_value(key);
+        legacy_key_present = false;
+    }
+    
+    LOG_DBG("Saved %d moisture samples in %zu bytes", count, len);
+    return 0;
+}
+
+/**
+ * @brief Restore the history from a compressed block
+ */
+static int restore_history(const uint8_t *block, size_t len)
+{
+    struct tsc_decoder dec;
+    int64_t timestamp;
+    int32_t moisture;
+    int count = 0;
+    
+    int ret = tsc_decoder_init(&dec, block, len);
+    if (ret < 0) {
+        return ret;
+    }
+    
+    if (tsc_decoder_channels(&dec) != 1 || tsc_decoder_count(&dec) > WATER_HISTORY_SIZE) {
+        return -EBADMSG;
+    }
+    
+    while ((ret = tsc_decoder_next(&dec, &timestamp, &moisture)) == 0) {
+        water_pattern.history.moisture[count] = moisture / (float)GROW_CENTI_SCALE;
+        water_pattern.history.timestamps[count] = timestamp;
+        count++;
+    }
+    
+    if (ret != -ENODATA) {
+        return ret;
+    }
+    
+    water_pattern.history.index = count % WATER_HISTORY_SIZE;
+    water_pattern.history.filled = (count == WATER_HISTORY_SIZE);
+    
+    return 0;
 }
 
 /**
  * @brief Load water analysis data from storage
  * 
+ * Falls back to the raw structure older firmware stored under the
+ * legacy key.
+ * 
  * @param serial_number Device serial number
  * @return 0 on success, negative errno on failure
  */
 int water_analysis_load(const char *serial_number)
 {
     char key[64];
-    snprintf(key, sizeof(key), "water/%s", serial_number);
+    snprintf(key, sizeof(key), WATER_HASHED_KEY_FORMAT, serial_number);
+    
+    size_t size = sizeof(history_block);
+    int ret = storage_load_key_legacy(STORAGE_KEY_WATER_HISTORY, key, history_block, &size);
+    
+    if (ret == 0) {
+        ret = size <= sizeof(history_block) ? restore_history(history_block, size) : -EBADMSG;
+        if (ret < 0) {
+            LOG_ERR("Invalid water history block: %d", ret);
+            memset(&water_pattern.history, 0, sizeof(water_pattern.history));
+        }
+        return ret;
+    }
     
-    size_t size = sizeof(water_pattern);
-    int ret = storage_load_value(key, &water_pattern, &size);
+    if (ret != -ENOENT) {
+        LOG_ERR("Failed to load water analysis data: %d", ret);
+        return ret;
+    }
+    
+    snprintf(key, sizeof(key), WATER_LEGACY_KEY_FORMAT, serial_number);
+    
+    size = sizeof(water_pattern);
+    ret = storage_load_value(key, &water_pattern, &size);
     
     if (ret < 0) {
         LOG_ERR("Failed to load water analysis data: %d", ret);
@@ -254,7 +361,9 @@ int water_analysis_load(const char *serial_number)
         LOG_ERR("Invalid water analysis data size: %zu (expected %zu)", 
                size, sizeof(water_pattern));
         ret = -EINVAL;
+    } else {
+        legacy_key_present = true;
     }
     
     return ret;
-}
\ No newline at end of file
+}
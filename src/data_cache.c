@@ -3,15 +3,608 @@
 #include <string.h>
 #include <errno.h>
 
+#if defined(CONFIG_GROW_SPOOL)
+#include <zephyr/fs/fs.h>
+#endif
+
 #include "data_cache.h"
 #include "storage.h"
+#include "reclog.h"
+#include "spool.h"
+#include "mem_monitor.h"
 
 LOG_MODULE_REGISTER(data_cache, CONFIG_LOG_DEFAULT_LEVEL);
 
+/*
+ * Compact cached reading
+ *
+ * The channel values keep the fixed point of struct grow_reading. The
+ * timestamp is a delta to the previous entry: seconds up to 0x7FFF, or
+ * minutes with the top bit set for longer gaps. Status strings are
+ * rebuilt from the health and mismatch bits at upload time.
+ */
+struct cached_reading {
+    uint16_t time_delta;
+    int16_t soil_moisture;
+    int16_t light_level;
+    int16_t temperature;
+    int16_t humidity;
+    uint16_t air_movement;
+    uint8_t status;         /* CACHED_HEALTH, CACHED_ANALYZED, CACHED_MISMATCH and CACHED_KEYFRAME */
+    uint8_t confidence;
+} __packed;
+
+BUILD_ASSERT(sizeof(struct cached_reading) == 14, "cached reading must stay 14 bytes");
+
+/* Time delta encoding */
+#define CACHED_DELTA_MINUTES BIT(15)
+#define CACHED_DELTA_MAX 0x7FFF
+
+/* Status byte layout */
+#define CACHED_HEALTH_MASK 0x03     /* enum grow_health, 3 for unknown */
+#define CACHED_HEALTH_UNKNOWN 0x03
+#define CACHED_ANALYZED BIT(2)
+#define CACHED_MISMATCH_SHIFT 3
+#define CACHED_MISMATCH_MASK 0x0F
+#define CACHED_KEYFRAME BIT(7)      /* Logged as a full reading, ring entries only */
+
+/*
+ * Upload acknowledgement in the record log
+ *
+ * Records up to seq were uploaded or spooled. The log is only trimmed up
+ * to the keyframe the remaining records are decoded from, the ack marks
+ * the rest of the way.
+ */
+struct cache_ack {
+    uint32_t seq;
+} __packed;
+
+/* A full reading is logged every this many records to anchor the deltas */
+#define CACHE_KEYFRAME_INTERVAL 64
+
 /* Cache storage */
-static struct cached_sensor_reading cache[MAX_CACHED_ENTRIES];
+static struct cached_reading cache[MAX_CACHED_ENTRIES];
+static uint32_t cache_seq[MAX_CACHED_ENTRIES]; /* Record log sequence of each entry */
 static int cache_head = 0; /* Index for next write */
 static int cache_count = 0; /* Number of valid entries */
+static uint32_t front_id;   /* Id of the oldest entry, ids count up from it */
+static int64_t base_timestamp;   /* Timestamp of the oldest entry */
+static int64_t newest_timestamp; /* Decoded timestamp of the newest entry */
+static uint32_t last_seq;   /* Record log sequence of the newest entry */
+
+/* Last decoded position, makes in-order reads constant time */
+static int cursor_index = -1;
+static int64_t cursor_timestamp;
+
+/* Delta chain of the record log */
+static int64_t log_timestamp;   /* Decoded timestamp of the last logged record */
+static int log_since_keyframe;  /* Records logged since the last keyframe */
+
+/* Acknowledged position in the record log */
+static uint32_t retired_seq;    /* Newest record released from the ring */
+static uint32_t acked_seq;      /* Newest record acknowledged in the log */
+static uint32_t anchor_seq;     /* Newest keyframe released from the ring */
+static bool loading;            /* Acknowledgements wait until the log was replayed */
+
+/* Rollup tier, a ring of aggregates oldest first */
+struct rollup_tier {
+    struct grow_rollup *buckets;
+    uint16_t size;
+    uint16_t period;        /* Seconds per aggregate */
+    uint16_t head;          /* Index for next write */
+    uint16_t count;
+    bool open;              /* The newest aggregate accepts more readings */
+};
+
+static struct grow_rollup rollup_10min[CONFIG_GROW_CACHE_ROLLUP_10MIN];
+static struct grow_rollup rollup_hourly[CONFIG_GROW_CACHE_ROLLUP_HOURLY];
+
+/* Evicted readings that were not spooled, finest tier first */
+enum { ROLLUP_10MIN, ROLLUP_HOURLY };
+
+static struct rollup_tier rollup_tiers[] = {
+    [ROLLUP_10MIN] = { rollup_10min, ARRAY_SIZE(rollup_10min), 10 * 60 },
+    [ROLLUP_HOURLY] = { rollup_hourly, ARRAY_SIZE(rollup_hourly), 60 * 60 },
+};
+
+static uint32_t rolled_up;      /* Readings merged into the finest tier */
+static uint32_t rollup_dropped; /* Readings dropped with the oldest hourly aggregate */
+
+/* Asks a thread to call data_cache_sync() */
+static data_cache_save_cb_t save_cb;
+
+#if defined(CONFIG_GROW_SPOOL)
+/*
+ * Rollup file on the spool partition
+ *
+ * The header is followed by the aggregates of each tier, oldest first.
+ * The save is requested ROLLUP_SAVE_DELAY after the first change, so
+ * bursts of evictions or uploads rewrite the file once. It is written
+ * to a temporary file, copying a few aggregates at a time with the
+ * cache locked, and renamed over the rollup file once complete.
+ */
+#define ROLLUP_PATH CONFIG_GROW_SPOOL_MOUNT_POINT "/rollups"
+#define ROLLUP_TMP_PATH ROLLUP_PATH ".tmp"
+#define ROLLUP_MAGIC 0x50554C52 /* "RLUP" */
+#define ROLLUP_SAVE_DELAY K_SECONDS(10)
+#define ROLLUP_SAVE_CHUNK 4     /* Aggregates copied per lock */
+#define ROLLUP_SAVE_TRIES 3     /* Passes before giving up on a changing tier */
+
+struct rollup_file_header {
+    uint32_t magic;
+    uint16_t count[2];      /* Aggregates of each tier */
+} __packed;
+
+static uint32_t rollup_generation;  /* Counts rollup changes */
+static uint32_t rollup_saved;       /* Generation in the rollup file */
+
+static void rollup_timer_expiry(struct k_timer *timer);
+
+static K_TIMER_DEFINE(rollup_timer, rollup_timer_expiry, NULL);
+
+/* Serialises savers, the tiers are only locked while they are copied */
+static K_MUTEX_DEFINE(rollup_save_lock);
+#endif
+
+/* Delta chains of the spool, every segment starts with a keyframe */
+static int64_t spool_write_timestamp;
+static int64_t spool_read_timestamp;
+static int64_t spool_release_timestamp;
+static int64_t spool_drop_timestamp;
+
+/* Serialises access from the analysis and uplink threads */
+K_MUTEX_DEFINE(cache_lock);
+
+/**
+ * @brief Decode a time delta to seconds
+ */
+static int64_t decode_delta(uint16_t delta)
+{
+    if (delta & CACHED_DELTA_MINUTES) {
+        return (int64_t)(delta & CACHED_DELTA_MAX) * 60;
+    }
+    
+    return delta;
+}
+
+/**
+ * @brief Encode the time since the previous entry
+ *
+ * Gaps beyond 0x7FFF seconds are rounded to minutes and saturate after
+ * about 22 days. Clock steps backwards are stored as no gap.
+ *
+ * @param prev Decoded timestamp of the previous entry
+ * @param timestamp Timestamp to encode
+ * @param decoded Pointer to store the timestamp the delta decodes to
+ * @return Encoded delta
+ */
+static uint16_t encode_delta(int64_t prev, int64_t timestamp, int64_t *decoded)
+{
+    int64_t delta = timestamp - prev;
+    uint16_t encoded;
+    
+    if (delta <= 0) {
+        encoded = 0;
+    } else if (delta <= CACHED_DELTA_MAX) {
+        encoded = (uint16_t)delta;
+    } else {
+        encoded = CACHED_DELTA_MINUTES | (uint16_t)MIN((delta + 30) / 60, CACHED_DELTA_MAX);
+    }
+    
+    *decoded = prev + decode_delta(encoded);
+    return encoded;
+}
+
+/**
+ * @brief Pack a reading, encoding its timestamp against the previous one
+ */
+static void cache_encode(const struct grow_reading *reading, int64_t *prev,
+                         struct cached_reading *out)
+{
+    uint8_t health = reading->health <= GROW_HEALTH_CRITICAL ?
+                     reading->health : CACHED_HEALTH_UNKNOWN;
+    
+    out->time_delta = encode_delta(*prev, reading->timestamp, prev);
+    out->soil_moisture = reading->soil_moisture;
+    out->light_level = reading->light_level;
+    out->temperature = reading->temperature;
+    out->humidity = reading->humidity;
+    out->air_movement = reading->air_movement;
+    out->status = health |
+                  ((reading->flags & GROW_READING_ANALYZED) ? CACHED_ANALYZED : 0) |
+                  ((reading->mismatch & CACHED_MISMATCH_MASK) << CACHED_MISMATCH_SHIFT);
+    out->confidence = reading->confidence;
+}
+
+/**
+ * @brief Unpack a reading
+ *
+ * Cached readings bypassed the publish filter, so none were suppressed.
+ */
+static void cache_decode(const struct cached_reading *entry, int64_t timestamp,
+                         struct grow_reading *out)
+{
+    uint8_t health = entry->status & CACHED_HEALTH_MASK;
+    
+    out->timestamp = timestamp;
+    out->soil_moisture = entry->soil_moisture;
+    out->light_level = entry->light_level;
+    out->temperature = entry->temperature;
+    out->humidity = entry->humidity;
+    out->air_movement = entry->air_movement;
+    out->suppressed = 0;
+    out->health = health == CACHED_HEALTH_UNKNOWN ? GROW_HEALTH_UNKNOWN : health;
+    out->mismatch = (entry->status >> CACHED_MISMATCH_SHIFT) & CACHED_MISMATCH_MASK;
+    out->confidence = entry->confidence;
+    out->flags = (entry->status & CACHED_ANALYZED) ? GROW_READING_ANALYZED : 0;
+}
+
+/**
+ * @brief Reset the in-memory ring
+ */
+static void cache_reset(void)
+{
+    memset(cache, 0, sizeof(cache));
+    memset(cache_seq, 0, sizeof(cache_seq));
+    cache_head = 0;
+    cache_count = 0;
+    base_timestamp = 0;
+    newest_timestamp = 0;
+    cursor_index = -1;
+}
+
+/**
+ * @brief Get the ring index of the oldest entry
+ */
+static int cache_tail(void)
+{
+    return (cache_head + MAX_CACHED_ENTRIES - cache_count) % MAX_CACHED_ENTRIES;
+}
+
+/**
+ * @brief Reset the rollup tiers
+ */
+static void rollup_reset(void)
+{
+    for (int i = 0; i < (int)ARRAY_SIZE(rollup_tiers); i++) {
+        rollup_tiers[i].head = 0;
+        rollup_tiers[i].count = 0;
+        rollup_tiers[i].open = false;
+    }
+}
+
+/**
+ * @brief Get the oldest aggregate of a tier
+ */
+static struct grow_rollup *rollup_oldest(struct rollup_tier *tier)
+{
+    return &tier->buckets[(tier->head + tier->size - tier->count) % tier->size];
+}
+
+/**
+ * @brief Get the newest aggregate of a tier
+ */
+static struct grow_rollup *rollup_newest(struct rollup_tier *tier)
+{
+    return &tier->buckets[(tier->head + tier->size - 1) % tier->size];
+}
+
+/**
+ * @brief Merge an aggregate into another one
+ */
+static void rollup_merge(struct grow_rollup *dst, const struct grow_rollup *src)
+{
+    dst->start = MIN(dst->start, src->start);
+    dst->count += src->count;
+    dst->mismatch |= src->mismatch;
+    
+    /* Unknown health only wins when nothing was analyzed */
+    if (dst->health == GROW_HEALTH_UNKNOWN ||
+        (src->health != GROW_HEALTH_UNKNOWN && src->health > dst->health)) {
+        dst->health = src->health;
+    }
+    
+    for (int i = 0; i < GROW_CHANNEL_COUNT; i++) {
+        dst->min[i] = MIN(dst->min[i], src->min[i]);
+        dst->max[i] = MAX(dst->max[i], src->max[i]);
+        dst->sum[i] += src->sum[i];
+    }
+}
+
+/**
+ * @brief Add an aggregate to a rollup tier
+ *
+ * The aggregate is merged into the newest one of the tier if it falls
+ * into the same period. When the tier is full its oldest aggregate moves
+ * to the next coarser tier, or is dropped from the coarsest one.
+ *
+ * @param index Tier index
+ * @param rollup Aggregate to add
+ */
+static void rollup_add(int index, const struct grow_rollup *rollup)
+{
+    struct rollup_tier *tier = &rollup_tiers[index];
+    int64_t period_start = rollup->start - rollup->start % tier->period;
+    
+    if (tier->count > 0 && tier->open) {
+        struct grow_rollup *newest = rollup_newest(tier);
+        int64_t newest_start = newest->start - newest->start % tier->period;
+        
+        /* Readings from before a clock step join the newest period */
+        if (newest_start >= period_start &&
+            newest->count + rollup->count <= UINT16_MAX) {
+            rollup_merge(newest, rollup);
+            return;
+        }
+    }
+    
+    if (tier->count == tier->size) {
+        struct grow_rollup *oldest = rollup_oldest(tier);
+        
+        if (index + 1 < (int)ARRAY_SIZE(rollup_tiers)) {
+            rollup_add(index + 1, oldest);
+        } else {
+            rollup_dropped += oldest->count;
+        }
+        tier->count--;
+    }
+    
+    tier->buckets[tier->head] = *rollup;
+    tier->buckets[tier->head].period = tier->period;
+    tier->head = (tier->head + 1) % tier->size;
+    tier->count++;
+    tier->open = true;
+}
+
+/**
+ * @brief Merge a reading into the finest rollup tier
+ */
+static void rollup_reading(const struct grow_reading *reading)
+{
+    struct grow_rollup rollup = {
+        .start = reading->timestamp,
+        .count = 1,
+        .health = (reading->flags & GROW_READING_ANALYZED) ?
+                  reading->health : GROW_HEALTH_UNKNOWN,
+        .mismatch = reading->mismatch,
+    };
+    
+    for (int i = 0; i < GROW_CHANNEL_COUNT; i++) {
+        int32_t value = grow_reading_channel(reading, i);
+        
+        rollup.min[i] = value;
+        rollup.max[i] = value;
+        rollup.sum[i] = value;
+    }
+    
+    rollup_add(ROLLUP_10MIN, &rollup);
+    rolled_up++;
+}
+
+#if defined(CONFIG_GROW_SPOOL)
+
+/**
+ * @brief Write all of a buffer to the rollup file
+ */
+static int rollup_write(struct fs_file_t *file, const void *data, size_t len)
+{
+    ssize_t n = fs_write(file, data, len);
+    
+    if (n < 0) {
+        return n;
+    }
+    
+    return n == (ssize_t)len ? 0 : -ENOSPC;
+}
+
+/**
+ * @brief Write the rollup tiers to the rollup file
+ *
+ * Runs without the cache lock held. The tiers are copied a chunk at a
+ * time, and the pass is abandoned if they change in between.
+ *
+ * @return 0 on success, -EAGAIN if the tiers changed, negative errno on
+ *         failure
+ */
+static int rollup_save(void)
+{
+    struct grow_rollup chunk[ROLLUP_SAVE_CHUNK];
+    struct rollup_file_header hdr = { .magic = ROLLUP_MAGIC };
+    int first[ARRAY_SIZE(rollup_tiers)];
+    struct fs_file_t file;
+    uint32_t generation;
+    int ret;
+    
+    k_mutex_lock(&cache_lock, K_FOREVER);
+    generation = rollup_generation;
+    for (int i = 0; i < (int)ARRAY_SIZE(rollup_tiers); i++) {
+        struct rollup_tier *tier = &rollup_tiers[i];
+        
+        hdr.count[i] = tier->count;
+        first[i] = (tier->head + tier->size - tier->count) % tier->size;
+    }
+    k_mutex_unlock(&cache_lock);
+    
+    if (generation == rollup_saved) {
+        return 0;
+    }
+    
+    /* Nothing to restore */
+    if (hdr.count[ROLLUP_10MIN] == 0 && hdr.count[ROLLUP_HOURLY] == 0) {
+        ret = fs_unlink(ROLLUP_PATH);
+        if (ret == 0 || ret == -ENOENT) {
+            rollup_saved = generation;
+            ret = 0;
+        }
+        return ret;
+    }
+    
+    fs_file_t_init(&file);
+    ret = fs_open(&file, ROLLUP_TMP_PATH, FS_O_CREATE | FS_O_WRITE);
+    if (ret < 0) {
+        return ret;
+    }
+    
+    /* Left over from an abandoned pass */
+    ret = fs_truncate(&file, 0);
+    if (ret == 0) {
+        ret = rollup_write(&file, &hdr, sizeof(hdr));
+    }
+    
+    for (int i = 0; i < (int)ARRAY_SIZE(rollup_tiers) && ret == 0; i++) {
+        struct rollup_tier *tier = &rollup_tiers[i];
+        
+        for (int done = 0; done < hdr.count[i] && ret == 0; ) {
+            int n = MIN(hdr.count[i] - done, ROLLUP_SAVE_CHUNK);
+            
+            k_mutex_lock(&cache_lock, K_FOREVER);
+            bool changed = rollup_generation != generation;
+            for (int j = 0; j < n && !changed; j++) {
+                chunk[j] = tier->buckets[(first[i] + done + j) % tier->size];
+            }
+            k_mutex_unlock(&cache_lock);
+            
+            ret = changed ? -EAGAIN : rollup_write(&file, chunk, n * sizeof(chunk[0]));
+            done += n;
+        }
+    }
+    
+    int close_ret = fs_close(&file);
+    if (ret == 0) {
+        ret = close_ret;
+    }
+    
+    /* LittleFS replaces the rollup file atomically */
+    if (ret == 0) {
+        ret = fs_rename(ROLLUP_TMP_PATH, ROLLUP_PATH);
+    }
+    
+    if (ret < 0) {
+        fs_unlink(ROLLUP_TMP_PATH);
+        return ret;
+    }
+    
+    rollup_saved = generation;
+    return 0;
+}
+
+/**
+ * @brief Restore the rollup tiers from the rollup file
+ *
+ * A tier that shrank since the file was written keeps its newest
+ * aggregates. Restored aggregates are closed, readings after a reboot
+ * start new ones.
+ */
+static void rollup_load(void)
+{
+    struct rollup_file_header hdr;
+    struct fs_file_t file;
+    int restored = 0;
+    
+    fs_file_t_init(&file);
+    if (fs_open(&file, ROLLUP_PATH, FS_O_READ) < 0) {
+        return;
+    }
+    
+    if (fs_read(&file, &hdr, sizeof(hdr)) != sizeof(hdr) || hdr.magic != ROLLUP_MAGIC) {
+        LOG_WRN("Discarding unreadable rollup file");
+        fs_close(&file);
+        return;
+    }
+    
+    for (int i = 0; i < (int)ARRAY_SIZE(rollup_tiers); i++) {
+        struct rollup_tier *tier = &rollup_tiers[i];
+        
+        for (int j = 0; j < hdr.count[i]; j++) {
+            struct grow_rollup *bucket = &tier->buckets[tier->head];
+            
+            /* A truncated file keeps what was read */
+            if (fs_read(&file, bucket, sizeof(*bucket)) != sizeof(*bucket)) {
+                i = ARRAY_SIZE(rollup_tiers);
+                break;
+            }
+            
+            tier->head = (tier->head + 1) % tier->size;
+            tier->count = MIN(tier->count + 1, tier->size);
+            restored++;
+        }
+    }
+    
+    fs_close(&file);
+    
+    /* The file holds what was restored */
+    rollup_saved = rollup_generation;
+    
+    LOG_INF("Restored %d rollups", restored);
+}
+
+/**
+ * @brief Ask for the changed rollup tiers to be saved
+ */
+static void rollup_timer_expiry(struct k_timer *timer)
+{
+    ARG_UNUSED(timer);
+    
+    if (save_cb) {
+        save_cb();
+    }
+}
+
+/**
+ * @brief Schedule saving the changed rollup tiers
+ *
+ * Called with the cache locked.
+ */
+static void rollup_changed(void)
+{
+    rollup_generation++;
+    
+    if (k_timer_remaining_get(&rollup_timer) == 0) {
+        k_timer_start(&rollup_timer, ROLLUP_SAVE_DELAY, K_NO_WAIT);
+    }
+}
+
+#else
+
+static void rollup_load(void)
+{
+}
+
+static void rollup_changed(void)
+{
+}
+
+#endif /* CONFIG_GROW_SPOOL */
+
+/**
+ * @brief Roll up the readings of a spool segment deleted before it was uploaded
+ *
+ * Called by the spool from cache_evict(), with the cache locked. The
+ * segment starts with a keyframe, records released already are decoded
+ * to follow the delta chain only.
+ */
+static void spool_drop(const void *data, size_t len, bool released)
+{
+    struct grow_reading reading;
+    
+    if (len == sizeof(reading)) {
+        memcpy(&reading, data, sizeof(reading));
+        spool_drop_timestamp = reading.timestamp;
+    } else if (len == sizeof(struct cached_reading)) {
+        struct cached_reading entry;
+        
+        memcpy(&entry, data, sizeof(entry));
+        spool_drop_timestamp += decode_delta(entry.time_delta);
+        cache_decode(&entry, spool_drop_timestamp, &reading);
+    } else {
+        return;
+    }
+    
+    if (!released) {
+        rollup_reading(&reading);
+        rollup_changed();
+    }
+}
 
 /**
  * @brief Initialize data cache
@@ -21,63 +614,244 @@ static int cache_count = 0; /* Number of valid entries */
 int data_cache_init(void)
 {
     /* Clear cache */
-    memset(cache, 0, sizeof(cache));
-    cache_head = 0;
-    cache_count = 0;
+    k_mutex_lock(&cache_lock, K_FOREVER);
+    cache_reset();
+    rollup_reset();
+    log_since_keyframe = 0;
+    k_mutex_unlock(&cache_lock);
+    
+    mem_monitor_register("data_cache", "cache", sizeof(cache));
+    mem_monitor_register("data_cache", "cache_seq", sizeof(cache_seq));
+    mem_monitor_register("data_cache", "rollup_10min", sizeof(rollup_10min));
+    mem_monitor_register("data_cache", "rollup_hourly", sizeof(rollup_hourly));
+    
+    /* Mount the record log that persists the cache */
+    int ret = reclog_init();
+    if (ret < 0) {
+        LOG_ERR("Failed to mount record log: %d", ret);
+        return ret;
+    }
+    
+    /* Readings evicted from the full cache overflow to the spool */
+    ret = spool_init();
+    if (ret < 0) {
+        LOG_WRN("Spool unavailable, readings beyond the cache will be lost: %d", ret);
+    }
+    
+    /* Segments the spool deletes before they were uploaded are rolled up */
+    spool_set_drop_cb(spool_drop);
     
     LOG_INF("Data cache initialized");
     return 0;
 }
 
 /**
- * @brief Add sensor reading to cache
- * 
- * @param soil_moisture Soil moisture value
- * @param light_level Light level value
- * @param temperature Temperature value
- * @param humidity Humidity value
- * @param air_movement Air movement value
- * @param timestamp Timestamp of reading
- * @param health_status Health status value
- * @param env_mismatch Environmental mismatch flags
- * @param plant_status Plant status string
+ * @brief Remove the oldest entries from the ring
+ *
+ * The log position of the removed entries is persisted separately by
+ * cache_ack().
+ *
+ * @param count Number of entries to remove
+ */
+static void cache_retire(int count)
+{
+    while (count-- > 0 && cache_count > 0) {
+        int oldest = cache_tail();
+        
+        if (cache_seq[oldest] > retired_seq) {
+            retired_seq = cache_seq[oldest];
+        }
+        if ((cache[oldest].status & CACHED_KEYFRAME) && cache_seq[oldest] > 0) {
+            anchor_seq = cache_seq[oldest];
+        }
+        
+        /* The next entry becomes the base */
+        if (cache_count > 1) {
+            base_timestamp += decode_delta(cache[(oldest + 1) % MAX_CACHED_ENTRIES].time_delta);
+        }
+        
+        cache_count--;
+        front_id++;
+    }
+    
+    /* Indices shift with the oldest entry */
+    cursor_index = -1;
+}
+
+/**
+ * @brief Persist the position of the retired entries in the record log
+ *
+ * The log is trimmed up to the keyframe the remaining records are
+ * decoded from, and an ack record marks the retired ones after it so
+ * they are not restored after a reboot.
+ *
  * @return 0 on success, negative errno on failure
  */
-int data_cache_add_reading(float soil_moisture,
-                         float light_level,
-                         float temperature,
-                         float humidity,
-                         float air_movement,
-                         int64_t timestamp,
-                         int health_status,
-                         const char *env_mismatch,
-                         const char *plant_status)
+static int cache_ack(void)
 {
-    /* Add to circular buffer */
-    cache[cache_head].soil_moisture = soil_moisture;
-    cache[cache_head].light_level = light_level;
-    cache[cache_head].temperature = temperature;
-    cache[cache_head].humidity = humidity;
-    cache[cache_head].air_movement = air_movement;
-    cache[cache_head].timestamp = timestamp;
-    cache[cache_head].health_status = health_status;
+    struct cache_ack ack = { .seq = retired_seq };
+    int ret;
+    
+    if (retired_seq <= acked_seq) {
+        return 0;
+    }
+    
+    if (anchor_seq > 1) {
+        ret = reclog_trim(anchor_seq - 1);
+        if (ret < 0) {
+            return ret;
+        }
+    }
     
-    strncpy(cache[cache_head].env_mismatch, env_mismatch, sizeof(cache[cache_head].env_mismatch) - 1);
-    cache[cache_head].env_mismatch[sizeof(cache[cache_head].env_mismatch) - 1] = '\0';
+    ret = reclog_append(&ack, sizeof(ack), NULL);
+    if (ret < 0) {
+        return ret;
+    }
     
-    strncpy(cache[cache_head].plant_status, plant_status, sizeof(cache[cache_head].plant_status) - 1);
-    cache[cache_head].plant_status[sizeof(cache[cache_head].plant_status) - 1] = '\0';
+    acked_seq = retired_seq;
+    return 0;
+}
+
+/**
+ * @brief Move the oldest entry of the full ring to the spool
+ *
+ * Entries the spool does not take are merged into the rollup tiers.
+ * The entry is released from the record log either way, so it is not
+ * restored into the ring and spooled again after a reboot.
+ */
+static void cache_evict(void)
+{
+    struct grow_reading reading;
+    int ret;
     
-    cache[cache_head].valid = true;
+    cache_decode(&cache[cache_tail()], base_timestamp, &reading);
+    
+    if (spool_segment_empty()) {
+        ret = spool_append(&reading, sizeof(reading), reading.timestamp);
+        spool_write_timestamp = reading.timestamp;
+    } else {
+        struct cached_reading entry;
+        
+        cache_encode(&reading, &spool_write_timestamp, &entry);
+        ret = spool_append(&entry, sizeof(entry), reading.timestamp);
+    }
+    
+    if (ret < 0) {
+        if (ret != -ENOTSUP) {
+            LOG_WRN("Evicted reading not spooled, rolling it up: %d", ret);
+        }
+        rollup_reading(&reading);
+        rollup_changed();
+    }
+    
+    cache_retire(1);
+    
+    if (!loading) {
+        ret = cache_ack();
+        if (ret < 0) {
+            LOG_WRN("Evicted reading not released: %d", ret);
+        }
+    }
+}
+
+/**
+ * @brief Add a reading to the in-memory ring
+ *
+ * @param reading Reading to add
+ * @param seq Record log sequence, 0 if it was not logged
+ * @param keyframe The reading was logged as a full reading
+ */
+static void cache_push(const struct grow_reading *reading, uint32_t seq, bool keyframe)
+{
+    if (cache_count == 0) {
+        base_timestamp = reading->timestamp;
+        newest_timestamp = reading->timestamp;
+    } else if (cache_count == MAX_CACHED_ENTRIES) {
+        cache_evict();
+    }
+    
+    /* Add to circular buffer */
+    cache_encode(reading, &newest_timestamp, &cache[cache_head]);
+    if (keyframe) {
+        cache[cache_head].status |= CACHED_KEYFRAME;
+    }
+    cache_seq[cache_head] = seq;
     
-    /* Update head index */
+    /* Update head index and count */
     cache_head = (cache_head + 1) % MAX_CACHED_ENTRIES;
+    cache_count++;
+    
+    if (seq > last_seq) {
+        last_seq = seq;
+    }
+}
+
+/**
+ * @brief Append a reading to the record log
+ *
+ * Most readings are logged in compact form. A full reading is logged
+ * periodically and after every clear so the log can be decoded from any
+ * keyframe after the oldest sector is dropped.
+ *
+ * @param reading Reading to log
+ * @param seq Pointer to store the record sequence
+ * @param keyframe Pointer to store whether the full reading was logged
+ * @return 0 on success, negative errno on failure
+ */
+static int cache_log(const struct grow_reading *reading, uint32_t *seq, bool *keyframe)
+{
+    int ret;
+    
+    *keyframe = log_since_keyframe == 0;
+    
+    if (*keyframe) {
+        ret = reclog_append(reading, sizeof(*reading), seq);
+        log_timestamp = reading->timestamp;
+    } else {
+        struct cached_reading entry;
+        
+        cache_encode(reading, &log_timestamp, &entry);
+        ret = reclog_append(&entry, sizeof(entry), seq);
+    }
+    
+    if (ret < 0) {
+        /* The delta chain is broken, start a new one */
+        log_since_keyframe = 0;
+        *keyframe = false;
+        return ret;
+    }
+    
+    log_since_keyframe = (log_since_keyframe + 1) % CACHE_KEYFRAME_INTERVAL;
+    return 0;
+}
+
+/**
+ * @brief Add sensor reading to cache
+ * 
+ * @param reading Reading to store
+ * @return 0 on success, negative errno on failure
+ */
+int data_cache_add_reading(const struct grow_reading *reading)
+{
+    if (!reading) {
+        return -EINVAL;
+    }
     
-    /* Update count */
-    if (cache_count < MAX_CACHED_ENTRIES) {
-        cache_count++;
+    uint32_t seq = 0;
+    bool keyframe;
+    
+    k_mutex_lock(&cache_lock, K_FOREVER);
+    
+    /* One small append persists the reading */
+    int ret = cache_log(reading, &seq, &keyframe);
+    if (ret < 0) {
+        LOG_WRN("Cached reading not persisted: %d", ret);
     }
     
+    cache_push(reading, seq, keyframe);
+    
+    k_mutex_unlock(&cache_lock);
+    
     LOG_DBG("Added reading to cache (total: %d)", cache_count);
     return 0;
 }
@@ -99,140 +873,466 @@ int data_cache_count(void)
  * @param reading_out Pointer to store the reading
  * @return 0 on success, negative errno on failure
  */
-int data_cache_get_reading(int index, struct cached_sensor_reading *reading_out)
+int data_cache_get_reading(int index, struct grow_reading *reading_out)
 {
+    k_mutex_lock(&cache_lock, K_FOREVER);
+    
     if (!reading_out || index < 0 || index >= cache_count) {
+        k_mutex_unlock(&cache_lock);
         return -EINVAL;
     }
     
-    /* Calculate actual index in circular buffer */
-    int actual_index = 0;
-    if (cache_count < MAX_CACHED_ENTRIES) {
-        /* Buffer not full yet */
-        actual_index = index;
-    } else {
-        /* Buffer full, calculate based on head position */
-        actual_index = (cache_head + index) % MAX_CACHED_ENTRIES;
+    /* Index of the oldest entry in the circular buffer */
+    int oldest = cache_tail();
+    
+    /* Sum the deltas from the oldest entry, or from the last read one */
+    int pos = 0;
+    int64_t timestamp = base_timestamp;
+    if (cursor_index >= 0 && cursor_index <= index) {
+        pos = cursor_index;
+        timestamp = cursor_timestamp;
     }
     
-    if (!cache[actual_index].valid) {
-        return -ENOENT;
+    while (pos < index) {
+        pos++;
+        timestamp += decode_delta(cache[(oldest + pos) % MAX_CACHED_ENTRIES].time_delta);
     }
     
-    /* Copy data */
-    memcpy(reading_out, &cache[actual_index], sizeof(struct cached_sensor_reading));
+    cursor_index = index;
+    cursor_timestamp = timestamp;
+    
+    cache_decode(&cache[(oldest + index) % MAX_CACHED_ENTRIES], timestamp, reading_out);
+    
+    k_mutex_unlock(&cache_lock);
     
     return 0;
 }
 
 /**
- * @brief Clear cache after successful upload
+ * @brief Get the oldest cached reading
  * 
- * @return 0 on success, negative errno on failure
+ * @param reading_out Pointer to store the reading
+ * @param id_out Pointer to store the id to release the reading with
+ * @return 0 on success, -ENODATA if the cache is empty
  */
-int data_cache_clear(void)
+int data_cache_peek(struct grow_reading *reading_out, uint32_t *id_out)
 {
-    memset(cache, 0, sizeof(cache));
-    cache_head = 0;
-    cache_count = 0;
+    if (!reading_out || !id_out) {
+        return -EINVAL;
+    }
+    
+    k_mutex_lock(&cache_lock, K_FOREVER);
+    
+    if (cache_count == 0) {
+        k_mutex_unlock(&cache_lock);
+        return -ENODATA;
+    }
+    
+    cache_decode(&cache[cache_tail()], base_timestamp, reading_out);
+    *id_out = front_id;
+    
+    k_mutex_unlock(&cache_lock);
     
-    LOG_INF("Data cache cleared");
     return 0;
 }
 
 /**
- * @brief Save cache to storage
+ * @brief Release cached readings after they were uploaded
  * 
- * @param serial_number Device serial number
+ * @param id Id of the newest uploaded reading
  * @return 0 on success, negative errno on failure
  */
-int data_cache_save(const char *serial_number)
+int data_cache_release(uint32_t id)
 {
-    char key[64];
+    k_mutex_lock(&cache_lock, K_FOREVER);
     
-    /* Save cache metadata */
-    snprintf(key, sizeof(key), "cache/meta/%s", serial_number);
-    struct {
-        int head;
-        int count;
-    } meta = {
-        .head = cache_head,
-        .count = cache_count
-    };
+    /* Readings evicted in the meantime were released already */
+    int32_t count = (int32_t)(id - front_id) + 1;
+    if (count <= 0) {
+        k_mutex_unlock(&cache_lock);
+        return 0;
+    }
+    
+    cache_retire(MIN(count, cache_count));
+    int ret = cache_ack();
+    
+    k_mutex_unlock(&cache_lock);
     
-    int ret = storage_save_value(key, &meta, sizeof(meta));
     if (ret < 0) {
-        LOG_ERR("Failed to save cache metadata: %d", ret);
+        LOG_ERR("Failed to release cached records: %d", ret);
         return ret;
     }
     
-    /* Save cache data */
-    snprintf(key, sizeof(key), "cache/data/%s", serial_number);
-    ret = storage_save_value(key, cache, sizeof(cache));
+    return 0;
+}
+
+/**
+ * @brief Clear cache after successful upload
+ * 
+ * @return 0 on success, negative errno on failure
+ */
+int data_cache_clear(void)
+{
+    k_mutex_lock(&cache_lock, K_FOREVER);
+    
+    /* Release the uploaded records in the log */
+    int ret = reclog_trim(last_seq);
+    
+    front_id += cache_count;
+    cache_reset();
+    rollup_reset();
+    rollup_changed();
+    
+    /* The trim covers every record, no keyframe is left to keep */
+    retired_seq = last_seq;
+    acked_seq = last_seq;
+    anchor_seq = 0;
+    
+    /* The next record must not refer to a released one */
+    log_since_keyframe = 0;
+    k_mutex_unlock(&cache_lock);
+    
     if (ret < 0) {
-        LOG_ERR("Failed to save cache data: %d", ret);
+        LOG_ERR("Failed to release cached records: %d", ret);
         return ret;
     }
     
-    LOG_INF("Data cache saved (%d entries)", cache_count);
+    LOG_INF("Data cache cleared");
+    return 0;
+}
+
+/**
+ * @brief Get the oldest rollup
+ * 
+ * @param rollup_out Pointer to store the rollup
+ * @return 0 on success, -ENODATA if there are no rollups
+ */
+int data_cache_peek_rollup(struct grow_rollup *rollup_out)
+{
+    int ret = -ENODATA;
+    
+    if (!rollup_out) {
+        return -EINVAL;
+    }
+    
+    k_mutex_lock(&cache_lock, K_FOREVER);
+    
+    /* Coarser tiers hold older readings */
+    for (int i = (int)ARRAY_SIZE(rollup_tiers) - 1; i >= 0; i--) {
+        struct rollup_tier *tier = &rollup_tiers[i];
+        
+        if (tier->count == 0) {
+            continue;
+        }
+        
+        *rollup_out = *rollup_oldest(tier);
+        
+        /* Keep it unchanged until it is released */
+        if (tier->count == 1) {
+            tier->open = false;
+        }
+        
+        ret = 0;
+        break;
+    }
+    
+    k_mutex_unlock(&cache_lock);
+    
+    return ret;
+}
+
+/**
+ * @brief Release a rollup after it was uploaded
+ * 
+ * @param rollup Rollup returned by data_cache_peek_rollup()
+ */
+void data_cache_release_rollup(const struct grow_rollup *rollup)
+{
+    k_mutex_lock(&cache_lock, K_FOREVER);
+    
+    for (int i = 0; i < (int)ARRAY_SIZE(rollup_tiers); i++) {
+        struct rollup_tier *tier = &rollup_tiers[i];
+        
+        if (tier->period != rollup->period || tier->count == 0) {
+            continue;
+        }
+        
+        /* A rollup merged into a coarser tier meanwhile is uploaded again from there */
+        struct grow_rollup *oldest = rollup_oldest(tier);
+        if (oldest->start == rollup->start && oldest->count == rollup->count) {
+            tier->count--;
+            rollup_changed();
+        }
+    }
+    
+    k_mutex_unlock(&cache_lock);
+}
+
+/**
+ * @brief Get the cache statistics
+ * 
+ * @param stats_out Pointer to store the statistics
+ */
+void data_cache_get_stats(struct data_cache_stats *stats_out)
+{
+    k_mutex_lock(&cache_lock, K_FOREVER);
+    
+    stats_out->cached = cache_count;
+    stats_out->rollups_10min = rollup_tiers[ROLLUP_10MIN].count;
+    stats_out->rollups_hourly = rollup_tiers[ROLLUP_HOURLY].count;
+    stats_out->rolled_up = rolled_up;
+    stats_out->rollup_dropped = rollup_dropped;
+    
+    k_mutex_unlock(&cache_lock);
+}
+
+/**
+ * @brief Set the handler asking for the rollups to be saved
+ * 
+ * @param cb Handler, NULL for none
+ */
+void data_cache_set_save_cb(data_cache_save_cb_t cb)
+{
+    save_cb = cb;
+}
+
+/**
+ * @brief Write the pending rollup changes
+ * 
+ * @return 0 on success, negative errno on failure
+ */
+int data_cache_sync(void)
+{
+#if defined(CONFIG_GROW_SPOOL)
+    int ret;
+    
+    /* A change during the save starts the timer again */
+    k_timer_stop(&rollup_timer);
+    
+    k_mutex_lock(&rollup_save_lock, K_FOREVER);
+    for (int i = 0; i < ROLLUP_SAVE_TRIES; i++) {
+        ret = rollup_save();
+        if (ret != -EAGAIN) {
+            break;
+        }
+    }
+    k_mutex_unlock(&rollup_save_lock);
+    
+    return ret;
+#else
+    return 0;
+#endif
+}
+
+/**
+ * @brief Read the next spooled reading, oldest first
+ * 
+ * Records released before a reboot are decoded to follow the delta
+ * chain, but not returned.
+ * 
+ * @param reading_out Pointer to store the reading
+ * @return 0 on success, -ENODATA when all spooled readings were read
+ */
+int data_cache_read_spooled(struct grow_reading *reading_out)
+{
+    union {
+        struct grow_reading full;
+        struct cached_reading compact;
+    } record;
+    size_t len;
+    bool released;
+    int ret;
+    
+    if (!reading_out) {
+        return -EINVAL;
+    }
+    
+    k_mutex_lock(&cache_lock, K_FOREVER);
+    
+    do {
+        ret = spool_read(&record, sizeof(record), &len, &released);
+        if (ret == -EMSGSIZE) {
+            continue;
+        }
+        if (ret < 0) {
+            break;
+        }
+        
+        if (len == sizeof(record.full)) {
+            *reading_out = record.full;
+            spool_read_timestamp = record.full.timestamp;
+            reading_out->suppressed = 0;
+        } else if (len == sizeof(record.compact)) {
+            spool_read_timestamp += decode_delta(record.compact.time_delta);
+            cache_decode(&record.compact, spool_read_timestamp, reading_out);
+        } else {
+            ret = -EMSGSIZE;
+        }
+        
+        if (ret == 0 && released) {
+            ret = -EAGAIN;
+        }
+    } while (ret == -EMSGSIZE || ret == -EAGAIN);
+    
+    k_mutex_unlock(&cache_lock);
+    
+    return ret;
+}
+
+/**
+ * @brief Release the spooled readings read so far
+ * 
+ * @return 0 on success, negative errno on failure
+ */
+int data_cache_release_spooled(void)
+{
+    k_mutex_lock(&cache_lock, K_FOREVER);
+    spool_release_timestamp = spool_read_timestamp;
+    int ret = spool_release();
+    k_mutex_unlock(&cache_lock);
+    
+    return ret;
+}
+
+/**
+ * @brief Read the spooled readings again from the last release
+ */
+void data_cache_rewind_spooled(void)
+{
+    k_mutex_lock(&cache_lock, K_FOREVER);
+    spool_read_timestamp = spool_release_timestamp;
+    spool_rewind();
+    k_mutex_unlock(&cache_lock);
+}
+
+/**
+ * @brief Find the newest acknowledgement in the log
+ */
+static int load_ack(uint32_t seq, const void *data, size_t len, void *user_data)
+{
+    uint32_t *ack_seq = user_data;
+    struct cache_ack ack;
+    
+    ARG_UNUSED(seq);
+    
+    if (len == sizeof(ack)) {
+        memcpy(&ack, data, sizeof(ack));
+        if (ack.seq > *ack_seq) {
+            *ack_seq = ack.seq;
+        }
+    }
+    
+    return 0;
+}
+
+/* Record log replay state */
+struct cache_replay {
+    uint32_t ack_seq;   /* Records up to this one were released */
+    int64_t timestamp;  /* Decoded timestamp of the last restored record */
+    bool anchored;      /* A keyframe was seen */
+    int skipped;
+};
+
+/**
+ * @brief Restore one record from the log
+ *
+ * Released records are decoded to follow the delta chain, but only the
+ * ones after the acknowledgement are restored.
+ */
+static int load_record(uint32_t seq, const void *data, size_t len, void *user_data)
+{
+    struct cache_replay *replay = user_data;
+    struct grow_reading reading;
+    bool keyframe = false;
+    
+    if (len == sizeof(struct cache_ack)) {
+        return 0;
+    }
+    
+    if (len == sizeof(struct grow_reading)) {
+        memcpy(&reading, data, sizeof(reading));
+        replay->timestamp = reading.timestamp;
+        replay->anchored = true;
+        keyframe = true;
+    } else if (len == sizeof(struct cached_reading) && replay->anchored) {
+        const struct cached_reading *entry = data;
+        
+        replay->timestamp += decode_delta(entry->time_delta);
+        cache_decode(entry, replay->timestamp, &reading);
+    } else if (seq > replay->ack_seq) {
+        /* Unknown layout, or its keyframe was dropped with an old sector */
+        replay->skipped++;
+        return 0;
+    } else {
+        return 0;
+    }
+    
+    if (seq <= replay->ack_seq) {
+        /* Trimming must keep the keyframe of the remaining records */
+        if (keyframe) {
+            anchor_seq = seq;
+        }
+        return 0;
+    }
+    
+    cache_push(&reading, seq, keyframe);
     return 0;
 }
 
 /**
  * @brief Load cache from storage
  * 
+ * Restores the rollups and the readings that were not uploaded yet from
+ * the record log, and removes the cache blobs older firmware kept in NVS.
+ * 
  * @param serial_number Device serial number
  * @return 0 on success, negative errno on failure
  */
 int data_cache_load(const char *serial_number)
 {
     char key[64];
+    struct cache_replay replay = { 0 };
     
-    /* Load cache metadata */
+    /* The cache used to be rewritten to NVS as a whole, drop those blobs */
     snprintf(key, sizeof(key), "cache/meta/%s", serial_number);
-    struct {
-        int head;
-        int count;
-    } meta;
+    storage_delete_value(key);
+    snprintf(key, sizeof(key), "cache/data/%s", serial_number);
+    storage_delete_value(key);
     
-    size_t meta_size = sizeof(meta);
-    int ret = storage_load_value(key, &meta, &meta_size);
+    k_mutex_lock(&cache_lock, K_FOREVER);
     
-    if (ret < 0) {
-        if (ret == -ENOENT) {
-            /* No cache data, initialize empty cache */
-            LOG_INF("No saved cache data found");
-            data_cache_init();
-            return 0;
-        }
-        LOG_ERR("Failed to load cache metadata: %d", ret);
-        return ret;
+    /* Before the replay, which may evict readings into the rollups */
+    rollup_load();
+    
+    int ret = reclog_foreach(load_ack, &replay.ack_seq);
+    if (ret == 0) {
+        retired_seq = replay.ack_seq;
+        acked_seq = replay.ack_seq;
+        
+        /* Readings evicted while replaying are acknowledged once at the end */
+        loading = true;
+        ret = reclog_foreach(load_record, &replay);
+        loading = false;
     }
     
-    if (meta_size != sizeof(meta)) {
-        LOG_ERR("Invalid cache metadata size");
-        return -EINVAL;
+    if (ret == 0) {
+        ret = cache_ack();
     }
     
-    /* Load cache data */
-    snprintf(key, sizeof(key), "cache/data/%s", serial_number);
-    size_t cache_size = sizeof(cache);
-    ret = storage_load_value(key, cache, &cache_size);
+    /* Start a new delta chain rather than continue the replayed one */
+    log_since_keyframe = 0;
+    k_mutex_unlock(&cache_lock);
     
     if (ret < 0) {
-        LOG_ERR("Failed to load cache data: %d", ret);
+        LOG_ERR("Failed to load cached readings: %d", ret);
         return ret;
     }
     
-    if (cache_size != sizeof(cache)) {
-        LOG_ERR("Invalid cache data size");
-        return -EINVAL;
+    if (replay.skipped > 0) {
+        LOG_WRN("Skipped %d cached records that could not be decoded", replay.skipped);
     }
     
-    /* Set cache state */
-    cache_head = meta.head;
-    cache_count = meta.count;
-    
-    LOG_INF("Data cache loaded (%d entries)", cache_count);
+    LOG_INF("Data cache loaded (%d entries, acknowledged to %u)", cache_count,
+            replay.ack_seq);
     return 0;
-}
\ No newline at end of file
+}
@@ -4,21 +4,27 @@
 #include <stdint.h>
 #include <stdbool.h>
 
-/* Maximum number of cached entries */
-#define MAX_CACHED_ENTRIES 48  // 48 hours of data
-
-/* Structure for a cached sensor reading */
-struct cached_sensor_reading {
-    float soil_moisture;
-    float light_level;
-    float temperature;
-    float humidity;
-    float air_movement;
-    int64_t timestamp;
-    int health_status;
-    char env_mismatch[32];
-    char plant_status[32];
-    bool valid;
+#include "grow_reading.h"
+
+/* Maximum number of cached entries, 8 hours at a 60 s sample interval.
+ * Entries are kept in a 14-byte compact form. */
+#define MAX_CACHED_ENTRIES 480
+
+/**
+ * @brief Ask for data_cache_sync() to be called
+ *
+ * Called from a timer some seconds after the rollups changed, so it must
+ * only signal a thread, which then saves them.
+ */
+typedef void (*data_cache_save_cb_t)(void);
+
+/* Data cache statistics */
+struct data_cache_stats {
+    uint32_t cached;            /* Readings in the cache */
+    uint32_t rollups_10min;     /* 10-minute rollups */
+    uint32_t rollups_hourly;    /* Hourly rollups */
+    uint32_t rolled_up;         /* Evicted readings merged into rollups since boot */
+    uint32_t rollup_dropped;    /* Readings dropped with the oldest hourly rollup */
 };
 
 /**
@@ -31,26 +37,10 @@ int data_cache_init(void);
 /**
  * @brief Add sensor reading to cache
  * 
- * @param soil_moisture Soil moisture value
- * @param light_level Light level value
- * @param temperature Temperature value
- * @param humidity Humidity value
- * @param air_movement Air movement value
- * @param timestamp Timestamp of reading
- * @param health_status Health status value
- * @param env_mismatch Environmental mismatch flags
- * @param plant_status Plant status string
+ * @param reading Reading to store
  * @return 0 on success, negative errno on failure
  */
-int data_cache_add_reading(float soil_moisture,
-                         float light_level,
-                         float temperature,
-                         float humidity,
-                         float air_movement,
-                         int64_t timestamp,
-                         int health_status,
-                         const char *env_mismatch,
-                         const char *plant_status);
+int data_cache_add_reading(const struct grow_reading *reading);
 
 /**
  * @brief Get number of cached readings
@@ -66,7 +56,31 @@ int data_cache_count(void);
  * @param reading_out Pointer to store the reading
  * @return 0 on success, negative errno on failure
  */
-int data_cache_get_reading(int index, struct cached_sensor_reading *reading_out);
+int data_cache_get_reading(int index, struct grow_reading *reading_out);
+
+/**
+ * @brief Get the oldest cached reading
+ * 
+ * Uploads drain the cache from the oldest reading, releasing each one
+ * once it was accepted so a failed upload resumes where it stopped.
+ * 
+ * @param reading_out Pointer to store the reading
+ * @param id_out Pointer to store the id to release the reading with
+ * @return 0 on success, -ENODATA if the cache is empty
+ */
+int data_cache_peek(struct grow_reading *reading_out, uint32_t *id_out);
+
+/**
+ * @brief Release cached readings after they were uploaded
+ * 
+ * Releases the reading with the given id and all older ones. The
+ * release is persisted, released readings are not restored after a
+ * reboot. Readings evicted to the spool in the meantime are skipped.
+ * 
+ * @param id Id of the newest uploaded reading
+ * @return 0 on success, negative errno on failure
+ */
+int data_cache_release(uint32_t id);
 
 /**
  * @brief Clear cache after successful upload
@@ -76,16 +90,82 @@ int data_cache_get_reading(int index, struct cached_sensor_reading *reading_out)
 int data_cache_clear(void);
 
 /**
- * @brief Save cache to storage
+ * @brief Get the oldest rollup
+ * 
+ * Readings evicted from the full cache that could not be spooled, and
+ * spooled readings whose segment was deleted before they were uploaded,
+ * are merged into 10-minute rollups, which are merged into hourly ones
+ * when their slots run out. Rollups are older than every cached
+ * reading. With the spool they are saved to its partition and restored
+ * by data_cache_load(), without it they are kept in RAM only.
+ * 
+ * @param rollup_out Pointer to store the rollup
+ * @return 0 on success, -ENODATA if there are no rollups
+ */
+int data_cache_peek_rollup(struct grow_rollup *rollup_out);
+
+/**
+ * @brief Release a rollup after it was uploaded
+ * 
+ * @param rollup Rollup returned by data_cache_peek_rollup()
+ */
+void data_cache_release_rollup(const struct grow_rollup *rollup);
+
+/**
+ * @brief Get the cache statistics
+ * 
+ * @param stats_out Pointer to store the statistics
+ */
+void data_cache_get_stats(struct data_cache_stats *stats_out);
+
+/**
+ * @brief Set the handler asking for the rollups to be saved
+ * 
+ * @param cb Handler, NULL for none
+ */
+void data_cache_set_save_cb(data_cache_save_cb_t cb);
+
+/**
+ * @brief Write the pending rollup changes
+ * 
+ * Writes the spool partition without holding the cache lock. Call it
+ * from a thread when the save handler asks, and before a reboot so no
+ * change is lost.
+ * 
+ * @return 0 on success, -EAGAIN if the rollups kept changing, negative
+ *         errno on failure
+ */
+int data_cache_sync(void);
+
+/**
+ * @brief Read the next spooled reading, oldest first
+ * 
+ * Readings evicted from the full cache are kept in the spool. They are
+ * older than every cached reading.
+ * 
+ * @param reading_out Pointer to store the reading
+ * @return 0 on success, -ENODATA when all spooled readings were read
+ */
+int data_cache_read_spooled(struct grow_reading *reading_out);
+
+/**
+ * @brief Release the spooled readings read so far
  * 
- * @param serial_number Device serial number
  * @return 0 on success, negative errno on failure
  */
-int data_cache_save(const char *serial_number);
+int data_cache_release_spooled(void);
+
+/**
+ * @brief Read the spooled readings again from the last release
+ */
+void data_cache_rewind_spooled(void);
 
 /**
  * @brief Load cache from storage
  * 
+ * Readings are persisted to the record log as they are added, this
+ * restores the ones not uploaded yet.
+ * 
  * @param serial_number Device serial number
  * @return 0 on success, negative errno on failure
  */
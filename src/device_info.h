@@ -0,0 +1,14 @@
+#ifndef DEVICE_INFO_H
+#define DEVICE_INFO_H
+
+#include <stdbool.h>
+
+/* Device information structure */
+struct device_info {
+    char serial_number[33];
+    char plant_name[64];
+    char plant_variety[64];
+    bool provisioned;
+};
+
+#endif /* DEVICE_INFO_H */
@@ -3,6 +3,8 @@
 
 #include <stdint.h>
 
+#include "grow_reading.h"
+
 /**
  * @brief Initialize Firebase connection
  *
@@ -13,34 +15,31 @@ int firebase_init(void);
 /**
  * @brief Send sensor data to Firebase
  *
+ * Status, mismatch and recommendation strings are derived from the
+ * reading while the payload is encoded.
+ *
  * @param serial_number Device serial number
- * @param soil_moisture Soil moisture value (0-100%)
- * @param light_level Light level value (0-100%)
- * @param temperature Temperature value (°C)
- * @param humidity Humidity value (0-100%)
- * @param air_movement Air movement value
- * @param timestamp Timestamp of reading
  * @param plant_name Plant name
  * @param plant_variety Plant variety
- * @param health_status Plant health status
- * @param env_mismatch Environmental mismatch flags
- * @param recommendation Recommendations
- * @param plant_status Plant status string
+ * @param reading Reading to upload
  * @return 0 on success, negative errno on failure
  */
 int firebase_send_sensor_data(const char *serial_number,
-                             float soil_moisture,
-                             float light_level,
-                             float temperature,
-                             float humidity,
-                             float air_movement,
-                             int64_t timestamp,
                              const char *plant_name,
                              const char *plant_variety,
-                             int health_status, 
-                             const char *env_mismatch,
-                             const char *recommendation,
-                             const char *plant_status);
+                             const struct grow_reading *reading);
+
+/**
+ * @brief Send a rollup of readings to Firebase
+ *
+ * Each rollup is written to its own document under the plant's
+ * rollups collection.
+ *
+ * @param serial_number Device serial number
+ * @param rollup Rollup to upload
+ * @return 0 on success, negative errno on failure
+ */
+int firebase_send_rollup(const char *serial_number, const struct grow_rollup *rollup);
 
 /**
  * @brief Send water prediction data to Firebase
@@ -0,0 +1,144 @@
+#include <zephyr/kernel.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+
+#include "grow_reading.h"
+
+/**
+ * @brief Format environmental mismatch bits as a string (e.g. "temp,light")
+ *
+ * @param mismatch GROW_MISMATCH_* bits
+ * @param output_str Output string buffer
+ * @param output_size Size of output buffer
+ * @return 0 on success, negative errno on failure
+ */
+int grow_format_mismatch(uint8_t mismatch, char *output_str, size_t output_size)
+{
+    if (!output_str || output_size == 0) {
+        return -EINVAL;
+    }
+
+    /* Build mismatch string */
+    size_t written = 0;
+    output_str[0] = '\0';
+
+    if (mismatch & GROW_MISMATCH_TEMPERATURE) {
+        written += snprintf(output_str + written, output_size - written, "temp,");
+    }
+
+    if ((mismatch & GROW_MISMATCH_HUMIDITY) && written < output_size) {
+        written += snprintf(output_str + written, output_size - written, "humid,");
+    }
+
+    if ((mismatch & GROW_MISMATCH_SOIL_MOISTURE) && written < output_size) {
+        written += snprintf(output_str + written, output_size - written, "moist,");
+    }
+
+    if ((mismatch & GROW_MISMATCH_LIGHT_LEVEL) && written < output_size) {
+        written += snprintf(output_str + written, output_size - written, "light,");
+    }
+
+    if (written >= output_size) {
+        return -ENOMEM;
+    }
+
+    /* Remove trailing comma if any */
+    if (written > 0 && output_str[written - 1] == ',') {
+        output_str[written - 1] = '\0';
+    } else if (written == 0) {
+        /* No mismatches */
+        strncpy(output_str, "none", output_size - 1);
+        output_str[output_size - 1] = '\0';
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Format the plant status string (e.g. "Healthy", "Stressed")
+ *
+ * @param health enum grow_health value
+ * @param mismatch GROW_MISMATCH_* bits
+ * @param output_str Output string buffer
+ * @param output_size Size of output buffer
+ * @return 0 on success, negative errno on failure
+ */
+int grow_format_status(uint8_t health, uint8_t mismatch,
+                       char *output_str, size_t output_size)
+{
+    const char *status;
+
+    if (!output_str || output_size == 0) {
+        return -EINVAL;
+    }
+
+    if (health == GROW_HEALTH_CRITICAL) {
+        status = "Critical";
+    } else if (health == GROW_HEALTH_STRESSED) {
+        status = "Stressed";
+    } else if (health == GROW_HEALTH_UNKNOWN) {
+        status = "Unknown";
+    } else if (mismatch) {
+        status = "Adjustment Needed";
+    } else {
+        status = "Healthy";
+    }
+
+    strncpy(output_str, status, output_size - 1);
+    output_str[output_size - 1] = '\0';
+    return 0;
+}
+
+/**
+ * @brief Format care recommendations
+ *
+ * @param health enum grow_health value
+ * @param mismatch GROW_MISMATCH_* bits
+ * @param output_str Output string buffer
+ * @param output_size Size of output buffer
+ * @return 0 on success, negative errno on failure
+ */
+int grow_format_recommendation(uint8_t health, uint8_t mismatch,
+                               char *output_str, size_t output_size)
+{
+    if (!output_str || output_size == 0) {
+        return -EINVAL;
+    }
+
+    size_t written = 0;
+    output_str[0] = '\0';
+
+    if (health == GROW_HEALTH_UNKNOWN) {
+        /* Not analysed yet, nothing to recommend */
+        return 0;
+    }
+
+    if (health == GROW_HEALTH_HEALTHY) {
+        written += snprintf(output_str + written, output_size - written,
+                          "Plant is healthy. ");
+    } else {
+        /* Add specific recommendations for each mismatch */
+        if (mismatch & GROW_MISMATCH_TEMPERATURE) {
+            written += snprintf(output_str + written, output_size - written,
+                              "Adjust temperature. ");
+        }
+
+        if ((mismatch & GROW_MISMATCH_HUMIDITY) && written < output_size) {
+            written += snprintf(output_str + written, output_size - written,
+                              "Adjust humidity level. ");
+        }
+
+        if ((mismatch & GROW_MISMATCH_SOIL_MOISTURE) && written < output_size) {
+            written += snprintf(output_str + written, output_size - written,
+                              "Adjust watering schedule. ");
+        }
+
+        if ((mismatch & GROW_MISMATCH_LIGHT_LEVEL) && written < output_size) {
+            written += snprintf(output_str + written, output_size - written,
+                              "Adjust light exposure. ");
+        }
+    }
+
+    return (written < output_size) ? 0 : -ENOMEM;
+}
@@ -0,0 +1,206 @@
+#ifndef GROW_READING_H
+#define GROW_READING_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/toolchain.h>
+
+/* Fixed-point scales */
+#define GROW_CENTI_SCALE 100 /* Moisture, light, temperature, humidity */
+#define GROW_DECI_SCALE 10   /* Air movement */
+
+/* Plant health status (matches ML_HEALTH_*) */
+enum grow_health {
+    GROW_HEALTH_HEALTHY = 0,
+    GROW_HEALTH_STRESSED = 1,
+    GROW_HEALTH_CRITICAL = 2,
+    GROW_HEALTH_UNKNOWN = 0xFF,
+};
+
+/* Environmental mismatch bits */
+#define GROW_MISMATCH_TEMPERATURE BIT(0)
+#define GROW_MISMATCH_HUMIDITY BIT(1)
+#define GROW_MISMATCH_SOIL_MOISTURE BIT(2)
+#define GROW_MISMATCH_LIGHT_LEVEL BIT(3)
+
+/* Reading flags */
+#define GROW_READING_ANALYZED BIT(0) /* Health, mismatch and confidence are valid */
+
+/**
+ * @brief Canonical sensor reading
+ *
+ * Filled once by the sampler and passed by pointer through analysis,
+ * cache and uplink.
+ */
+struct grow_reading {
+    int64_t timestamp;      /* Seconds */
+    int16_t soil_moisture;  /* 0.01 % */
+    int16_t light_level;    /* 0.01 % */
+    int16_t temperature;    /* 0.01 °C */
+    int16_t humidity;       /* 0.01 % */
+    uint16_t air_movement;  /* 0.1 relative units */
+    uint16_t suppressed;    /* Uploads suppressed before this one */
+    uint8_t health;         /* enum grow_health */
+    uint8_t mismatch;       /* GROW_MISMATCH_* bits */
+    uint8_t confidence;     /* 0-100 % */
+    uint8_t flags;          /* GROW_READING_* bits */
+} __packed;
+
+/* Channel values of a reading */
+enum grow_channel {
+    GROW_CHANNEL_SOIL_MOISTURE,
+    GROW_CHANNEL_LIGHT_LEVEL,
+    GROW_CHANNEL_TEMPERATURE,
+    GROW_CHANNEL_HUMIDITY,
+    GROW_CHANNEL_AIR_MOVEMENT,
+    GROW_CHANNEL_COUNT,
+};
+
+/**
+ * @brief Aggregate of the readings of a period
+ *
+ * Channel values keep the fixed point of struct grow_reading.
+ */
+struct grow_rollup {
+    int64_t start;          /* Seconds, timestamp of the first reading */
+    uint16_t period;        /* Seconds */
+    uint16_t count;         /* Readings aggregated */
+    uint8_t health;         /* Worst enum grow_health, unknown if none was analyzed */
+    uint8_t mismatch;       /* GROW_MISMATCH_* bits seen in the period */
+    int32_t min[GROW_CHANNEL_COUNT];
+    int32_t max[GROW_CHANNEL_COUNT];
+    int32_t sum[GROW_CHANNEL_COUNT];
+} __packed;
+
+/**
+ * @brief Get a channel value of a reading
+ */
+static inline int32_t grow_reading_channel(const struct grow_reading *reading,
+                                           enum grow_channel channel)
+{
+    switch (channel) {
+    case GROW_CHANNEL_SOIL_MOISTURE:
+        return reading->soil_moisture;
+    case GROW_CHANNEL_LIGHT_LEVEL:
+        return reading->light_level;
+    case GROW_CHANNEL_TEMPERATURE:
+        return reading->temperature;
+    case GROW_CHANNEL_HUMIDITY:
+        return reading->humidity;
+    case GROW_CHANNEL_AIR_MOVEMENT:
+        return reading->air_movement;
+    default:
+        return 0;
+    }
+}
+
+/**
+ * @brief Get the rounded mean of a rollup channel
+ */
+static inline int32_t grow_rollup_mean(const struct grow_rollup *rollup,
+                                       enum grow_channel channel)
+{
+    int32_t sum = rollup->sum[channel];
+    int32_t half = rollup->count / 2;
+
+    if (rollup->count == 0) {
+        return 0;
+    }
+
+    return (sum < 0 ? sum - half : sum + half) / rollup->count;
+}
+
+/**
+ * @brief Convert a value to fixed point, rounding and saturating
+ */
+static inline int32_t grow_fixed_from_float(float value, int32_t scale,
+                                            int32_t min, int32_t max)
+{
+    float scaled = value * scale;
+    int32_t fixed = (int32_t)(scaled < 0.0f ? scaled - 0.5f : scaled + 0.5f);
+
+    return CLAMP(fixed, min, max);
+}
+
+/**
+ * @brief Set the channel values of a reading from floating point values
+ */
+static inline void grow_reading_set_values(struct grow_reading *reading,
+                                           float soil_moisture, float light_level,
+                                           float temperature, float humidity,
+                                           float air_movement)
+{
+    reading->soil_moisture = grow_fixed_from_float(soil_moisture, GROW_CENTI_SCALE,
+                                                   INT16_MIN, INT16_MAX);
+    reading->light_level = grow_fixed_from_float(light_level, GROW_CENTI_SCALE,
+                                                 INT16_MIN, INT16_MAX);
+    reading->temperature = grow_fixed_from_float(temperature, GROW_CENTI_SCALE,
+                                                 INT16_MIN, INT16_MAX);
+    reading->humidity = grow_fixed_from_float(humidity, GROW_CENTI_SCALE,
+                                              INT16_MIN, INT16_MAX);
+    reading->air_movement = grow_fixed_from_float(air_movement, GROW_DECI_SCALE,
+                                                  0, UINT16_MAX);
+}
+
+/* Floating point accessors */
+static inline float grow_soil_moisture(const struct grow_reading *reading)
+{
+    return reading->soil_moisture / (float)GROW_CENTI_SCALE;
+}
+
+static inline float grow_light_level(const struct grow_reading *reading)
+{
+    return reading->light_level / (float)GROW_CENTI_SCALE;
+}
+
+static inline float grow_temperature(const struct grow_reading *reading)
+{
+    return reading->temperature / (float)GROW_CENTI_SCALE;
+}
+
+static inline float grow_humidity(const struct grow_reading *reading)
+{
+    return reading->humidity / (float)GROW_CENTI_SCALE;
+}
+
+static inline float grow_air_movement(const struct grow_reading *reading)
+{
+    return reading->air_movement / (float)GROW_DECI_SCALE;
+}
+
+/**
+ * @brief Format environmental mismatch bits as a string (e.g. "temp,light")
+ *
+ * @param mismatch GROW_MISMATCH_* bits
+ * @param output_str Output string buffer
+ * @param output_size Size of output buffer
+ * @return 0 on success, negative errno on failure
+ */
+int grow_format_mismatch(uint8_t mismatch, char *output_str, size_t output_size);
+
+/**
+ * @brief Format the plant status string (e.g. "Healthy", "Stressed")
+ *
+ * @param health enum grow_health value
+ * @param mismatch GROW_MISMATCH_* bits
+ * @param output_str Output string buffer
+ * @param output_size Size of output buffer
+ * @return 0 on success, negative errno on failure
+ */
+int grow_format_status(uint8_t health, uint8_t mismatch,
+                       char *output_str, size_t output_size);
+
+/**
+ * @brief Format care recommendations
+ *
+ * @param health enum grow_health value
+ * @param mismatch GROW_MISMATCH_* bits
+ * @param output_str Output string buffer
+ * @param output_size Size of output buffer
+ * @return 0 on success, negative errno on failure
+ */
+int grow_format_recommendation(uint8_t health, uint8_t mismatch,
+                               char *output_str, size_t output_size);
+
+#endif /* GROW_READING_H */
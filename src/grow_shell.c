@@ -0,0 +1,357 @@
+#include <zephyr/kernel.h>
+#include <zephyr/shell/shell.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pipeline.h"
+#include "scheduler.h"
+#include "publish_filter.h"
+#include "data_cache.h"
+#include "storage.h"
+#include "reclog.h"
+#include "spool.h"
+#include "perf.h"
+#include "mem_monitor.h"
+#include "common/adaptive_sampling.h"
+#include "common/ml_analysis.h"
+
+/* Channel names accepted by "grow set deadband" */
+static const char *const deadband_names[PUBLISH_FIELD_COUNT] = {
+    [PUBLISH_FIELD_SOIL_MOISTURE] = "moisture",
+    [PUBLISH_FIELD_LIGHT_LEVEL] = "light",
+    [PUBLISH_FIELD_TEMPERATURE] = "temperature",
+    [PUBLISH_FIELD_HUMIDITY] = "humidity",
+    [PUBLISH_FIELD_AIR_MOVEMENT] = "air",
+};
+
+/**
+ * @brief Print the latency histogram summary of every stage
+ */
+static void print_perf(const struct shell *sh)
+{
+    struct perf_histogram hist;
+
+    shell_print(sh, "%-16s %8s %10s %10s %10s", "stage", "count", "min us", "avg us", "max us");
+
+    for (int stage = 0; stage < PERF_STAGE_COUNT; stage++) {
+        if (perf_snapshot(stage, &hist) < 0 || hist.count == 0) {
+            continue;
+        }
+
+        shell_print(sh, "%-16s %8u %10u %10u %10u", perf_stage_name(stage), hist.count,
+                    (uint32_t)k_cyc_to_us_floor64(hist.min_cycles),
+                    (uint32_t)k_cyc_to_us_floor64(hist.total_cycles / hist.count),
+                    (uint32_t)k_cyc_to_us_floor64(hist.max_cycles));
+    }
+}
+
+static int cmd_grow_stats(const struct shell *sh, size_t argc, char **argv)
+{
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    struct pipeline_stats pipeline;
+    struct scheduler_stats sched;
+    struct storage_stats storage;
+    struct reclog_stats log;
+    struct spool_stats spool;
+    struct data_cache_stats cache;
+    struct ml_stats ml;
+
+    pipeline_get_stats(&pipeline);
+    scheduler_get_stats(&sched);
+    storage_get_stats(&storage);
+    reclog_get_stats(&log);
+    spool_get_stats(&spool);
+    data_cache_get_stats(&cache);
+    ml_get_stats(&ml);
+
+    shell_print(sh, "Sampling: period %u ms, %u cycles, %u missed, jitter p99 %u us",
+                sched.period_ms, sched.cycles, sched.missed_deadlines, sched.jitter_p99_us);
+    shell_print(sh, "Pipeline: %u samples, %u sensor errors, %u dropped",
+                pipeline.samples, pipeline.sensor_errors, pipeline.dropped);
+    shell_print(sh, "Uplink: %u published, %u failed, %u suppressed, %u cached",
+                pipeline.published, pipeline.publish_errors, pipeline.suppressed,
+                pipeline.cached);
+    shell_print(sh, "Inference: %u run, %u reused", ml.inferences, ml.cache_hits);
+    shell_print(sh, "Cache: %u/%d readings, %u 10-min and %u hourly rollups "
+                "(%u readings rolled up, %u dropped)",
+                cache.cached, MAX_CACHED_ENTRIES, cache.rollups_10min, cache.rollups_hourly,
+                cache.rolled_up, cache.rollup_dropped);
+    shell_print(sh, "NVS: %u writes, %u bytes written, %u errors, %u saves coalesced",
+                storage.writes, storage.bytes_written, storage.write_errors,
+                storage.coalesced);
+    shell_print(sh, "Record log: %u appends, %u bytes written, %u erases, %u sectors dropped",
+                log.appends, log.bytes_written, log.erases, log.dropped);
+
+    if (IS_ENABLED(CONFIG_GROW_SPOOL)) {
+        shell_print(sh, "Spool: %u segments, %u bytes, %u appends, %u segments dropped",
+                    spool.segments, spool.bytes, spool.appends, spool.dropped);
+    }
+
+    if (IS_ENABLED(CONFIG_GROW_PERF)) {
+        print_perf(sh);
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Print one thread, called for every thread
+ */
+static void print_thread(const struct k_thread *thread, void *user_data)
+{
+    const struct shell *sh = user_data;
+    struct k_thread *t = (struct k_thread *)thread;
+    const char *name = k_thread_name_get(t);
+    size_t unused = 0;
+    size_t size = 0;
+    uint32_t cpu_percent = 0;
+
+#if defined(CONFIG_THREAD_STACK_INFO)
+    size = t->stack_info.size;
+#if defined(CONFIG_INIT_STACKS)
+    if (k_thread_stack_space_get(t, &unused) != 0) {
+        unused = 0;
+    }
+#endif
+#endif
+
+#if defined(CONFIG_THREAD_RUNTIME_STATS)
+    k_thread_runtime_stats_t rt_stats;
+    k_thread_runtime_stats_t all_stats;
+
+    if (k_thread_runtime_stats_get(t, &rt_stats) == 0 &&
+        k_thread_runtime_stats_all_get(&all_stats) == 0 &&
+        all_stats.execution_cycles > 0) {
+        cpu_percent = (uint32_t)((rt_stats.execution_cycles * 100U) /
+                                 all_stats.execution_cycles);
+    }
+#endif
+
+    shell_print(sh, "%-16s %4d %6u %6u %4u%%",
+                (name && name[0]) ? name : "unnamed",
+                k_thread_priority_get(t), (uint32_t)(size - unused), (uint32_t)size,
+                cpu_percent);
+}
+
+static int cmd_grow_threads(const struct shell *sh, size_t argc, char **argv)
+{
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    shell_print(sh, "%-16s %4s %6s %6s %5s", "thread", "prio", "used", "size", "cpu");
+    k_thread_foreach_unlocked(print_thread, (void *)sh);
+
+    if (!IS_ENABLED(CONFIG_INIT_STACKS) || !IS_ENABLED(CONFIG_THREAD_RUNTIME_STATS)) {
+        shell_warn(sh, "Enable CONFIG_INIT_STACKS and CONFIG_THREAD_RUNTIME_STATS "
+                   "for stack and CPU usage");
+    }
+
+    return 0;
+}
+
+static int cmd_grow_heap(const struct shell *sh, size_t argc, char **argv)
+{
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    struct mem_heap_stats heap;
+    int ret = mem_monitor_get_heap(&heap);
+
+    if (ret == -ENOTSUP) {
+        shell_error(sh, "Enable CONFIG_SYS_HEAP_RUNTIME_STATS and a system heap");
+        return ret;
+    } else if (ret < 0) {
+        shell_error(sh, "Failed to read heap statistics");
+        return ret;
+    }
+
+    shell_print(sh, "Heap: %zu allocated, %zu free, %zu peak allocated",
+                heap.allocated, heap.size - heap.allocated, heap.max_allocated);
+
+    /* Printed by the heap walker on the console */
+    if (mem_monitor_print_heap_fragmentation() == -ENOTSUP) {
+        shell_print(sh, "Enable CONFIG_SYS_HEAP_INFO for the free chunk histogram");
+    }
+
+    return 0;
+}
+
+static int cmd_grow_mem(const struct shell *sh, size_t argc, char **argv)
+{
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    struct mem_region region;
+    struct mem_stats stats;
+
+    shell_print(sh, "%-16s %-16s %8s", "module", "buffer", "bytes");
+    for (int i = 0; mem_monitor_get_region(i, &region) == 0; i++) {
+        shell_print(sh, "%-16s %-16s %8zu", region.module, region.name, region.size);
+    }
+
+    uint32_t alarms = mem_monitor_check(&stats);
+
+    shell_print(sh, "Static: %u bytes registered", stats.static_bytes);
+    if (stats.heap_size > 0) {
+        shell_print(sh, "Heap: %u/%u bytes allocated, %u peak, margin %d%%",
+                    stats.heap_allocated, stats.heap_size, stats.heap_max_allocated,
+                    CONFIG_GROW_MEM_HEAP_MARGIN_PCT);
+    }
+    shell_print(sh, "Stack: %u bytes least unused, margin %d bytes",
+                stats.stack_min_unused, CONFIG_GROW_MEM_STACK_MARGIN);
+
+    size_t arena_used;
+    size_t arena_size;
+
+    if (ml_get_arena_usage(&arena_used, &arena_size) == 0) {
+        shell_print(sh, "Tensor arena: %zu/%zu bytes used, %zu free",
+                    arena_used, arena_size, arena_size - arena_used);
+    }
+    shell_print(sh, "Alarms:%s%s%s", (alarms & MEM_ALARM_HEAP) ? " heap" : "",
+                (alarms & MEM_ALARM_STACK) ? " stack" : "", alarms ? "" : " none");
+
+    return 0;
+}
+
+static int cmd_grow_perf_dump(const struct shell *sh, size_t argc, char **argv)
+{
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    static uint8_t dump[PERF_DUMP_MAX_SIZE];
+    char line[2 * 32 + 1];
+
+    if (!IS_ENABLED(CONFIG_GROW_PERF)) {
+        shell_error(sh, "Enable CONFIG_GROW_PERF");
+        return -ENOTSUP;
+    }
+
+    int len = perf_dump(dump, sizeof(dump));
+
+    if (len < 0) {
+        shell_error(sh, "Failed to encode histograms: %d", len);
+        return len;
+    }
+
+    /* Plain hex, 32 bytes per line, for xxd -r -p on the host */
+    for (int pos = 0; pos < len; pos += 32) {
+        bin2hex(&dump[pos], MIN(len - pos, 32), line, sizeof(line));
+        shell_print(sh, "%s", line);
+    }
+
+    return 0;
+}
+
+static int cmd_grow_perf_reset(const struct shell *sh, size_t argc, char **argv)
+{
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    perf_reset();
+    shell_print(sh, "Histograms cleared");
+
+    return 0;
+}
+
+static int cmd_grow_set_interval(const struct shell *sh, size_t argc, char **argv)
+{
+    ARG_UNUSED(argc);
+
+    int err = 0;
+    unsigned long interval = shell_strtoul(argv[1], 10, &err);
+
+    if (err || adaptive_sampling_set_interval(interval) < 0) {
+        shell_error(sh, "Interval must be %d-%d seconds",
+                    CONFIG_GROW_SAMPLE_INTERVAL_MIN_SEC, CONFIG_GROW_SAMPLE_INTERVAL_MAX_SEC);
+        return -EINVAL;
+    }
+
+    scheduler_set_period(interval * 1000U);
+    shell_print(sh, "Sampling interval set to %lu s", interval);
+
+    return 0;
+}
+
+static int cmd_grow_set_deadband(const struct shell *sh, size_t argc, char **argv)
+{
+    ARG_UNUSED(argc);
+
+    char *end;
+    float deadband = strtof(argv[2], &end);
+
+    if (end == argv[2] || *end != '\0') {
+        shell_error(sh, "Invalid deadband: %s", argv[2]);
+        return -EINVAL;
+    }
+
+    for (int field = 0; field < PUBLISH_FIELD_COUNT; field++) {
+        if (strcmp(argv[1], deadband_names[field]) != 0) {
+            continue;
+        }
+
+        if (publish_filter_set_deadband(field, deadband) < 0) {
+            shell_error(sh, "Deadband must not be negative");
+            return -EINVAL;
+        }
+
+        shell_print(sh, "Deadband of %s set to %.2f", deadband_names[field], (double)deadband);
+        return 0;
+    }
+
+    shell_error(sh, "Unknown channel %s (moisture, light, temperature, humidity, air)",
+                argv[1]);
+    return -EINVAL;
+}
+
+static int cmd_grow_set_health(const struct shell *sh, size_t argc, char **argv)
+{
+    ARG_UNUSED(argc);
+
+    enum publish_health_mode mode;
+
+    if (strcmp(argv[1], "any") == 0) {
+        mode = PUBLISH_HEALTH_ANY;
+    } else if (strcmp(argv[1], "worse") == 0) {
+        mode = PUBLISH_HEALTH_WORSE;
+    } else {
+        shell_error(sh, "Unknown health mode %s (any, worse)", argv[1]);
+        return -EINVAL;
+    }
+
+    publish_filter_set_health_mode(mode);
+    shell_print(sh, "Health uploads set to %s", argv[1]);
+
+    return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_grow_set,
+    SHELL_CMD_ARG(interval, NULL, "Set the sampling interval: interval <seconds>",
+                  cmd_grow_set_interval, 2, 0),
+    SHELL_CMD_ARG(deadband, NULL,
+                  "Set a publish deadband: deadband <moisture|light|temperature|humidity|air> <value>",
+                  cmd_grow_set_deadband, 3, 0),
+    SHELL_CMD_ARG(health, NULL,
+                  "Set which health changes force an upload: health <any|worse>",
+                  cmd_grow_set_health, 2, 0),
+    SHELL_SUBCMD_SET_END
+);
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_grow_perf,
+    SHELL_CMD(dump, NULL, "Binary histogram dump in hex", cmd_grow_perf_dump),
+    SHELL_CMD(reset, NULL, "Clear the histograms", cmd_grow_perf_reset),
+    SHELL_SUBCMD_SET_END
+);
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_grow,
+    SHELL_CMD(stats, NULL, "Pipeline, uplink, cache and storage statistics", cmd_grow_stats),
+    SHELL_CMD(threads, NULL, "Stack usage and CPU load per thread", cmd_grow_threads),
+    SHELL_CMD(heap, NULL, "Heap usage, peak and fragmentation", cmd_grow_heap),
+    SHELL_CMD(mem, NULL, "Static footprint, heap and stack budget", cmd_grow_mem),
+    SHELL_CMD(perf, &sub_grow_perf, "Stage latency histograms", NULL),
+    SHELL_CMD(set, &sub_grow_set, "Runtime tuning", NULL),
+    SHELL_SUBCMD_SET_END
+);
+
+SHELL_CMD_REGISTER(grow, &sub_grow, "Grow plant monitor commands", NULL);
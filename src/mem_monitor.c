@@ -0,0 +1,334 @@
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/spinlock.h>
+#include <zephyr/sys/sys_heap.h>
+#include <string.h>
+#include <errno.h>
+
+#include "mem_monitor.h"
+#include "ble.h"
+
+LOG_MODULE_REGISTER(mem_monitor, CONFIG_LOG_DEFAULT_LEVEL);
+
+/* Heap statistics need the runtime stats of a configured system heap */
+#if defined(CONFIG_SYS_HEAP_RUNTIME_STATS) && (CONFIG_HEAP_MEM_POOL_SIZE > 0)
+#define HEAP_STATS_AVAILABLE 1
+#else
+#define HEAP_STATS_AVAILABLE 0
+#endif
+
+/* The free chunk histogram needs the heap info walker */
+#if defined(CONFIG_SYS_HEAP_INFO) && (CONFIG_HEAP_MEM_POOL_SIZE > 0)
+#define HEAP_INFO_AVAILABLE 1
+#else
+#define HEAP_INFO_AVAILABLE 0
+#endif
+
+/* Footprint table */
+static struct mem_region regions[CONFIG_GROW_MEM_MONITOR_MAX_REGIONS];
+static int region_count;
+static struct k_spinlock region_lock;
+
+/* Last check */
+static struct mem_stats last_stats;
+static uint32_t raised_alarms;
+K_MUTEX_DEFINE(check_lock);
+
+static struct k_work_delayable check_work;
+
+/* Thread with the least unused stack, found by the stack scan */
+struct stack_scan {
+    size_t min_unused;
+    const char *min_name;
+};
+
+/**
+ * @brief Register a static buffer in the footprint table
+ *
+ * @param module Owning module name (static string)
+ * @param name Buffer name (static string)
+ * @param size Buffer size in bytes
+ * @return 0 on success, negative errno on failure
+ */
+int mem_monitor_register(const char *module, const char *name, size_t size)
+{
+    int ret = 0;
+
+    if (!module || !name) {
+        return -EINVAL;
+    }
+
+    k_spinlock_key_t key = k_spin_lock(&region_lock);
+
+    /* Modules may be initialized again, e.g. after a failed start */
+    for (int i = 0; i < region_count; i++) {
+        if (regions[i].module == module && regions[i].name == name) {
+            regions[i].size = size;
+            goto out;
+        }
+    }
+
+    if (region_count >= CONFIG_GROW_MEM_MONITOR_MAX_REGIONS) {
+        ret = -ENOMEM;
+        goto out;
+    }
+
+    regions[region_count].module = module;
+    regions[region_count].name = name;
+    regions[region_count].size = size;
+    region_count++;
+
+out:
+    k_spin_unlock(&region_lock, key);
+
+    if (ret < 0) {
+        LOG_ERR("No room to register %s/%s, raise CONFIG_GROW_MEM_MONITOR_MAX_REGIONS",
+                module, name);
+    }
+    return ret;
+}
+
+/**
+ * @brief Get a registered static buffer
+ *
+ * @param index Registration index
+ * @param region Pointer to store the buffer description
+ * @return 0 on success, -ENOENT past the last registration
+ */
+int mem_monitor_get_region(int index, struct mem_region *region)
+{
+    int ret = 0;
+
+    if (!region || index < 0) {
+        return -EINVAL;
+    }
+
+    k_spinlock_key_t key = k_spin_lock(&region_lock);
+
+    if (index < region_count) {
+        *region = regions[index];
+    } else {
+        ret = -ENOENT;
+    }
+
+    k_spin_unlock(&region_lock, key);
+    return ret;
+}
+
+/**
+ * @brief Sum the registered static buffers
+ */
+static size_t static_bytes(void)
+{
+    size_t total = 0;
+    k_spinlock_key_t key = k_spin_lock(&region_lock);
+
+    for (int i = 0; i < region_count; i++) {
+        total += regions[i].size;
+    }
+
+    k_spin_unlock(&region_lock, key);
+    return total;
+}
+
+#if HEAP_STATS_AVAILABLE || HEAP_INFO_AVAILABLE
+extern struct k_heap _system_heap;
+#endif
+
+/**
+ * @brief Get the system heap usage
+ *
+ * @param stats Pointer to store the heap usage
+ * @return 0 on success, -ENOTSUP without heap runtime statistics
+ */
+int mem_monitor_get_heap(struct mem_heap_stats *stats)
+{
+    if (!stats) {
+        return -EINVAL;
+    }
+
+#if HEAP_STATS_AVAILABLE
+    struct sys_memory_stats heap;
+
+    if (sys_heap_runtime_stats_get(&_system_heap.heap, &heap) != 0) {
+        return -EIO;
+    }
+
+    stats->size = heap.allocated_bytes + heap.free_bytes;
+    stats->allocated = heap.allocated_bytes;
+    stats->max_allocated = heap.max_allocated_bytes;
+
+    return 0;
+#else
+    memset(stats, 0, sizeof(*stats));
+    return -ENOTSUP;
+#endif
+}
+
+/**
+ * @brief Print the free chunk histogram of the system heap
+ *
+ * @return 0 on success, -ENOTSUP without CONFIG_SYS_HEAP_INFO
+ */
+int mem_monitor_print_heap_fragmentation(void)
+{
+#if HEAP_INFO_AVAILABLE
+    /* The walk only reads chunk headers, keep allocations out meanwhile */
+    k_spinlock_key_t key = k_spin_lock(&_system_heap.lock);
+    sys_heap_print_info(&_system_heap.heap, false);
+    k_spin_unlock(&_system_heap.lock, key);
+
+    return 0;
+#else
+    return -ENOTSUP;
+#endif
+}
+
+/**
+ * @brief Record the unused stack of one thread
+ */
+static void scan_thread(const struct k_thread *cthread, void *user_data)
+{
+#if defined(CONFIG_INIT_STACKS) && defined(CONFIG_THREAD_STACK_INFO)
+    struct stack_scan *scan = user_data;
+    struct k_thread *thread = (struct k_thread *)cthread;
+    size_t unused;
+
+    if (k_thread_stack_space_get(thread, &unused) != 0) {
+        return;
+    }
+
+    if (unused < scan->min_unused) {
+        const char *name = k_thread_name_get(thread);
+
+        scan->min_unused = unused;
+        scan->min_name = (name && name[0]) ? name : "unnamed";
+    }
+#else
+    ARG_UNUSED(cthread);
+    ARG_UNUSED(user_data);
+#endif
+}
+
+/**
+ * @brief Run the heap and stack checks and raise alarms
+ *
+ * @param stats Pointer to store the summary, may be NULL
+ * @return MEM_ALARM_* bits currently raised
+ */
+uint32_t mem_monitor_check(struct mem_stats *stats)
+{
+    struct mem_heap_stats heap;
+    struct stack_scan scan = {
+        .min_unused = SIZE_MAX,
+        .min_name = NULL,
+    };
+    struct mem_stats current = { 0 };
+    uint32_t alarms = 0;
+
+    current.static_bytes = static_bytes();
+
+    if (mem_monitor_get_heap(&heap) == 0) {
+        size_t free_bytes = heap.size - heap.allocated;
+
+        current.heap_size = heap.size;
+        current.heap_allocated = heap.allocated;
+        current.heap_max_allocated = heap.max_allocated;
+
+        if (free_bytes * 100U < heap.size * CONFIG_GROW_MEM_HEAP_MARGIN_PCT) {
+            alarms |= MEM_ALARM_HEAP;
+        }
+    }
+
+    k_thread_foreach_unlocked(scan_thread, &scan);
+
+    if (scan.min_name) {
+        current.stack_min_unused = scan.min_unused;
+
+        if (scan.min_unused < CONFIG_GROW_MEM_STACK_MARGIN) {
+            alarms |= MEM_ALARM_STACK;
+        }
+    }
+
+    current.alarms = alarms;
+
+    k_mutex_lock(&check_lock, K_FOREVER);
+
+    uint32_t raised = alarms & ~raised_alarms;
+    uint32_t cleared = raised_alarms & ~alarms;
+
+    if (raised & MEM_ALARM_HEAP) {
+        LOG_WRN("Heap low: %u of %u bytes free",
+               current.heap_size - current.heap_allocated, current.heap_size);
+    }
+
+    if (raised & MEM_ALARM_STACK) {
+        LOG_WRN("Stack low: %s has %u bytes unused", scan.min_name,
+               current.stack_min_unused);
+    }
+
+    if (cleared) {
+        LOG_INF("Memory alarm cleared (0x%x)", cleared);
+    }
+
+    raised_alarms = alarms;
+    last_stats = current;
+
+    k_mutex_unlock(&check_lock);
+
+    if (raised) {
+        ble_notify_mem_stats(&current);
+    }
+
+    if (stats) {
+        *stats = current;
+    }
+
+    return alarms;
+}
+
+/**
+ * @brief Get the summary of the last check
+ *
+ * @param stats Pointer to store the summary
+ */
+void mem_monitor_get_stats(struct mem_stats *stats)
+{
+    if (!stats) {
+        return;
+    }
+
+    k_mutex_lock(&check_lock, K_FOREVER);
+    *stats = last_stats;
+    k_mutex_unlock(&check_lock);
+}
+
+/**
+ * @brief Periodic check on the system work queue
+ */
+static void check_work_handler(struct k_work *work)
+{
+    ARG_UNUSED(work);
+
+    mem_monitor_check(NULL);
+    k_work_reschedule(&check_work, K_SECONDS(CONFIG_GROW_MEM_MONITOR_INTERVAL_SEC));
+}
+
+/**
+ * @brief Initialize the memory monitor
+ *
+ * @return 0 on success, negative errno on failure
+ */
+int mem_monitor_init(void)
+{
+    if (!IS_ENABLED(CONFIG_GROW_MEM_MONITOR)) {
+        return 0;
+    }
+
+    k_work_init_delayable(&check_work, check_work_handler);
+    k_work_reschedule(&check_work, K_SECONDS(CONFIG_GROW_MEM_MONITOR_INTERVAL_SEC));
+
+    LOG_INF("Memory monitor started (heap margin %d%%, stack margin %d bytes)",
+           CONFIG_GROW_MEM_HEAP_MARGIN_PCT, CONFIG_GROW_MEM_STACK_MARGIN);
+    return 0;
+}
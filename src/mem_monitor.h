@@ -0,0 +1,122 @@
+#ifndef MEM_MONITOR_H
+#define MEM_MONITOR_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/toolchain.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Alarm bits */
+#define MEM_ALARM_HEAP BIT(0)  /* Free system heap below the margin */
+#define MEM_ALARM_STACK BIT(1) /* A thread's unused stack below the margin */
+
+/* Static buffer owned by a module */
+struct mem_region {
+    const char *module;
+    const char *name;
+    size_t size;
+};
+
+/*
+ * System heap usage
+ *
+ * This is the Zephyr system heap (k_malloc). The TFLite interpreter is
+ * built in a registered static buffer rather than with C++ new, so the
+ * libc malloc arena holds no long-lived allocations of the app.
+ */
+struct mem_heap_stats {
+    size_t size;
+    size_t allocated;
+    size_t max_allocated;
+};
+
+/* Memory summary, little-endian on the Memory Stats characteristic */
+struct mem_stats {
+    uint32_t static_bytes;       /* Sum of the registered static buffers */
+    uint32_t heap_size;          /* 0 if heap statistics are unavailable */
+    uint32_t heap_allocated;
+    uint32_t heap_max_allocated;
+    uint32_t stack_min_unused;   /* Smallest unused stack of any thread */
+    uint32_t alarms;             /* MEM_ALARM_* bits raised by the last check */
+} __packed;
+
+/**
+ * @brief Initialize the memory monitor
+ *
+ * Starts the periodic check when CONFIG_GROW_MEM_MONITOR is enabled.
+ *
+ * @return 0 on success, negative errno on failure
+ */
+int mem_monitor_init(void);
+
+/**
+ * @brief Register a static buffer in the footprint table
+ *
+ * The table holds CONFIG_GROW_MEM_MONITOR_MAX_REGIONS buffers, a failed
+ * registration is logged.
+ *
+ * @param module Owning module name (static string)
+ * @param name Buffer name (static string)
+ * @param size Buffer size in bytes
+ * @return 0 on success, negative errno on failure
+ */
+int mem_monitor_register(const char *module, const char *name, size_t size);
+
+/**
+ * @brief Get a registered static buffer
+ *
+ * @param index Registration index
+ * @param region Pointer to store the buffer description
+ * @return 0 on success, -ENOENT past the last registration
+ */
+int mem_monitor_get_region(int index, struct mem_region *region);
+
+/**
+ * @brief Get the system heap usage
+ *
+ * Only reads the heap runtime statistics, it never allocates.
+ *
+ * @param stats Pointer to store the heap usage
+ * @return 0 on success, -ENOTSUP without heap runtime statistics
+ */
+int mem_monitor_get_heap(struct mem_heap_stats *stats);
+
+/**
+ * @brief Print the free chunk histogram of the system heap
+ *
+ * Free chunks are counted per power-of-two size bucket, so a heap with
+ * much free space in small buckets only is fragmented. Reads the chunk
+ * headers with the heap locked and prints to the console, it never
+ * allocates.
+ *
+ * @return 0 on success, -ENOTSUP without CONFIG_SYS_HEAP_INFO
+ */
+int mem_monitor_print_heap_fragmentation(void);
+
+/**
+ * @brief Run the heap and stack checks and raise alarms
+ *
+ * Alarms are logged and notified over BLE when they are raised, and
+ * logged again when they clear.
+ *
+ * @param stats Pointer to store the summary, may be NULL
+ * @return MEM_ALARM_* bits currently raised
+ */
+uint32_t mem_monitor_check(struct mem_stats *stats);
+
+/**
+ * @brief Get the summary of the last check
+ *
+ * @param stats Pointer to store the summary
+ */
+void mem_monitor_get_stats(struct mem_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MEM_MONITOR_H */
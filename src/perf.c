@@ -0,0 +1,187 @@
+#include <zephyr/kernel.h>
+#include <zephyr/spinlock.h>
+#include <zephyr/sys/byteorder.h>
+#include <string.h>
+#include <errno.h>
+
+#include "perf.h"
+
+/* Binary dump format */
+#define PERF_DUMP_MAGIC "GPRF"
+#define PERF_DUMP_VERSION 1
+
+static struct perf_histogram histograms[PERF_STAGE_COUNT];
+static struct k_spinlock perf_lock;
+
+static const char *const stage_names[PERF_STAGE_COUNT] = {
+    [PERF_SENSORS_READ] = "sensors_read",
+    [PERF_ADC_SOIL] = "adc_soil",
+    [PERF_ADC_LIGHT] = "adc_light",
+    [PERF_ADC_AIR] = "adc_air",
+    [PERF_DHT] = "dht",
+    [PERF_ML_ADD_READING] = "ml_add_reading",
+    [PERF_INFERENCE] = "inference",
+    [PERF_STORAGE_SAVE] = "storage_save",
+    [PERF_HABITAT_FETCH] = "habitat_fetch",
+    [PERF_DNS] = "dns",
+    [PERF_TCP_CONNECT] = "tcp_connect",
+    [PERF_TLS_CONNECT] = "tls_connect",
+    [PERF_HTTP_REQUEST] = "http_request",
+    [PERF_UPLINK] = "uplink",
+    [PERF_RECLOG_APPEND] = "reclog_append",
+};
+
+#if defined(CONFIG_GROW_PERF)
+/**
+ * @brief Get the log2 bucket for a duration
+ */
+static int cycles_bucket(uint32_t cycles)
+{
+    int bucket = 0;
+
+    while (cycles > 0 && bucket < PERF_BUCKETS - 1) {
+        cycles >>= 1;
+        bucket++;
+    }
+
+    return bucket;
+}
+
+/**
+ * @brief Record the duration of a stage
+ *
+ * @param stage Stage that completed
+ * @param start Timestamp returned by perf_begin()
+ */
+void perf_end(enum perf_stage stage, uint32_t start)
+{
+    /* Unsigned subtraction handles one counter wrap */
+    uint32_t cycles = k_cycle_get_32() - start;
+
+    if (stage < 0 || stage >= PERF_STAGE_COUNT) {
+        return;
+    }
+
+    k_spinlock_key_t key = k_spin_lock(&perf_lock);
+    struct perf_histogram *hist = &histograms[stage];
+
+    if (hist->count == 0 || cycles < hist->min_cycles) {
+        hist->min_cycles = cycles;
+    }
+    if (cycles > hist->max_cycles) {
+        hist->max_cycles = cycles;
+    }
+    hist->count++;
+    hist->total_cycles += cycles;
+    hist->buckets[cycles_bucket(cycles)]++;
+
+    k_spin_unlock(&perf_lock, key);
+}
+#endif /* CONFIG_GROW_PERF */
+
+/**
+ * @brief Get a copy of the histogram of a stage
+ *
+ * @param stage Stage to query
+ * @param hist_out Pointer to store the histogram
+ * @return 0 on success, negative errno on failure
+ */
+int perf_snapshot(enum perf_stage stage, struct perf_histogram *hist_out)
+{
+    if (stage < 0 || stage >= PERF_STAGE_COUNT || !hist_out) {
+        return -EINVAL;
+    }
+
+    k_spinlock_key_t key = k_spin_lock(&perf_lock);
+    *hist_out = histograms[stage];
+    k_spin_unlock(&perf_lock, key);
+
+    return 0;
+}
+
+/**
+ * @brief Clear all histograms
+ */
+void perf_reset(void)
+{
+    k_spinlock_key_t key = k_spin_lock(&perf_lock);
+    memset(histograms, 0, sizeof(histograms));
+    k_spin_unlock(&perf_lock, key);
+}
+
+/**
+ * @brief Get the name of a stage
+ *
+ * @param stage Stage to query
+ * @return Stage name, or "unknown" for an invalid stage
+ */
+const char *perf_stage_name(enum perf_stage stage)
+{
+    if (stage < 0 || stage >= PERF_STAGE_COUNT) {
+        return "unknown";
+    }
+
+    return stage_names[stage];
+}
+
+/**
+ * @brief Encode all histograms in a compact binary format
+ *
+ * @param buf Output buffer
+ * @param size Size of output buffer
+ * @return Number of bytes written on success, negative errno on failure
+ */
+int perf_dump(uint8_t *buf, size_t size)
+{
+    struct perf_histogram hist;
+    size_t pos = 0;
+
+    if (!buf || size < PERF_DUMP_HEADER_SIZE) {
+        return -ENOMEM;
+    }
+
+    memcpy(buf, PERF_DUMP_MAGIC, 4);
+    buf[4] = PERF_DUMP_VERSION;
+    buf[5] = PERF_STAGE_COUNT;
+    buf[6] = PERF_BUCKETS;
+    buf[7] = 0;
+    sys_put_le32(sys_clock_hw_cycles_per_sec(), &buf[8]);
+    pos = PERF_DUMP_HEADER_SIZE;
+
+    for (int stage = 0; stage < PERF_STAGE_COUNT; stage++) {
+        uint8_t used = 0;
+
+        perf_snapshot(stage, &hist);
+        if (hist.count == 0) {
+            continue;
+        }
+
+        for (int i = 0; i < PERF_BUCKETS; i++) {
+            if (hist.buckets[i]) {
+                used++;
+            }
+        }
+
+        if (pos + PERF_DUMP_STAGE_SIZE + used * PERF_DUMP_BUCKET_SIZE > size) {
+            return -ENOMEM;
+        }
+
+        buf[pos] = stage;
+        buf[pos + 1] = used;
+        sys_put_le32(hist.count, &buf[pos + 2]);
+        sys_put_le32(hist.min_cycles, &buf[pos + 6]);
+        sys_put_le32(hist.max_cycles, &buf[pos + 10]);
+        sys_put_le64(hist.total_cycles, &buf[pos + 14]);
+        pos += PERF_DUMP_STAGE_SIZE;
+
+        for (int i = 0; i < PERF_BUCKETS; i++) {
+            if (hist.buckets[i]) {
+                buf[pos] = i;
+                sys_put_le32(hist.buckets[i], &buf[pos + 1]);
+                pos += PERF_DUMP_BUCKET_SIZE;
+            }
+        }
+    }
+
+    return pos;
+}
@@ -0,0 +1,126 @@
+#ifndef PERF_H
+#define PERF_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <zephyr/kernel.h>
+
+/* Instrumented pipeline stages */
+enum perf_stage {
+    PERF_SENSORS_READ,   /* Complete sensors_read() */
+    PERF_ADC_SOIL,       /* Soil moisture ADC read */
+    PERF_ADC_LIGHT,      /* Light level ADC read */
+    PERF_ADC_AIR,        /* Air movement ADC read */
+    PERF_DHT,            /* Temperature and humidity sensor read */
+    PERF_ML_ADD_READING, /* ml_add_sensor_reading() */
+    PERF_INFERENCE,      /* tflite_run_inference() */
+    PERF_STORAGE_SAVE,   /* storage_save_value() */
+    PERF_HABITAT_FETCH,  /* Complete habitat_data_fetch() */
+    PERF_DNS,            /* Host name resolution */
+    PERF_TCP_CONNECT,    /* TCP connect on plain sockets */
+    PERF_TLS_CONNECT,    /* TCP connect and TLS handshake on TLS sockets */
+    PERF_HTTP_REQUEST,   /* http_client_req() */
+    PERF_UPLINK,         /* Complete reading upload */
+    PERF_RECLOG_APPEND,  /* reclog_append() */
+    PERF_STAGE_COUNT
+};
+
+/* Number of log2 buckets (bucket n holds [2^(n-1), 2^n) cycles) */
+#define PERF_BUCKETS 32
+
+/*
+ * Latency histogram of one stage, durations in hardware cycles.
+ * Durations are measured with the 32-bit cycle counter, so stages longer
+ * than one counter period (about 17 s at 240 MHz) are under-reported.
+ */
+struct perf_histogram {
+    uint32_t count;
+    uint32_t min_cycles;
+    uint32_t max_cycles;
+    uint64_t total_cycles;
+    uint32_t buckets[PERF_BUCKETS];
+};
+
+#if defined(CONFIG_GROW_PERF)
+
+/**
+ * @brief Start timing a stage
+ *
+ * @return Start timestamp to pass to perf_end()
+ */
+static inline uint32_t perf_begin(void)
+{
+    return k_cycle_get_32();
+}
+
+/**
+ * @brief Record the duration of a stage
+ *
+ * @param stage Stage that completed
+ * @param start Timestamp returned by perf_begin()
+ */
+void perf_end(enum perf_stage stage, uint32_t start);
+
+#else
+
+static inline uint32_t perf_begin(void)
+{
+    return 0;
+}
+
+static inline void perf_end(enum perf_stage stage, uint32_t start)
+{
+    ARG_UNUSED(stage);
+    ARG_UNUSED(start);
+}
+
+#endif /* CONFIG_GROW_PERF */
+
+/**
+ * @brief Get a copy of the histogram of a stage
+ *
+ * @param stage Stage to query
+ * @param hist_out Pointer to store the histogram
+ * @return 0 on success, negative errno on failure
+ */
+int perf_snapshot(enum perf_stage stage, struct perf_histogram *hist_out);
+
+/**
+ * @brief Clear all histograms
+ */
+void perf_reset(void);
+
+/**
+ * @brief Get the name of a stage
+ *
+ * @param stage Stage to query
+ * @return Stage name, or "unknown" for an invalid stage
+ */
+const char *perf_stage_name(enum perf_stage stage);
+
+/* Sizes of the perf_dump() header, stage and bucket entries */
+#define PERF_DUMP_HEADER_SIZE 12
+#define PERF_DUMP_STAGE_SIZE 22
+#define PERF_DUMP_BUCKET_SIZE 5
+
+/* Largest perf_dump() output, every stage with every bucket used */
+#define PERF_DUMP_MAX_SIZE (PERF_DUMP_HEADER_SIZE + PERF_STAGE_COUNT * \
+                            (PERF_DUMP_STAGE_SIZE + PERF_BUCKETS * PERF_DUMP_BUCKET_SIZE))
+
+/**
+ * @brief Encode all histograms in a compact binary format
+ *
+ * Layout, all fields little-endian:
+ * - header: magic "GPRF", version (u8), stage count (u8),
+ *   bucket count (u8), reserved (u8), cycles per second (u32)
+ * - per stage with samples: stage (u8), non-empty bucket count (u8),
+ *   count (u32), min cycles (u32), max cycles (u32), total cycles (u64),
+ *   then (bucket (u8), count (u32)) for each non-empty bucket
+ *
+ * @param buf Output buffer
+ * @param size Size of output buffer
+ * @return Number of bytes written on success, negative errno on failure
+ */
+int perf_dump(uint8_t *buf, size_t size);
+
+#endif /* PERF_H */
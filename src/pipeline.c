@@ -0,0 +1,626 @@
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/reboot.h>
+
+#include "pipeline.h"
+#include "sensors.h"
+#include "connectivity.h"
+#include "firebase.h"
+#include "storage.h"
+#include "data_cache.h"
+#include "button_handler.h"
+#include "scheduler.h"
+#include "publish_filter.h"
+#include "boot_stats.h"
+#include "perf.h"
+#include "mem_monitor.h"
+#include "common/ml_analysis.h"
+#include "common/plant_analysis.h"
+#include "common/water_analysis.h"
+#include "common/adaptive_sampling.h"
+
+LOG_MODULE_REGISTER(pipeline, CONFIG_LOG_DEFAULT_LEVEL);
+
+/* Watering threshold used for predictions (30% moisture) */
+#define WATERING_THRESHOLD 30.0f
+
+/* Minimum prediction confidence required to upload a prediction */
+#define WATER_PREDICTION_MIN_CONFIDENCE 30.0f
+
+/*
+ * Reading slot handed between the stages by pointer. Slots come from a
+ * slab sized for both queues plus the slot held by each stage, so the
+ * sampler never waits for one.
+ */
+struct pipeline_slot {
+    struct grow_reading reading;
+    float daily_consumption_rate;
+    int64_t next_watering_timestamp;
+    float prediction_confidence;
+};
+
+#define PIPELINE_SLOT_COUNT (2 * CONFIG_GROW_PIPELINE_QUEUE_DEPTH + 3)
+
+K_MEM_SLAB_DEFINE_STATIC(slot_slab, sizeof(struct pipeline_slot),
+                         PIPELINE_SLOT_COUNT, 8);
+
+/* Queues connecting the pipeline stages */
+K_MSGQ_DEFINE(sample_msgq, sizeof(struct pipeline_slot *),
+              CONFIG_GROW_PIPELINE_QUEUE_DEPTH, 4);
+K_MSGQ_DEFINE(result_msgq, sizeof(struct pipeline_slot *),
+              CONFIG_GROW_PIPELINE_QUEUE_DEPTH, 4);
+
+/* Raised when the network comes up so the uplink drains the cache */
+static struct k_poll_signal connected_signal;
+
+/* Raised when the cache rollups are due to be saved */
+static struct k_poll_signal rollup_signal;
+
+/* Shared device information */
+static struct device_info *dev_info;
+
+/* Set once the deferred analysis initialization completed */
+static atomic_t analysis_ready;
+
+/* Counters reported by pipeline_get_stats() */
+static atomic_t stat_samples;
+static atomic_t stat_sensor_errors;
+static atomic_t stat_dropped;
+static atomic_t stat_published;
+static atomic_t stat_publish_errors;
+static atomic_t stat_suppressed;
+static atomic_t stat_cached;
+
+static void sampler_thread(void *p1, void *p2, void *p3);
+static void analysis_thread(void *p1, void *p2, void *p3);
+static void uplink_thread(void *p1, void *p2, void *p3);
+
+K_THREAD_DEFINE(sampler_tid, CONFIG_GROW_SAMPLER_STACK_SIZE,
+                sampler_thread, NULL, NULL, NULL,
+                CONFIG_GROW_SAMPLER_PRIORITY, 0, SYS_FOREVER_MS);
+K_THREAD_DEFINE(analysis_tid, CONFIG_GROW_ANALYSIS_STACK_SIZE,
+                analysis_thread, NULL, NULL, NULL,
+                CONFIG_GROW_ANALYSIS_PRIORITY, 0, SYS_FOREVER_MS);
+K_THREAD_DEFINE(uplink_tid, CONFIG_GROW_UPLINK_STACK_SIZE,
+                uplink_thread, NULL, NULL, NULL,
+                CONFIG_GROW_UPLINK_PRIORITY, 0, SYS_FOREVER_MS);
+
+/**
+ * @brief Have the uplink stage save the cache rollups
+ *
+ * Called from the data cache timer.
+ */
+static void request_rollup_save(void)
+{
+    k_poll_signal_raise(&rollup_signal, 0);
+}
+
+/**
+ * @brief Handle pending button requests
+ */
+static void handle_button_requests(void)
+{
+    if (button_reset_requested()) {
+        LOG_INF("Processing soft reset request");
+        button_clear_requests();
+        data_cache_sync();
+        storage_sync();
+        sys_reboot(SYS_REBOOT_WARM);
+    } else if (button_factory_reset_requested()) {
+        LOG_INF("Processing factory reset request");
+        button_clear_requests();
+
+        /* Clear all data */
+        storage_reset_device_config();
+
+        /* Reboot */
+        data_cache_sync();
+        storage_sync();
+        sys_reboot(SYS_REBOOT_COLD);
+    }
+}
+
+/**
+ * @brief Sampler stage: read sensors at a fixed cadence
+ *
+ * Runs at high priority and never blocks on analysis or network work.
+ * Wake-ups follow absolute deadlines from the sampling scheduler, so
+ * processing time never accumulates as drift.
+ * When the analysis stage falls behind, the oldest queued sample is
+ * dropped so the newest reading is always processed.
+ */
+static void sampler_thread(void *p1, void *p2, void *p3)
+{
+    ARG_UNUSED(p1);
+    ARG_UNUSED(p2);
+    ARG_UNUSED(p3);
+
+    int ret;
+    struct pipeline_slot *slot = NULL;
+
+    while (1) {
+        scheduler_wait_next();
+
+        if (!slot && k_mem_slab_alloc(&slot_slab, (void **)&slot, K_NO_WAIT) != 0) {
+            /* Analysis is behind, reuse the slot of the oldest sample */
+            if (k_msgq_get(&sample_msgq, &slot, K_NO_WAIT) == 0) {
+                atomic_inc(&stat_dropped);
+                LOG_WRN("Analysis queue full, dropped sample from %lld",
+                       (long long)slot->reading.timestamp);
+            } else {
+                LOG_ERR("No free reading slot");
+                slot = NULL;
+                handle_button_requests();
+                continue;
+            }
+        }
+
+        uint32_t start = perf_begin();
+
+        ret = sensors_read(&slot->reading);
+        perf_end(PERF_SENSORS_READ, start);
+
+        if (ret < 0) {
+            atomic_inc(&stat_sensor_errors);
+            LOG_ERR("Failed to read sensors: %d", ret);
+        } else {
+            atomic_inc(&stat_samples);
+            boot_stats_mark(BOOT_PHASE_FIRST_READING);
+
+            LOG_INF("Sensor readings - Moisture: %.2f%%, Light: %.2f%%, Temp: %.2f°C, Humidity: %.2f%%, Air: %.2f",
+                   grow_soil_moisture(&slot->reading),
+                   grow_light_level(&slot->reading),
+                   grow_temperature(&slot->reading),
+                   grow_humidity(&slot->reading),
+                   grow_air_movement(&slot->reading));
+
+            /* Only provisioned devices analyse and publish readings */
+            if (dev_info->provisioned) {
+                struct pipeline_slot *dropped;
+
+                while (k_msgq_put(&sample_msgq, &slot, K_NO_WAIT) != 0) {
+                    /* Analysis is behind, drop the oldest sample */
+                    if (k_msgq_get(&sample_msgq, &dropped, K_NO_WAIT) == 0) {
+                        atomic_inc(&stat_dropped);
+                        LOG_WRN("Analysis queue full, dropped sample from %lld",
+                               (long long)dropped->reading.timestamp);
+                        k_mem_slab_free(&slot_slab, dropped);
+                    }
+                }
+                slot = NULL;
+            }
+        }
+
+        handle_button_requests();
+    }
+}
+
+/**
+ * @brief Store a reading in the offline cache
+ *
+ * @param reading Reading to cache
+ */
+static void cache_reading(const struct grow_reading *reading)
+{
+    int ret = data_cache_add_reading(reading);
+
+    if (ret < 0) {
+        LOG_ERR("Failed to cache sensor data: %d", ret);
+    } else {
+        atomic_inc(&stat_cached);
+        LOG_INF("Sensor data cached successfully");
+    }
+}
+
+/**
+ * @brief Hand a slot over to the uplink stage, caching if it is backed up
+ *
+ * @param slot Slot holding the reading
+ */
+static void forward_slot(struct pipeline_slot *slot)
+{
+    if (k_msgq_put(&result_msgq, &slot, K_NO_WAIT) != 0) {
+        LOG_WRN("Uplink queue full, caching sensor reading");
+        cache_reading(&slot->reading);
+        k_mem_slab_free(&slot_slab, slot);
+    }
+}
+
+/**
+ * @brief Analysis stage: run plant and water analysis on each sample
+ *
+ * Readings taken before the deferred boot initialization completed are
+ * forwarded without analysis.
+ */
+static void analysis_thread(void *p1, void *p2, void *p3)
+{
+    ARG_UNUSED(p1);
+    ARG_UNUSED(p2);
+    ARG_UNUSED(p3);
+
+    int ret;
+    struct pipeline_slot *slot;
+    static struct water_consumption_pattern water_pattern;
+
+    while (1) {
+        k_msgq_get(&sample_msgq, &slot, K_FOREVER);
+
+        if (!atomic_get(&analysis_ready)) {
+            /* Still booting, forward the reading unanalysed */
+            slot->prediction_confidence = 0.0f;
+            forward_slot(slot);
+            continue;
+        }
+
+        /* Perform plant analysis */
+        ret = plant_analysis_process_reading(
+            dev_info->serial_number,
+            dev_info->plant_name,
+            dev_info->plant_variety,
+            &slot->reading
+        );
+
+        if (ret < 0) {
+            LOG_ERR("Failed to analyze plant health: %d", ret);
+            k_mem_slab_free(&slot_slab, slot);
+            continue;
+        }
+
+        LOG_INF("Plant health: %d (Confidence: %u%%)",
+               slot->reading.health, slot->reading.confidence);
+
+        /* Adapt the sampling interval to how fast readings change */
+        uint32_t interval_sec = adaptive_sampling_update(plant_analysis_get_sensor_data());
+        scheduler_set_period(interval_sec * 1000U);
+
+        /* Update water analysis with new moisture reading */
+        float soil_moisture = grow_soil_moisture(&slot->reading);
+
+        water_analysis_add_reading(soil_moisture, slot->reading.timestamp);
+
+        /* Analyze water consumption pattern */
+        water_analysis_predict_watering(&water_pattern, soil_moisture, WATERING_THRESHOLD);
+        slot->daily_consumption_rate = water_pattern.daily_consumption_rate;
+        slot->next_watering_timestamp = water_pattern.next_watering_timestamp;
+        slot->prediction_confidence = water_pattern.prediction_confidence;
+
+        /* Save water analysis data */
+        water_analysis_save(dev_info->serial_number);
+
+        /* Hand over to the uplink stage */
+        forward_slot(slot);
+    }
+}
+
+/**
+ * @brief Upload one reading to Firebase
+ *
+ * @param reading Reading to upload
+ * @return 0 on success, negative errno on failure
+ */
+static int upload_reading(const struct grow_reading *reading)
+{
+    uint32_t start = perf_begin();
+    int ret = firebase_send_sensor_data(dev_info->serial_number,
+                                        dev_info->plant_name,
+                                        dev_info->plant_variety,
+                                        reading);
+    perf_end(PERF_UPLINK, start);
+
+    atomic_inc(ret < 0 ? &stat_publish_errors : &stat_published);
+    return ret;
+}
+
+/**
+ * @brief Send the rollups of evicted readings to Firebase, oldest first
+ *
+ * @return 0 when all rollups were sent, negative errno on failure
+ */
+static int send_rollups(void)
+{
+    struct grow_rollup rollup;
+    int sent = 0;
+
+    while (data_cache_peek_rollup(&rollup) == 0) {
+        uint32_t start = perf_begin();
+        int ret = firebase_send_rollup(dev_info->serial_number, &rollup);
+        perf_end(PERF_UPLINK, start);
+
+        atomic_inc(ret < 0 ? &stat_publish_errors : &stat_published);
+        if (ret < 0) {
+            LOG_ERR("Failed to send rollup to Firebase: %d", ret);
+            return ret;
+        }
+
+        data_cache_release_rollup(&rollup);
+        sent++;
+    }
+
+    if (sent > 0) {
+        LOG_INF("Sent %d rollups", sent);
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Send the spooled readings to Firebase, oldest first
+ *
+ * Each uploaded reading is released, a failed upload is retried from
+ * that reading on the next call.
+ *
+ * @return 0 when the spool is drained, negative errno on failure
+ */
+static int send_spooled_readings(void)
+{
+    struct grow_reading reading;
+    int sent = 0;
+    int ret;
+
+    while ((ret = data_cache_read_spooled(&reading)) == 0) {
+        ret = upload_reading(&reading);
+        if (ret < 0) {
+            LOG_ERR("Failed to send spooled data to Firebase: %d", ret);
+            data_cache_rewind_spooled();
+            return ret;
+        }
+
+        data_cache_release_spooled();
+        sent++;
+    }
+
+    if (sent > 0) {
+        LOG_INF("Sent %d spooled readings", sent);
+    }
+
+    return ret == -ENODATA ? 0 : ret;
+}
+
+/**
+ * @brief Send all cached readings to Firebase
+ *
+ * Each uploaded reading is released, a failed upload is retried from
+ * that reading on the next call.
+ */
+static void send_cached_readings(void)
+{
+    struct grow_reading cached_reading;
+    uint32_t id;
+    int sent = 0;
+    int ret;
+
+    /* Rollups and spooled readings are older than the cached ones */
+    if (send_rollups() < 0 || send_spooled_readings() < 0) {
+        return;
+    }
+
+    while (data_cache_peek(&cached_reading, &id) == 0) {
+        ret = upload_reading(&cached_reading);
+        if (ret < 0) {
+            LOG_ERR("Failed to send cached data to Firebase: %d (%d sent)", ret, sent);
+            return;
+        }
+
+        data_cache_release(id);
+        sent++;
+    }
+
+    if (sent > 0) {
+        LOG_INF("Sent %d cached readings", sent);
+    }
+}
+
+/**
+ * @brief Publish an analysed reading, or cache it while offline
+ *
+ * @param slot Slot holding the analysed reading
+ */
+static void publish_slot(struct pipeline_slot *slot)
+{
+    int ret;
+    struct grow_reading *reading = &slot->reading;
+
+    if (!connectivity_is_connected()) {
+        /* Offline - cache the data */
+        LOG_INF("Device offline, caching sensor reading");
+        cache_reading(reading);
+        return;
+    }
+
+    /* First, try to send any cached data */
+    send_cached_readings();
+
+    /* Skip uploads that did not change meaningfully */
+    if (!publish_filter_should_send(reading)) {
+        atomic_inc(&stat_suppressed);
+        return;
+    }
+
+    /* Send current data */
+    reading->suppressed = MIN(publish_filter_suppressed_count(), UINT16_MAX);
+
+    ret = upload_reading(reading);
+
+    if (ret < 0) {
+        LOG_ERR("Failed to send data to Firebase: %d", ret);
+        return;
+    }
+
+    publish_filter_ack(reading);
+
+    /* Send water prediction data if confidence is high enough */
+    if (slot->prediction_confidence > WATER_PREDICTION_MIN_CONFIDENCE) {
+        ret = firebase_send_water_prediction(
+            dev_info->serial_number,
+            slot->daily_consumption_rate,
+            slot->next_watering_timestamp,
+            slot->prediction_confidence
+        );
+
+        if (ret < 0) {
+            LOG_ERR("Failed to send water prediction to Firebase: %d", ret);
+        } else {
+            LOG_INF("Water prediction sent: next watering in %.1f hours",
+                  (slot->next_watering_timestamp - reading->timestamp) / 3600.0f);
+        }
+    }
+}
+
+/**
+ * @brief Uplink stage: publish readings and drain the offline cache
+ *
+ * Runs at the lowest priority so slow TLS handshakes and HTTP requests
+ * never delay sampling.
+ */
+static void uplink_thread(void *p1, void *p2, void *p3)
+{
+    ARG_UNUSED(p1);
+    ARG_UNUSED(p2);
+    ARG_UNUSED(p3);
+
+    struct pipeline_slot *slot;
+    int ret;
+    struct k_poll_event events[] = {
+        K_POLL_EVENT_INITIALIZER(K_POLL_TYPE_MSGQ_DATA_AVAILABLE,
+                                 K_POLL_MODE_NOTIFY_ONLY, &result_msgq),
+        K_POLL_EVENT_INITIALIZER(K_POLL_TYPE_SIGNAL,
+                                 K_POLL_MODE_NOTIFY_ONLY, &connected_signal),
+        K_POLL_EVENT_INITIALIZER(K_POLL_TYPE_SIGNAL,
+                                 K_POLL_MODE_NOTIFY_ONLY, &rollup_signal),
+    };
+
+    while (1) {
+        k_poll(events, ARRAY_SIZE(events), K_FOREVER);
+
+        if (events[1].state == K_POLL_STATE_SIGNALED) {
+            k_poll_signal_reset(&connected_signal);
+            events[1].state = K_POLL_STATE_NOT_READY;
+
+            if (connectivity_is_connected()) {
+                send_cached_readings();
+            }
+        }
+
+        if (events[2].state == K_POLL_STATE_SIGNALED) {
+            k_poll_signal_reset(&rollup_signal);
+            events[2].state = K_POLL_STATE_NOT_READY;
+
+            /* Flash writes stay off the pipeline threads and the work queue */
+            ret = data_cache_sync();
+            if (ret < 0) {
+                LOG_WRN("Failed to save cache rollups: %d", ret);
+            }
+        }
+
+        if (events[0].state == K_POLL_STATE_MSGQ_DATA_AVAILABLE) {
+            events[0].state = K_POLL_STATE_NOT_READY;
+
+            while (k_msgq_get(&result_msgq, &slot, K_NO_WAIT) == 0) {
+                publish_slot(slot);
+                k_mem_slab_free(&slot_slab, slot);
+                boot_stats_mark(BOOT_PHASE_FIRST_UPLINK);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Initialize the sensor pipeline
+ *
+ * @param info Device information shared with the pipeline stages
+ * @return 0 on success, negative errno on failure
+ */
+int pipeline_init(struct device_info *info)
+{
+    if (!info) {
+        return -EINVAL;
+    }
+
+    dev_info = info;
+
+    int ret = publish_filter_init();
+    if (ret < 0) {
+        LOG_ERR("Failed to initialize publish filter: %d", ret);
+        return ret;
+    }
+
+    k_poll_signal_init(&connected_signal);
+    k_poll_signal_init(&rollup_signal);
+    data_cache_set_save_cb(request_rollup_save);
+
+    mem_monitor_register("pipeline", "slots",
+                         PIPELINE_SLOT_COUNT * sizeof(struct pipeline_slot));
+
+    LOG_INF("Sensor pipeline initialized");
+    return 0;
+}
+
+/**
+ * @brief Start the pipeline threads
+ *
+ * @return 0 on success, negative errno on failure
+ */
+int pipeline_start(void)
+{
+    int ret;
+
+    if (!dev_info) {
+        return -EINVAL;
+    }
+
+    /* First deadline is now, so the first sample is taken immediately */
+    ret = scheduler_init(adaptive_sampling_get_interval() * 1000U);
+    if (ret < 0) {
+        LOG_ERR("Failed to initialize sampling scheduler: %d", ret);
+        return ret;
+    }
+
+    k_thread_name_set(sampler_tid, "sampler");
+    k_thread_name_set(analysis_tid, "analysis");
+    k_thread_name_set(uplink_tid, "uplink");
+
+    k_thread_start(uplink_tid);
+    k_thread_start(analysis_tid);
+    k_thread_start(sampler_tid);
+
+    boot_stats_mark(BOOT_PHASE_PIPELINE);
+
+    LOG_INF("Sensor pipeline started");
+    return 0;
+}
+
+/**
+ * @brief Enable plant and water analysis
+ */
+void pipeline_set_analysis_ready(void)
+{
+    atomic_set(&analysis_ready, 1);
+}
+
+/**
+ * @brief Get pipeline counters
+ *
+ * @param stats_out Pointer to store the counters
+ */
+void pipeline_get_stats(struct pipeline_stats *stats_out)
+{
+    if (!stats_out) {
+        return;
+    }
+
+    stats_out->samples = atomic_get(&stat_samples);
+    stats_out->sensor_errors = atomic_get(&stat_sensor_errors);
+    stats_out->dropped = atomic_get(&stat_dropped);
+    stats_out->published = atomic_get(&stat_published);
+    stats_out->publish_errors = atomic_get(&stat_publish_errors);
+    stats_out->suppressed = atomic_get(&stat_suppressed);
+    stats_out->cached = atomic_get(&stat_cached);
+}
+
+/**
+ * @brief Notify the uplink stage that the network is available
+ */
+void pipeline_notify_connected(void)
+{
+    k_poll_signal_raise(&connected_signal, 0);
+}
@@ -0,0 +1,62 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stdint.h>
+
+#include "device_info.h"
+
+/* Pipeline counters since boot */
+struct pipeline_stats {
+    uint32_t samples;        /* Sensor readings taken */
+    uint32_t sensor_errors;  /* Failed sensor reads */
+    uint32_t dropped;        /* Samples dropped because analysis fell behind */
+    uint32_t published;      /* Readings uploaded, including cached ones */
+    uint32_t publish_errors; /* Failed uploads */
+    uint32_t suppressed;     /* Uploads skipped by the publish filter */
+    uint32_t cached;         /* Readings stored in the offline cache */
+};
+
+/**
+ * @brief Initialize the sensor pipeline
+ *
+ * The pipeline is made of three threads connected by message queues:
+ * a high-priority sampler, a medium-priority analysis stage and a
+ * low-priority uplink stage.
+ *
+ * @param info Device information shared with the pipeline stages
+ * @return 0 on success, negative errno on failure
+ */
+int pipeline_init(struct device_info *info);
+
+/**
+ * @brief Start the pipeline threads
+ *
+ * @return 0 on success, negative errno on failure
+ */
+int pipeline_start(void);
+
+/**
+ * @brief Enable plant and water analysis
+ *
+ * Until this is called the analysis stage forwards readings unanalysed,
+ * so sampling and caching start before TFLite and the analysis history
+ * are loaded.
+ */
+void pipeline_set_analysis_ready(void);
+
+/**
+ * @brief Get pipeline counters
+ *
+ * @param stats_out Pointer to store the counters
+ */
+void pipeline_get_stats(struct pipeline_stats *stats_out);
+
+/**
+ * @brief Notify the uplink stage that the network is available
+ *
+ * Wakes the uplink thread so cached readings are sent without waiting
+ * for the next sample.
+ */
+void pipeline_notify_connected(void);
+
+#endif /* PIPELINE_H */
@@ -6,8 +6,11 @@
 #include <zephyr/data/json.h>
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 #include "../../firebase.h"
+#include "../../perf.h"
+#include "../../mem_monitor.h"
 
 LOG_MODULE_REGISTER(firebase, CONFIG_LOG_DEFAULT_LEVEL);
 
@@ -48,63 +51,73 @@ int firebase_init(void)
     /* Firebase initialization is basically establishing HTTP comm */
     /* Real initialization will happen during first data transmission */
     
+    mem_monitor_register("firebase", "payload_buf", sizeof(payload_buf));
+    mem_monitor_register("firebase", "response_buf", sizeof(response_buf));
+    mem_monitor_register("firebase", "header_buf", sizeof(header_buf));
+    
     return 0;
 }
 
+/* Fixed-point value formatting */
+#define CENTI_FMT "%s%u.%02u"
+#define CENTI_ARGS(value) ((value) < 0 ? "-" : ""), \
+    (unsigned int)(abs(value) / GROW_CENTI_SCALE), (unsigned int)(abs(value) % GROW_CENTI_SCALE)
+#define DECI_FMT "%u.%01u"
+#define DECI_ARGS(value) (unsigned int)((value) / GROW_DECI_SCALE), \
+    (unsigned int)((value) % GROW_DECI_SCALE)
+
 /**
  * @brief Create JSON payload for sensor data
  *
  * @param payload Buffer to store payload
  * @param payload_size Size of payload buffer
- * @param soil_moisture Soil moisture value
- * @param light_level Light level value
- * @param temperature Temperature value
- * @param humidity Humidity value
- * @param air_movement Air movement value
- * @param timestamp Timestamp of reading
  * @param plant_name Plant name
  * @param plant_variety Plant variety
- * @param health_status Plant health status
- * @param env_mismatch Environmental mismatch flags
- * @param recommendation Recommendations
- * @param plant_status Plant status string
+ * @param reading Reading to encode
  * @return Length of payload on success, negative errno on failure
  */
 static int create_sensor_data_payload(char *payload, size_t payload_size,
-                                    float soil_moisture,
-                                    float light_level,
-                                    float temperature,
-                                    float humidity,
-                                    float air_movement,
-                                    int64_t timestamp,
                                     const char *plant_name,
                                     const char *plant_variety,
-                                    int health_status,
-                                    const char *env_mismatch,
-                                    const char *recommendation,
-                                    const char *plant_status)
+                                    const struct grow_reading *reading)
 {
+    char env_mismatch[32];
+    char plant_status[32];
+    char recommendation[128];
+
+    grow_format_mismatch(reading->mismatch, env_mismatch, sizeof(env_mismatch));
+    grow_format_status(reading->health, reading->mismatch, plant_status, sizeof(plant_status));
+    grow_format_recommendation(reading->health, reading->mismatch,
+                               recommendation, sizeof(recommendation));
+
     /* Create JSON payload according to Firestore API format */
     int len = snprintf(payload, payload_size,
                      "{"
                      "\"fields\": {"
-                     "\"soilMoisture\": {\"doubleValue\": %.2f},"
-                     "\"lightLevel\": {\"doubleValue\": %.2f},"
-                     "\"temperature\": {\"doubleValue\": %.2f},"
-                     "\"humidity\": {\"doubleValue\": %.2f},"
-                     "\"airMovement\": {\"doubleValue\": %.2f},"
+                     "\"soilMoisture\": {\"doubleValue\": " CENTI_FMT "},"
+                     "\"lightLevel\": {\"doubleValue\": " CENTI_FMT "},"
+                     "\"temperature\": {\"doubleValue\": " CENTI_FMT "},"
+                     "\"humidity\": {\"doubleValue\": " CENTI_FMT "},"
+                     "\"airMovement\": {\"doubleValue\": " DECI_FMT "},"
                      "\"timestamp\": {\"integerValue\": \"%lld\"},"
                      "\"plantName\": {\"stringValue\": \"%s\"},"
                      "\"plantVariety\": {\"stringValue\": \"%s\"},"
                      "\"healthStatus\": {\"integerValue\": \"%d\"},"
                      "\"environmentalMismatch\": {\"stringValue\": \"%s\"},"
                      "\"recommendation\": {\"stringValue\": \"%s\"},"
-                     "\"plantStatus\": {\"stringValue\": \"%s\"}"
+                     "\"plantStatus\": {\"stringValue\": \"%s\"},"
+                     "\"suppressedCount\": {\"integerValue\": \"%u\"}"
                      "}"
                      "}",
-                     soil_moisture, light_level, temperature, humidity,
-                     air_movement, (long long)timestamp, plant_name, plant_variety,
-                     health_status, env_mismatch, recommendation, plant_status);
+                     CENTI_ARGS(reading->soil_moisture),
+                     CENTI_ARGS(reading->light_level),
+                     CENTI_ARGS(reading->temperature),
+                     CENTI_ARGS(reading->humidity),
+                     DECI_ARGS(reading->air_movement),
+                     (long long)reading->timestamp, plant_name, plant_variety,
+                     reading->health == GROW_HEALTH_UNKNOWN ? -1 : reading->health,
+                     env_mismatch, recommendation, plant_status,
+                     (unsigned int)reading->suppressed);
                      
     if (len < 0 || len >= payload_size) {
         LOG_ERR("Payload buffer too small");
@@ -114,51 +127,88 @@ static int create_sensor_data_payload(char *payload, size_t payload_size,
     return len;
 }
 
+/* Mean, minimum and maximum of a rollup channel */
+#define ROLLUP_FMT(name, fmt) \
+    "\"" name "Mean\": {\"doubleValue\": " fmt "}," \
+    "\"" name "Min\": {\"doubleValue\": " fmt "}," \
+    "\"" name "Max\": {\"doubleValue\": " fmt "},"
+#define ROLLUP_ARGS(rollup, channel, args) \
+    args(grow_rollup_mean(rollup, channel)), \
+    args((rollup)->min[channel]), \
+    args((rollup)->max[channel])
+
 /**
- * @brief Send sensor data to Firebase
+ * @brief Create JSON payload for a rollup
  *
- * @param serial_number Device serial number
- * @param soil_moisture Soil moisture value (0-100%)
- * @param light_level Light level value (0-100%)
- * @param temperature Temperature value (°C)
- * @param humidity Humidity value (0-100%)
- * @param air_movement Air movement value
- * @param timestamp Timestamp of reading
- * @param plant_name Plant name
- * @param plant_variety Plant variety
- * @param health_status Plant health status
- * @param env_mismatch Environmental mismatch flags
- * @param recommendation Recommendations
- * @param plant_status Plant status string
+ * The plant name and variety are left to the plant document.
+ *
+ * @param payload Buffer to store payload
+ * @param payload_size Size of payload buffer
+ * @param rollup Rollup to encode
+ * @return Length of payload on success, negative errno on failure
+ */
+static int create_rollup_payload(char *payload, size_t payload_size,
+                                 const struct grow_rollup *rollup)
+{
+    char env_mismatch[32];
+
+    grow_format_mismatch(rollup->mismatch, env_mismatch, sizeof(env_mismatch));
+
+    int len = snprintf(payload, payload_size,
+                     "{"
+                     "\"fields\": {"
+                     ROLLUP_FMT("soilMoisture", CENTI_FMT)
+                     ROLLUP_FMT("lightLevel", CENTI_FMT)
+                     ROLLUP_FMT("temperature", CENTI_FMT)
+                     ROLLUP_FMT("humidity", CENTI_FMT)
+                     ROLLUP_FMT("airMovement", DECI_FMT)
+                     "\"timestamp\": {\"integerValue\": \"%lld\"},"
+                     "\"period\": {\"integerValue\": \"%u\"},"
+                     "\"count\": {\"integerValue\": \"%u\"},"
+                     "\"healthStatus\": {\"integerValue\": \"%d\"},"
+                     "\"environmentalMismatch\": {\"stringValue\": \"%s\"}"
+                     "}"
+                     "}",
+                     ROLLUP_ARGS(rollup, GROW_CHANNEL_SOIL_MOISTURE, CENTI_ARGS),
+                     ROLLUP_ARGS(rollup, GROW_CHANNEL_LIGHT_LEVEL, CENTI_ARGS),
+                     ROLLUP_ARGS(rollup, GROW_CHANNEL_TEMPERATURE, CENTI_ARGS),
+                     ROLLUP_ARGS(rollup, GROW_CHANNEL_HUMIDITY, CENTI_ARGS),
+                     ROLLUP_ARGS(rollup, GROW_CHANNEL_AIR_MOVEMENT, DECI_ARGS),
+                     (long long)rollup->start, (unsigned int)rollup->period,
+                     (unsigned int)rollup->count,
+                     rollup->health == GROW_HEALTH_UNKNOWN ? -1 : rollup->health,
+                     env_mismatch);
+
+    if (len < 0 || len >= payload_size) {
+        LOG_ERR("Payload buffer too small");
+        return -ENOMEM;
+    }
+
+    return len;
+}
+
+/**
+ * @brief Write a document with an HTTP PATCH request
+ *
+ * @param url Document path
+ * @param payload JSON payload
+ * @param payload_len Payload length
  * @return 0 on success, negative errno on failure
  */
-int firebase_send_sensor_data(const char *serial_number,
-                             float soil_moisture,
-                             float light_level,
-                             float temperature,
-                             float humidity,
-                             float air_movement,
-                             int64_t timestamp,
-                             const char *plant_name,
-                             const char *plant_variety,
-                             int health_status,
-                             const char *env_mismatch,
-                             const char *recommendation,
-                             const char *plant_status)
+static int patch_document(const char *url, const uint8_t *payload, size_t payload_len)
 {
     int ret;
+    uint32_t start;
     struct sockaddr_in addr;
     struct zsock_addrinfo *addrinfo, hints = {
         .ai_family = AF_INET,
         .ai_socktype = SOCK_STREAM
     };
-    int payload_len;
-    char url[128];
-    
-    LOG_INF("Sending sensor data to Firebase");
     
     /* Resolve Firebase host */
+    start = perf_begin();
     ret = zsock_getaddrinfo(FIREBASE_HOST, NULL, &hints, &addrinfo);
+    perf_end(PERF_DNS, start);
     if (ret < 0) {
         LOG_ERR("Failed to resolve Firebase host: %d", ret);
         return ret;
@@ -179,30 +229,15 @@ int firebase_send_sensor_data(const char *serial_number,
     zsock_freeaddrinfo(addrinfo);
     
     /* Connect to Firebase */
+    start = perf_begin();
     ret = zsock_connect(sock, (struct sockaddr *)&addr, sizeof(addr));
+    perf_end(PERF_TCP_CONNECT, start);
     if (ret < 0) {
         LOG_ERR("Failed to connect to Firebase: %d", errno);
         zsock_close(sock);
         return -errno;
     }
     
-    /* Create URL for the document */
-    snprintf(url, sizeof(url),
-            "/v1/projects/%s/databases/(default)/documents/plants/%s",
-            FIREBASE_PROJECT_ID, serial_number);
-    
-    /* Create JSON payload for sensor data */
-    payload_len = create_sensor_data_payload((char *)payload_buf, sizeof(payload_buf),
-                                           soil_moisture, light_level,
-                                           temperature, humidity, air_movement,
-                                           timestamp, plant_name, plant_variety,
-                                           health_status, env_mismatch, recommendation, 
-                                           plant_status);
-    if (payload_len < 0) {
-        zsock_close(sock);
-        return payload_len;
-    }
-    
     /* Setup HTTP request */
     memset(&req, 0, sizeof(req));
     memset(&rsp, 0, sizeof(rsp));
@@ -211,7 +246,7 @@ int firebase_send_sensor_data(const char *serial_number,
     req.url = url;
     req.host = FIREBASE_HOST;
     req.protocol = "https";
-    req.payload = payload_buf;
+    req.payload = payload;
     req.payload_len = payload_len;
     req.content_type_value = "application/json";
     
@@ -221,7 +256,9 @@ int firebase_send_sensor_data(const char *serial_number,
     rsp.header_buf_len = sizeof(header_buf);
     
     /* Send HTTP request */
+    start = perf_begin();
     ret = http_client_req(sock, &req, 5000, &rsp);
+    perf_end(PERF_HTTP_REQUEST, start);
     
     zsock_close(sock);
     
@@ -236,11 +273,94 @@ int firebase_send_sensor_data(const char *serial_number,
         return -EIO;
     }
     
+    return 0;
+}
+
+/**
+ * @brief Send sensor data to Firebase
+ *
+ * @param serial_number Device serial number
+ * @param plant_name Plant name
+ * @param plant_variety Plant variety
+ * @param reading Reading to upload
+ * @return 0 on success, negative errno on failure
+ */
+int firebase_send_sensor_data(const char *serial_number,
+                             const char *plant_name,
+                             const char *plant_variety,
+                             const struct grow_reading *reading)
+{
+    int ret;
+    int payload_len;
+    char url[128];
+    
+    if (!reading) {
+        return -EINVAL;
+    }
+    
+    LOG_INF("Sending sensor data to Firebase");
+    
+    /* Create URL for the document */
+    snprintf(url, sizeof(url),
+            "/v1/projects/%s/databases/(default)/documents/plants/%s",
+            FIREBASE_PROJECT_ID, serial_number);
+    
+    /* Create JSON payload for sensor data */
+    payload_len = create_sensor_data_payload((char *)payload_buf, sizeof(payload_buf),
+                                           plant_name, plant_variety, reading);
+    if (payload_len < 0) {
+        return payload_len;
+    }
+    
+    ret = patch_document(url, payload_buf, payload_len);
+    if (ret < 0) {
+        return ret;
+    }
+    
     LOG_INF("Sensor data sent to Firebase successfully");
     
     return 0;
 }
 
+/**
+ * @brief Send a rollup of readings to Firebase
+ *
+ * @param serial_number Device serial number
+ * @param rollup Rollup to upload
+ * @return 0 on success, negative errno on failure
+ */
+int firebase_send_rollup(const char *serial_number, const struct grow_rollup *rollup)
+{
+    int ret;
+    int payload_len;
+    char url[160];
+    
+    if (!rollup) {
+        return -EINVAL;
+    }
+    
+    LOG_INF("Sending rollup to Firebase");
+    
+    /* One document per period, a retried upload overwrites it */
+    snprintf(url, sizeof(url),
+            "/v1/projects/%s/databases/(default)/documents/plants/%s/rollups/%lld-%u",
+            FIREBASE_PROJECT_ID, serial_number, (long long)rollup->start, rollup->period);
+    
+    payload_len = create_rollup_payload((char *)payload_buf, sizeof(payload_buf), rollup);
+    if (payload_len < 0) {
+        return payload_len;
+    }
+    
+    ret = patch_document(url, payload_buf, payload_len);
+    if (ret < 0) {
+        return ret;
+    }
+    
+    LOG_INF("Rollup sent to Firebase successfully");
+    
+    return 0;
+}
+
 /**
  * @brief Send water prediction data to Firebase
  *
@@ -256,11 +376,6 @@ int firebase_send_water_prediction(const char *serial_number,
                                  float prediction_confidence)
 {
     int ret;
-    struct sockaddr_in addr;
-    struct zsock_addrinfo *addrinfo, hints = {
-        .ai_family = AF_INET,
-        .ai_socktype = SOCK_STREAM
-    };
     char payload[256];
     char url[128];
     
@@ -284,69 +399,12 @@ int firebase_send_water_prediction(const char *serial_number,
             "/v1/projects/%s/databases/(default)/documents/plants/%s/waterPrediction/current",
             FIREBASE_PROJECT_ID, serial_number);
     
-    /* Resolve Firebase host */
-    ret = zsock_getaddrinfo(FIREBASE_HOST, NULL, &hints, &addrinfo);
+    ret = patch_document(url, (const uint8_t *)payload, strlen(payload));
     if (ret < 0) {
-        LOG_ERR("Failed to resolve Firebase host: %d", ret);
         return ret;
     }
     
-    /* Create socket */
-    sock = zsock_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
-    if (sock < 0) {
-        LOG_ERR("Failed to create socket: %d", errno);
-        zsock_freeaddrinfo(addrinfo);
-        return -errno;
-    }
-    
-    /* Setup address */
-    memcpy(&addr, addrinfo->ai_addr, sizeof(addr));
-    addr.sin_port = htons(FIREBASE_PORT);
-    
-    zsock_freeaddrinfo(addrinfo);
-    
-    /* Connect to Firebase */
-    ret = zsock_connect(sock, (struct sockaddr *)&addr, sizeof(addr));
-    if (ret < 0) {
-        LOG_ERR("Failed to connect to Firebase: %d", errno);
-        zsock_close(sock);
-        return -errno;
-    }
-    
-    /* Setup HTTP request */
-    memset(&req, 0, sizeof(req));
-    memset(&rsp, 0, sizeof(rsp));
-    
-    req.method = HTTP_PATCH;
-    req.url = url;
-    req.host = FIREBASE_HOST;
-    req.protocol = "https";
-    req.payload = payload;
-    req.payload_len = strlen(payload);
-    req.content_type_value = "application/json";
-    
-    rsp.data = response_buf;
-    rsp.data_len = sizeof(response_buf);
-    rsp.header_buf = header_buf;
-    rsp.header_buf_len = sizeof(header_buf);
-    
-    /* Send HTTP request */
-    ret = http_client_req(sock, &req, 5000, &rsp);
-    
-    zsock_close(sock);
-    
-    if (ret < 0) {
-        LOG_ERR("Failed to send HTTP request: %d", ret);
-        return ret;
-    }
-    
-    if (rsp.status_code != 200 && rsp.status_code != 201) {
-        LOG_ERR("Firebase request failed with status %d", rsp.status_code);
-        LOG_ERR("Response: %s", rsp.data);
-        return -EIO;
-    }
-    
     LOG_INF("Water prediction data sent to Firebase successfully");
     
     return 0;
-}
\ No newline at end of file
+}
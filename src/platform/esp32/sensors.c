@@ -8,6 +8,7 @@
 #include <string.h>
 
 #include "../../sensors.h"
+#include "../../perf.h"
 
 LOG_MODULE_REGISTER(sensors, CONFIG_LOG_DEFAULT_LEVEL);
 
@@ -246,46 +247,61 @@ static int read_temp_humidity(float *temperature_out, float *humidity_out)
 /**
  * @brief Read all sensor values
  *
- * @param soil_moisture_out Pointer to store soil moisture value (0-100%)
- * @param light_level_out Pointer to store light level value (0-100%)
- * @param temperature_out Pointer to store temperature value (°C)
- * @param humidity_out Pointer to store humidity value (0-100%)
- * @param air_movement_out Pointer to store air movement value (relative value)
+ * @param reading_out Reading to fill with the sensor values and timestamp
  * @return 0 on success, negative errno on failure
  */
-int sensors_read(float *soil_moisture_out, float *light_level_out,
-                float *temperature_out, float *humidity_out,
-                float *air_movement_out)
+int sensors_read(struct grow_reading *reading_out)
 {
     int ret;
+    float soil_moisture, light_level, temperature, humidity, air_movement;
+    uint32_t start;
+    
+    if (!reading_out) {
+        return -EINVAL;
+    }
     
     /* Read soil moisture */
-    ret = read_soil_moisture(soil_moisture_out);
+    start = perf_begin();
+    ret = read_soil_moisture(&soil_moisture);
+    perf_end(PERF_ADC_SOIL, start);
     if (ret < 0) {
         LOG_ERR("Failed to read soil moisture: %d", ret);
         return ret;
     }
     
     /* Read light level */
-    ret = read_light_level(light_level_out);
+    start = perf_begin();
+    ret = read_light_level(&light_level);
+    perf_end(PERF_ADC_LIGHT, start);
     if (ret < 0) {
         LOG_ERR("Failed to read light level: %d", ret);
         return ret;
     }
     
     /* Read air movement */
-    ret = read_air_movement(air_movement_out);
+    start = perf_begin();
+    ret = read_air_movement(&air_movement);
+    perf_end(PERF_ADC_AIR, start);
     if (ret < 0) {
         LOG_ERR("Failed to read air movement: %d", ret);
         return ret;
     }
     
     /* Read temperature and humidity */
-    ret = read_temp_humidity(temperature_out, humidity_out);
+    start = perf_begin();
+    ret = read_temp_humidity(&temperature, &humidity);
+    perf_end(PERF_DHT, start);
     if (ret < 0) {
         LOG_ERR("Failed to read temp and humidity: %d", ret);
         return ret;
     }
     
+    /* Fresh reading, analysis fills in health and mismatch */
+    memset(reading_out, 0, sizeof(*reading_out));
+    grow_reading_set_values(reading_out, soil_moisture, light_level,
+                            temperature, humidity, air_movement);
+    reading_out->timestamp = k_uptime_get() / 1000;
+    reading_out->health = GROW_HEALTH_UNKNOWN;
+    
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,137 @@
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/net/net_if.h>
+#include <zephyr/net/net_core.h>
+#include <zephyr/net/net_mgmt.h>
+
+#include "../../connectivity.h"
+
+LOG_MODULE_REGISTER(connectivity, CONFIG_LOG_DEFAULT_LEVEL);
+
+/* Network status */
+static bool is_connected;
+static struct net_if *iface;
+static struct net_mgmt_event_callback if_cb;
+
+/**
+ * @brief Report a connection state change once
+ */
+static void set_connected(bool connected)
+{
+    if (is_connected == connected) {
+        return;
+    }
+
+    is_connected = connected;
+    LOG_INF("Host network %s", connected ? "up" : "down");
+
+    /* Call connection callback */
+    connectivity_status_callback(connected);
+}
+
+/**
+ * @brief Interface management event handler
+ */
+static void if_mgmt_event_handler(struct net_mgmt_event_callback *cb,
+                                  uint32_t mgmt_event, struct net_if *event_iface)
+{
+    if (event_iface != iface) {
+        return;
+    }
+
+    switch (mgmt_event) {
+    case NET_EVENT_IF_UP:
+        set_connected(true);
+        break;
+
+    case NET_EVENT_IF_DOWN:
+        set_connected(false);
+        break;
+
+    default:
+        break;
+    }
+}
+
+/**
+ * @brief Initialize connectivity subsystem
+ *
+ * Uses the default interface, which is the host socket offload
+ * interface (or the TAP interface) of native_sim.
+ *
+ * @return 0 on success, negative errno on failure
+ */
+int connectivity_init(void)
+{
+    iface = net_if_get_default();
+    if (!iface) {
+        LOG_ERR("No network interface found");
+        return -ENODEV;
+    }
+
+    /* Register event handler */
+    net_mgmt_init_event_callback(&if_cb, if_mgmt_event_handler,
+                                 NET_EVENT_IF_UP | NET_EVENT_IF_DOWN);
+    net_mgmt_add_event_callback(&if_cb);
+
+    LOG_INF("Connectivity initialized");
+    return 0;
+}
+
+/**
+ * @brief Connect to network
+ *
+ * @return 0 on success, negative errno on failure
+ */
+int connectivity_connect(void)
+{
+    int ret;
+
+    ret = net_if_up(iface);
+    if (ret < 0 && ret != -EALREADY) {
+        LOG_ERR("Failed to bring up interface: %d", ret);
+        return ret;
+    }
+
+    /* The host network needs no association, report it right away */
+    if (net_if_is_up(iface)) {
+        set_connected(true);
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Disconnect from network
+ *
+ * @return 0 on success, negative errno on failure
+ */
+int connectivity_disconnect(void)
+{
+    int ret;
+
+    if (!is_connected) {
+        return 0;
+    }
+
+    /* Taking the interface down simulates an outage */
+    ret = net_if_down(iface);
+    if (ret < 0 && ret != -EALREADY) {
+        LOG_ERR("Failed to bring down interface: %d", ret);
+        return ret;
+    }
+
+    set_connected(false);
+
+    return 0;
+}
+
+/**
+ * @brief Check if connected to network
+ *
+ * @return true if connected, false otherwise
+ */
+bool connectivity_is_connected(void)
+{
+    return is_connected;
+}
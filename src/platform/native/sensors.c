@@ -0,0 +1,133 @@
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <math.h>
+#include <string.h>
+
+#include "../../sensors.h"
+#include "../../perf.h"
+
+LOG_MODULE_REGISTER(sensors, CONFIG_LOG_DEFAULT_LEVEL);
+
+/* Simulated conversion times, charged to the simulated clock */
+#define SIM_ADC_CONVERSION_US 20
+#define SIM_DHT_READ_US 4000  /* DHT22 start pulse and 40 bit transfer */
+
+/* Scripted environment */
+#define SIM_SECONDS_PER_DAY 86400
+#define SIM_START_OF_DAY_SEC (6 * 3600)  /* Boot at 06:00 */
+#define SIM_PI 3.14159265f
+
+#define SIM_MOISTURE_WATERED 70.0f  /* Soil moisture right after watering */
+#define SIM_MOISTURE_DRY 25.0f      /* Soil moisture at the next watering */
+#define SIM_LIGHT_PEAK 80.0f
+#define SIM_TEMPERATURE_MEAN 22.0f
+#define SIM_TEMPERATURE_SWING 4.0f
+#define SIM_HUMIDITY_MEAN 55.0f
+#define SIM_HUMIDITY_SWING 10.0f
+#define SIM_AIR_MEAN 2.0f
+
+#define SIM_WATERING_INTERVAL_SEC (CONFIG_GROW_SIM_WATERING_INTERVAL_HOURS * 3600)
+
+/* Noise generator state (xorshift32) */
+static uint32_t noise_state;
+
+/**
+ * @brief Get uniform noise in [-amplitude, amplitude]
+ */
+static float sim_noise(float amplitude)
+{
+    noise_state ^= noise_state << 13;
+    noise_state ^= noise_state >> 17;
+    noise_state ^= noise_state << 5;
+
+    return amplitude * ((float)noise_state / (float)UINT32_MAX * 2.0f - 1.0f);
+}
+
+/**
+ * @brief Clamp a simulated value to a percentage
+ */
+static float sim_percent(float value)
+{
+    return CLAMP(value, 0.0f, 100.0f);
+}
+
+/**
+ * @brief Initialize sensors
+ *
+ * @return 0 on success, negative errno on failure
+ */
+int sensors_init(void)
+{
+    noise_state = CONFIG_GROW_SIM_SEED;
+
+    LOG_INF("Simulated sensors initialized (watering every %d h, seed %d)",
+           CONFIG_GROW_SIM_WATERING_INTERVAL_HOURS, CONFIG_GROW_SIM_SEED);
+
+    return 0;
+}
+
+/**
+ * @brief Read all sensor values
+ *
+ * Values follow a scripted day: light and temperature follow the sun,
+ * humidity moves against the temperature, and soil moisture dries out
+ * until the next watering.
+ *
+ * @param reading_out Reading to fill with the sensor values and timestamp
+ * @return 0 on success, negative errno on failure
+ */
+int sensors_read(struct grow_reading *reading_out)
+{
+    float soil_moisture, light_level, temperature, humidity, air_movement;
+    uint32_t start;
+    int64_t now;
+
+    if (!reading_out) {
+        return -EINVAL;
+    }
+
+    now = k_uptime_get() / 1000;
+
+    float day = (float)((now + SIM_START_OF_DAY_SEC) % SIM_SECONDS_PER_DAY) /
+                SIM_SECONDS_PER_DAY;
+    float sun = sinf(2.0f * SIM_PI * (day - 0.25f));
+    float warmth = sinf(2.0f * SIM_PI * (day - 0.375f));
+    float dried = (float)(now % SIM_WATERING_INTERVAL_SEC) / SIM_WATERING_INTERVAL_SEC;
+
+    /* Read soil moisture */
+    start = perf_begin();
+    k_busy_wait(SIM_ADC_CONVERSION_US);
+    soil_moisture = sim_percent(SIM_MOISTURE_WATERED -
+                                (SIM_MOISTURE_WATERED - SIM_MOISTURE_DRY) * dried +
+                                sim_noise(0.2f));
+    perf_end(PERF_ADC_SOIL, start);
+
+    /* Read light level */
+    start = perf_begin();
+    k_busy_wait(SIM_ADC_CONVERSION_US);
+    light_level = sim_percent(SIM_LIGHT_PEAK * MAX(sun, 0.0f) + sim_noise(0.5f));
+    perf_end(PERF_ADC_LIGHT, start);
+
+    /* Read air movement */
+    start = perf_begin();
+    k_busy_wait(SIM_ADC_CONVERSION_US);
+    air_movement = MAX(SIM_AIR_MEAN + sim_noise(1.0f), 0.0f);
+    perf_end(PERF_ADC_AIR, start);
+
+    /* Read temperature and humidity */
+    start = perf_begin();
+    k_busy_wait(SIM_DHT_READ_US);
+    temperature = SIM_TEMPERATURE_MEAN + SIM_TEMPERATURE_SWING * warmth + sim_noise(0.1f);
+    humidity = sim_percent(SIM_HUMIDITY_MEAN - SIM_HUMIDITY_SWING * warmth +
+                           sim_noise(0.5f));
+    perf_end(PERF_DHT, start);
+
+    /* Fresh reading, analysis fills in health and mismatch */
+    memset(reading_out, 0, sizeof(*reading_out));
+    grow_reading_set_values(reading_out, soil_moisture, light_level,
+                            temperature, humidity, air_movement);
+    reading_out->timestamp = now;
+    reading_out->health = GROW_HEALTH_UNKNOWN;
+
+    return 0;
+}
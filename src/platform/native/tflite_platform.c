@@ -0,0 +1,286 @@
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/fs/fs.h>
+#include <string.h>
+#include <new>
+
+#include "../../tflite_interface.h"
+#include "../../mem_monitor.h"
+
+/* TensorFlow Lite Micro headers */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "tensorflow/lite/micro/all_ops_resolver.h"
+#include "tensorflow/lite/micro/micro_interpreter.h"
+#include "tensorflow/lite/micro/micro_log.h"
+#include "tensorflow/lite/micro/micro_mutable_op_resolver.h"
+#include "tensorflow/lite/micro/recording_micro_interpreter.h"
+#include "tensorflow/lite/micro/system_setup.h"
+#include "tensorflow/lite/schema/schema_generated.h"
+
+#ifdef __cplusplus
+}
+#endif
+
+#if defined(CONFIG_GROW_MODEL_EMBED)
+/* Generated from the linked model by scripts/gen_op_resolver.py */
+#include "tflite_model_ops.h"
+#endif
+
+LOG_MODULE_REGISTER(tflite_native, CONFIG_LOG_DEFAULT_LEVEL);
+
+/* Static TF Lite objects */
+namespace {
+  const tflite::Model* model = nullptr;
+  tflite::MicroInterpreter* interpreter = nullptr;
+#if defined(CONFIG_GROW_MODEL_EMBED)
+  tflite::MicroMutableOpResolver<TFLITE_MODEL_OP_COUNT> op_resolver;
+#else
+  tflite::MicroMutableOpResolver<10> op_resolver;
+#endif
+
+  /* Create an area of memory for input, output, and intermediate arrays */
+  constexpr int kTensorArenaSize = CONFIG_GROW_TFLITE_ARENA_SIZE;
+  alignas(16) static uint8_t tensor_arena[kTensorArenaSize];
+
+  /* The interpreter is built in place, so it is accounted for with the arena */
+#if defined(CONFIG_GROW_TFLITE_ARENA_RECORD)
+  using Interpreter = tflite::RecordingMicroInterpreter;
+#else
+  using Interpreter = tflite::MicroInterpreter;
+#endif
+  alignas(Interpreter) static uint8_t interpreter_buf[sizeof(Interpreter)];
+} // namespace
+
+#if !defined(CONFIG_GROW_MODEL_EMBED)
+/* Path to model file on the simulated flash (littlefs on tflite_partition) */
+#define MODEL_PATH "/tflite/" TFLITE_MODEL_FILE
+#define MODEL_SIZE (32 * 1024) /* Maximum expected model size */
+
+/* Buffer for model loading */
+static uint8_t model_data[MODEL_SIZE];
+#endif
+
+/**
+ * @brief Initialize TensorFlow Lite
+ * 
+ * @param ctx Pointer to TFLite context
+ * @return 0 on success, negative errno on failure
+ */
+int tflite_init(struct tflite_context *ctx)
+{
+    if (!ctx) {
+        return -EINVAL;
+    }
+    
+    LOG_INF("Initializing TensorFlow Lite for native_sim");
+    
+    /* Setup TFLite micro */
+    tflite::InitializeTarget();
+    
+    mem_monitor_register("tflite", "tensor_arena", kTensorArenaSize);
+    mem_monitor_register("tflite", "interpreter", sizeof(interpreter_buf));
+    
+#if defined(CONFIG_GROW_MODEL_EMBED)
+    /* The model is linked into flash and used in place */
+    LOG_INF("Model linked in flash, size: %u bytes", (unsigned int)tflite_model_size);
+    
+    model = tflite::GetModel(tflite_model_data);
+#else
+    mem_monitor_register("tflite", "model_data", MODEL_SIZE);
+    
+    /* Load the model from flash */
+    struct fs_file_t file;
+    fs_file_t_init(&file);
+    int rc = fs_open(&file, MODEL_PATH, FS_O_READ);
+    if (rc != 0) {
+        LOG_ERR("Failed to open model file: %d", rc);
+        return -EIO;
+    }
+    
+    /* Read model file */
+    ssize_t n = fs_read(&file, model_data, MODEL_SIZE);
+    fs_close(&file);
+    
+    if (n <= 0) {
+        LOG_ERR("Failed to read model file: %zd", n);
+        return -EIO;
+    }
+    
+    LOG_INF("Model loaded, size: %zd bytes", n);
+    
+    /* Map the model into a usable data structure */
+    model = tflite::GetModel(model_data);
+#endif
+    if (model->version() != TFLITE_SCHEMA_VERSION) {
+        LOG_ERR("Model schema version mismatch, expected %d but got %d",
+               TFLITE_SCHEMA_VERSION, model->version());
+        return -EINVAL;
+    }
+    
+#if defined(CONFIG_GROW_MODEL_EMBED)
+    /* Add exactly the operations of the model */
+    TFLITE_MODEL_ADD_OPS(op_resolver);
+#else
+    /* Add required operations to the resolver */
+    op_resolver.AddFullyConnected();
+    op_resolver.AddRelu();
+    op_resolver.AddReshape();
+    op_resolver.AddSoftmax();
+    op_resolver.AddPad();
+    op_resolver.AddMean();
+    op_resolver.AddConv2D();
+    op_resolver.AddMaxPool2D();
+    op_resolver.AddQuantize();
+    op_resolver.AddDequantize();
+#endif
+    
+    /* Build an interpreter to run the model */
+    interpreter = new (interpreter_buf) Interpreter(
+        model, op_resolver, tensor_arena, kTensorArenaSize);
+    
+    /* Allocate tensors */
+    if (interpreter->AllocateTensors() != kTfLiteOk) {
+        LOG_ERR("Failed to allocate tensors");
+        return -ENOMEM;
+    }
+    
+    /* Report the arena headroom */
+    size_t arena_used = interpreter->arena_used_bytes();
+    size_t headroom = kTensorArenaSize - arena_used;
+    
+    LOG_INF("Tensors allocated, arena used: %u of %u bytes, %u free",
+           (unsigned int)arena_used, (unsigned int)kTensorArenaSize,
+           (unsigned int)headroom);
+    if (headroom * 100 < (size_t)kTensorArenaSize * CONFIG_GROW_TFLITE_ARENA_HEADROOM_PCT) {
+        LOG_WRN("Tensor arena headroom below %d%%", CONFIG_GROW_TFLITE_ARENA_HEADROOM_PCT);
+    }
+    
+#if defined(CONFIG_GROW_TFLITE_ARENA_RECORD)
+    /* Read by scripts/arena_size.py */
+    static_cast<tflite::RecordingMicroInterpreter *>(interpreter)
+        ->GetMicroAllocator().PrintAllocations();
+    printk("tflite arena required: %u bytes\n", (unsigned int)arena_used);
+#endif
+    
+    /* Set up context */
+    ctx->model_data = (void*)model;
+    ctx->interpreter = (void*)interpreter;
+    ctx->tensor_arena = tensor_arena;
+    ctx->arena_size = kTensorArenaSize;
+    ctx->arena_used = arena_used;
+    
+    return 0;
+}
+
+/**
+ * @brief Run inference on input data
+ * 
+ * @param ctx TFLite context
+ * @param input_data Input sensor data array
+ * @param input_size Size of input data array
+ * @param output_data Buffer to store inference results
+ * @param output_size Size of output buffer
+ * @return 0 on success, negative errno on failure
+ */
+int tflite_run_inference(struct tflite_context *ctx, 
+                         const float *input_data, size_t input_size,
+                         float *output_data, size_t output_size)
+{
+    if (!ctx || !input_data || !output_data) {
+        return -EINVAL;
+    }
+    
+    tflite::MicroInterpreter *interpreter = (tflite::MicroInterpreter *)ctx->interpreter;
+    
+    /* Get input tensor */
+    TfLiteTensor *input = interpreter->input(0);
+    
+    /* Check input dimensions */
+    if (input->dims->size != 2 || input->dims->data[1] != input_size) {
+        LOG_ERR("Unexpected input dimensions");
+        return -EINVAL;
+    }
+    
+    /* Copy input data, quantized for an int8 model */
+    switch (input->type) {
+    case kTfLiteFloat32:
+        for (size_t i = 0; i < input_size; i++) {
+            input->data.f[i] = input_data[i];
+        }
+        break;
+    case kTfLiteInt8:
+        for (size_t i = 0; i < input_size; i++) {
+            input->data.int8[i] = tflite_quantize(input_data[i],
+                                                  input->params.scale,
+                                                  input->params.zero_point);
+        }
+        break;
+    default:
+        LOG_ERR("Unsupported input type %d", input->type);
+        return -ENOTSUP;
+    }
+    
+    /* Run inference */
+    if (interpreter->Invoke() != kTfLiteOk) {
+        LOG_ERR("Inference failed");
+        return -EFAULT;
+    }
+    
+    /* Get output tensor */
+    TfLiteTensor *output = interpreter->output(0);
+    
+    /* Check output dimensions */
+    if (output->dims->size != 2 || output->dims->data[1] != output_size) {
+        LOG_ERR("Unexpected output dimensions");
+        return -EINVAL;
+    }
+    
+    /* Copy output data, dequantized for an int8 model */
+    switch (output->type) {
+    case kTfLiteFloat32:
+        for (size_t i = 0; i < output_size; i++) {
+            output_data[i] = output->data.f[i];
+        }
+        break;
+    case kTfLiteInt8:
+        for (size_t i = 0; i < output_size; i++) {
+            output_data[i] = tflite_dequantize(output->data.int8[i],
+                                               output->params.scale,
+                                               output->params.zero_point);
+        }
+        break;
+    default:
+        LOG_ERR("Unsupported output type %d", output->type);
+        return -ENOTSUP;
+    }
+    
+    return 0;
+}
+
+/**
+ * @brief Clean up TensorFlow Lite resources
+ * 
+ * @param ctx TFLite context
+ * @return 0 on success, negative errno on failure
+ */
+int tflite_deinit(struct tflite_context *ctx)
+{
+    if (!ctx) {
+        return -EINVAL;
+    }
+    
+    if (ctx->interpreter) {
+        /* Built in interpreter_buf, only the destructor runs */
+        static_cast<tflite::MicroInterpreter*>(ctx->interpreter)->~MicroInterpreter();
+        ctx->interpreter = nullptr;
+        interpreter = nullptr;
+    }
+    
+    /* No need to delete model as it points to model_data */
+    ctx->model_data = nullptr;
+    
+    return 0;
+}
\ No newline at end of file
@@ -2,8 +2,10 @@
 #include <zephyr/logging/log.h>
 #include <zephyr/fs/fs.h>
 #include <string.h>
+#include <new>
 
 #include "../../tflite_interface.h"
+#include "../../mem_monitor.h"
 
 /* TensorFlow Lite Micro headers */
 #ifdef __cplusplus
@@ -24,26 +26,39 @@ extern "C" {
 }
 #endif
 
+#if defined(CONFIG_GROW_MODEL_EMBED)
+/* Generated from the linked model by scripts/gen_op_resolver.py */
+#include "tflite_model_ops.h"
+#endif
+
 LOG_MODULE_REGISTER(tflite_nrf, CONFIG_LOG_DEFAULT_LEVEL);
 
 /* Static TF Lite objects */
 namespace {
   const tflite::Model* model = nullptr;
   tflite::MicroInterpreter* interpreter = nullptr;
+#if defined(CONFIG_GROW_MODEL_EMBED)
+  tflite::MicroMutableOpResolver<TFLITE_MODEL_OP_COUNT> op_resolver;
+#else
   tflite::MicroMutableOpResolver<10> op_resolver;
+#endif
 
   /* Create an area of memory for input, output, and intermediate arrays */
-  /* Smaller tensor arena size for nRF52840 due to memory constraints */
-  constexpr int kTensorArenaSize = 64 * 1024;
-  static uint8_t tensor_arena[kTensorArenaSize];
+  constexpr int kTensorArenaSize = CONFIG_GROW_TFLITE_ARENA_SIZE;
+  alignas(16) static uint8_t tensor_arena[kTensorArenaSize];
+
+  /* The interpreter is built in place, so it is accounted for with the arena */
+  alignas(tflite::MicroInterpreter) static uint8_t interpreter_buf[sizeof(tflite::MicroInterpreter)];
 } // namespace
 
+#if !defined(CONFIG_GROW_MODEL_EMBED)
 /* Path to model file in flash */
-#define MODEL_PATH "/tflite/plant_health_model.tflite"
+#define MODEL_PATH "/tflite/" TFLITE_MODEL_FILE
 #define MODEL_SIZE (24 * 1024) /* Maximum expected model size */
 
 /* Buffer for model loading */
 static uint8_t model_data[MODEL_SIZE];
+#endif
 
 /**
  * @brief Initialize TensorFlow Lite
@@ -62,6 +77,17 @@ int tflite_init(struct tflite_context *ctx)
     /* Setup TFLite micro */
     tflite::InitializeTarget();
     
+    mem_monitor_register("tflite", "tensor_arena", kTensorArenaSize);
+    mem_monitor_register("tflite", "interpreter", sizeof(interpreter_buf));
+    
+#if defined(CONFIG_GROW_MODEL_EMBED)
+    /* The model is linked into flash and used in place */
+    LOG_INF("Model linked in flash, size: %u bytes", (unsigned int)tflite_model_size);
+    
+    model = tflite::GetModel(tflite_model_data);
+#else
+    mem_monitor_register("tflite", "model_data", MODEL_SIZE);
+    
     /* Load the model from flash */
     struct fs_file_t file;
     fs_file_t_init(&file);
@@ -85,12 +111,17 @@ int tflite_init(struct tflite_context *ctx)
     
     /* Map the model into a usable data structure */
     model = tflite::GetModel(model_data);
+#endif
     if (model->version() != TFLITE_SCHEMA_VERSION) {
         LOG_ERR("Model schema version mismatch, expected %d but got %d",
                TFLITE_SCHEMA_VERSION, model->version());
         return -EINVAL;
     }
     
+#if defined(CONFIG_GROW_MODEL_EMBED)
+    /* Add exactly the operations of the model */
+    TFLITE_MODEL_ADD_OPS(op_resolver);
+#else
     /* Add required operations to the resolver */
     op_resolver.AddFullyConnected();
     op_resolver.AddRelu();
@@ -102,9 +133,10 @@ int tflite_init(struct tflite_context *ctx)
     op_resolver.AddMaxPool2D();
     op_resolver.AddQuantize();
     op_resolver.AddDequantize();
+#endif
     
     /* Build an interpreter to run the model */
-    interpreter = new tflite::MicroInterpreter(
+    interpreter = new (interpreter_buf) tflite::MicroInterpreter(
         model, op_resolver, tensor_arena, kTensorArenaSize);
     
     /* Allocate tensors */
@@ -113,14 +145,23 @@ int tflite_init(struct tflite_context *ctx)
         return -ENOMEM;
     }
     
-    LOG_INF("Tensors allocated, arena used: %d bytes", 
-           interpreter->arena_used_bytes());
+    /* Report the arena headroom */
+    size_t arena_used = interpreter->arena_used_bytes();
+    size_t headroom = kTensorArenaSize - arena_used;
+    
+    LOG_INF("Tensors allocated, arena used: %u of %u bytes, %u free",
+           (unsigned int)arena_used, (unsigned int)kTensorArenaSize,
+           (unsigned int)headroom);
+    if (headroom * 100 < (size_t)kTensorArenaSize * CONFIG_GROW_TFLITE_ARENA_HEADROOM_PCT) {
+        LOG_WRN("Tensor arena headroom below %d%%", CONFIG_GROW_TFLITE_ARENA_HEADROOM_PCT);
+    }
     
     /* Set up context */
     ctx->model_data = (void*)model;
     ctx->interpreter = (void*)interpreter;
     ctx->tensor_arena = tensor_arena;
     ctx->arena_size = kTensorArenaSize;
+    ctx->arena_used = arena_used;
     
     return 0;
 }
@@ -154,9 +195,23 @@ int tflite_run_inference(struct tflite_context *ctx,
         return -EINVAL;
     }
     
-    /* Copy input data */
-    for (size_t i = 0; i < input_size; i++) {
-        input->data.f[i] = input_data[i];
+    /* Copy input data, quantized for an int8 model */
+    switch (input->type) {
+    case kTfLiteFloat32:
+        for (size_t i = 0; i < input_size; i++) {
+            input->data.f[i] = input_data[i];
+        }
+        break;
+    case kTfLiteInt8:
+        for (size_t i = 0; i < input_size; i++) {
+            input->data.int8[i] = tflite_quantize(input_data[i],
+                                                  input->params.scale,
+                                                  input->params.zero_point);
+        }
+        break;
+    default:
+        LOG_ERR("Unsupported input type %d", input->type);
+        return -ENOTSUP;
     }
     
     /* Run inference */
@@ -174,9 +229,23 @@ int tflite_run_inference(struct tflite_context *ctx,
         return -EINVAL;
     }
     
-    /* Copy output data */
-    for (size_t i = 0; i < output_size; i++) {
-        output_data[i] = output->data.f[i];
+    /* Copy output data, dequantized for an int8 model */
+    switch (output->type) {
+    case kTfLiteFloat32:
+        for (size_t i = 0; i < output_size; i++) {
+            output_data[i] = output->data.f[i];
+        }
+        break;
+    case kTfLiteInt8:
+        for (size_t i = 0; i < output_size; i++) {
+            output_data[i] = tflite_dequantize(output->data.int8[i],
+                                               output->params.scale,
+                                               output->params.zero_point);
+        }
+        break;
+    default:
+        LOG_ERR("Unsupported output type %d", output->type);
+        return -ENOTSUP;
     }
     
     return 0;
@@ -195,8 +264,10 @@ int tflite_deinit(struct tflite_context *ctx)
     }
     
     if (ctx->interpreter) {
-        delete static_cast<tflite::MicroInterpreter*>(ctx->interpreter);
+        /* Built in interpreter_buf, only the destructor runs */
+        static_cast<tflite::MicroInterpreter*>(ctx->interpreter)->~MicroInterpreter();
         ctx->interpreter = nullptr;
+        interpreter = nullptr;
     }
     
     /* No need to delete model as it points to model_data */
@@ -0,0 +1,220 @@
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <math.h>
+
+#include "publish_filter.h"
+
+LOG_MODULE_REGISTER(publish_filter, CONFIG_LOG_DEFAULT_LEVEL);
+
+/* Deadbands, Kconfig values are in hundredths of the channel unit */
+static float deadbands[PUBLISH_FIELD_COUNT];
+
+/* Health status changes that force an upload */
+static enum publish_health_mode health_mode;
+
+/* Last acknowledged reading */
+static struct grow_reading acked;
+static bool have_acked = false;
+
+/* Readings suppressed since the last acknowledged upload */
+static uint32_t suppressed_count = 0;
+
+/* Protects filter state shared with runtime tuning */
+K_MUTEX_DEFINE(filter_lock);
+
+/**
+ * @brief Get a channel value of a reading
+ */
+static float field_value(const struct grow_reading *reading, enum publish_field field)
+{
+    switch (field) {
+    case PUBLISH_FIELD_SOIL_MOISTURE:
+        return grow_soil_moisture(reading);
+    case PUBLISH_FIELD_LIGHT_LEVEL:
+        return grow_light_level(reading);
+    case PUBLISH_FIELD_TEMPERATURE:
+        return grow_temperature(reading);
+    case PUBLISH_FIELD_HUMIDITY:
+        return grow_humidity(reading);
+    case PUBLISH_FIELD_AIR_MOVEMENT:
+        return grow_air_movement(reading);
+    default:
+        return 0.0f;
+    }
+}
+
+/**
+ * @brief Check whether a health status change forces an upload
+ */
+static bool health_changed(uint8_t health, uint8_t acked_health)
+{
+    if (health == acked_health) {
+        return false;
+    }
+
+    if (health_mode == PUBLISH_HEALTH_ANY ||
+        health == GROW_HEALTH_UNKNOWN || acked_health == GROW_HEALTH_UNKNOWN) {
+        return true;
+    }
+
+    /* Known statuses are ordered from healthy to critical */
+    return health > acked_health;
+}
+
+/**
+ * @brief Initialize publish filter
+ *
+ * @return 0 on success, negative errno on failure
+ */
+int publish_filter_init(void)
+{
+    k_mutex_lock(&filter_lock, K_FOREVER);
+
+    deadbands[PUBLISH_FIELD_SOIL_MOISTURE] = CONFIG_GROW_DEADBAND_SOIL_MOISTURE / 100.0f;
+    deadbands[PUBLISH_FIELD_LIGHT_LEVEL] = CONFIG_GROW_DEADBAND_LIGHT_LEVEL / 100.0f;
+    deadbands[PUBLISH_FIELD_TEMPERATURE] = CONFIG_GROW_DEADBAND_TEMPERATURE / 100.0f;
+    deadbands[PUBLISH_FIELD_HUMIDITY] = CONFIG_GROW_DEADBAND_HUMIDITY / 100.0f;
+    deadbands[PUBLISH_FIELD_AIR_MOVEMENT] = CONFIG_GROW_DEADBAND_AIR_MOVEMENT / 100.0f;
+    health_mode = IS_ENABLED(CONFIG_GROW_PUBLISH_HEALTH_WORSE) ?
+                  PUBLISH_HEALTH_WORSE : PUBLISH_HEALTH_ANY;
+
+    have_acked = false;
+    suppressed_count = 0;
+
+    k_mutex_unlock(&filter_lock);
+
+    LOG_INF("Publish filter initialized (heartbeat %d s)", CONFIG_GROW_PUBLISH_HEARTBEAT_SEC);
+    return 0;
+}
+
+/**
+ * @brief Decide whether a reading must be uploaded
+ *
+ * @param reading Reading to check
+ * @return true if the reading must be uploaded, false if suppressed
+ */
+bool publish_filter_should_send(const struct grow_reading *reading)
+{
+    bool send = false;
+
+    if (!IS_ENABLED(CONFIG_GROW_PUBLISH_ON_CHANGE)) {
+        return true;
+    }
+
+    k_mutex_lock(&filter_lock, K_FOREVER);
+
+    if (!have_acked) {
+        send = true;
+    } else if (health_changed(reading->health, acked.health)) {
+        send = true;
+    } else if (reading->timestamp - acked.timestamp >= CONFIG_GROW_PUBLISH_HEARTBEAT_SEC) {
+        LOG_DBG("Heartbeat upload");
+        send = true;
+    } else {
+        for (int i = 0; i < PUBLISH_FIELD_COUNT; i++) {
+            if (fabsf(field_value(reading, i) - field_value(&acked, i)) >= deadbands[i]) {
+                send = true;
+                break;
+            }
+        }
+    }
+
+    if (!send) {
+        suppressed_count++;
+        LOG_DBG("Reading suppressed (%u since last upload)", suppressed_count);
+    }
+
+    k_mutex_unlock(&filter_lock);
+
+    return send;
+}
+
+/**
+ * @brief Record a reading as acknowledged by the server
+ *
+ * @param reading Uploaded reading
+ */
+void publish_filter_ack(const struct grow_reading *reading)
+{
+    k_mutex_lock(&filter_lock, K_FOREVER);
+
+    acked = *reading;
+    have_acked = true;
+    suppressed_count = 0;
+
+    k_mutex_unlock(&filter_lock);
+}
+
+/**
+ * @brief Get the number of readings suppressed since the last upload
+ *
+ * @return Suppressed reading count
+ */
+uint32_t publish_filter_suppressed_count(void)
+{
+    return suppressed_count;
+}
+
+/**
+ * @brief Set the deadband of a channel
+ *
+ * @param field Channel to configure
+ * @param deadband Minimum change that triggers an upload
+ * @return 0 on success, negative errno on failure
+ */
+int publish_filter_set_deadband(enum publish_field field, float deadband)
+{
+    if (field < 0 || field >= PUBLISH_FIELD_COUNT || deadband < 0.0f) {
+        return -EINVAL;
+    }
+
+    k_mutex_lock(&filter_lock, K_FOREVER);
+    deadbands[field] = deadband;
+    k_mutex_unlock(&filter_lock);
+
+    return 0;
+}
+
+/**
+ * @brief Get the deadband of a channel
+ *
+ * @param field Channel to query
+ * @return Deadband, or a negative value for an invalid channel
+ */
+float publish_filter_get_deadband(enum publish_field field)
+{
+    if (field < 0 || field >= PUBLISH_FIELD_COUNT) {
+        return -1.0f;
+    }
+
+    return deadbands[field];
+}
+
+/**
+ * @brief Set which health status changes force an upload
+ *
+ * @param mode Any change, or only a worsening
+ * @return 0 on success, negative errno on failure
+ */
+int publish_filter_set_health_mode(enum publish_health_mode mode)
+{
+    if (mode != PUBLISH_HEALTH_ANY && mode != PUBLISH_HEALTH_WORSE) {
+        return -EINVAL;
+    }
+
+    k_mutex_lock(&filter_lock, K_FOREVER);
+    health_mode = mode;
+    k_mutex_unlock(&filter_lock);
+
+    return 0;
+}
+
+/**
+ * @brief Get which health status changes force an upload
+ *
+ * @return Current health mode
+ */
+enum publish_health_mode publish_filter_get_health_mode(void)
+{
+    return health_mode;
+}
@@ -0,0 +1,96 @@
+#ifndef PUBLISH_FILTER_H
+#define PUBLISH_FILTER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "grow_reading.h"
+
+/* Channels checked by the publish filter */
+enum publish_field {
+    PUBLISH_FIELD_SOIL_MOISTURE,
+    PUBLISH_FIELD_LIGHT_LEVEL,
+    PUBLISH_FIELD_TEMPERATURE,
+    PUBLISH_FIELD_HUMIDITY,
+    PUBLISH_FIELD_AIR_MOVEMENT,
+    PUBLISH_FIELD_COUNT
+};
+
+/* Health status changes that force an upload */
+enum publish_health_mode {
+    PUBLISH_HEALTH_ANY,
+    PUBLISH_HEALTH_WORSE,
+};
+
+/**
+ * @brief Initialize publish filter
+ *
+ * Loads the default deadbands and forgets the last acknowledged reading,
+ * so the next reading is always published.
+ *
+ * @return 0 on success, negative errno on failure
+ */
+int publish_filter_init(void);
+
+/**
+ * @brief Decide whether a reading must be uploaded
+ *
+ * A reading is published when any channel moved by at least its deadband
+ * since the last acknowledged upload, when the health status changed as
+ * selected by the health mode, or when the heartbeat interval elapsed. Otherwise it is counted as
+ * suppressed.
+ *
+ * @param reading Reading to check
+ * @return true if the reading must be uploaded, false if suppressed
+ */
+bool publish_filter_should_send(const struct grow_reading *reading);
+
+/**
+ * @brief Record a reading as acknowledged by the server
+ *
+ * Resets the suppressed counter.
+ *
+ * @param reading Uploaded reading
+ */
+void publish_filter_ack(const struct grow_reading *reading);
+
+/**
+ * @brief Get the number of readings suppressed since the last upload
+ *
+ * @return Suppressed reading count
+ */
+uint32_t publish_filter_suppressed_count(void);
+
+/**
+ * @brief Set the deadband of a channel
+ *
+ * @param field Channel to configure
+ * @param deadband Minimum change that triggers an upload
+ * @return 0 on success, negative errno on failure
+ */
+int publish_filter_set_deadband(enum publish_field field, float deadband);
+
+/**
+ * @brief Get the deadband of a channel
+ *
+ * @param field Channel to query
+ * @return Deadband, or a negative value for an invalid channel
+ */
+float publish_filter_get_deadband(enum publish_field field);
+
+/**
+ * @brief Set which health status changes force an upload
+ *
+ * @param mode Any change, or only a worsening
+ * @return 0 on success, negative errno on failure
+ */
+int publish_filter_set_health_mode(enum publish_health_mode mode);
+
+/**
+ * @brief Get which health status changes force an upload
+ *
+ * @return Current health mode
+ */
+enum publish_health_mode publish_filter_get_health_mode(void);
+
+#endif /* PUBLISH_FILTER_H */
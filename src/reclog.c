@@ -0,0 +1,573 @@
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/storage/flash_map.h>
+#include <zephyr/sys/crc.h>
+#include <string.h>
+#include <errno.h>
+
+#include "reclog.h"
+#include "perf.h"
+
+LOG_MODULE_REGISTER(reclog, CONFIG_LOG_DEFAULT_LEVEL);
+
+/* Flash partition label for the record log */
+#define RECLOG_PARTITION reclog_partition
+#define RECLOG_PARTITION_ID FIXED_PARTITION_ID(RECLOG_PARTITION)
+
+/* Erase unit of all supported flash controllers */
+#define RECLOG_SECTOR_SIZE 4096
+#define RECLOG_MIN_SECTORS 3
+
+/* Record header */
+#define RECLOG_MAGIC 0xA5
+#define RECLOG_TYPE_DATA 1
+#define RECLOG_TYPE_TRIM 2
+
+struct reclog_header {
+    uint8_t magic;
+    uint8_t type;       /* RECLOG_TYPE_* */
+    uint16_t len;       /* Payload length */
+    uint32_t seq;       /* Sequence number, data and trim records alike */
+    uint32_t arg;       /* Trim records: last consumed sequence number */
+    uint16_t crc;       /* CRC16 of the payload */
+    uint8_t reserved;
+    uint8_t hdr_crc;    /* CRC8 of the preceding header bytes */
+} __packed;
+
+BUILD_ASSERT(sizeof(struct reclog_header) == 16, "record header must be 16 bytes");
+
+/* Writes are padded to the write block size, which must divide the header */
+#define RECLOG_MAX_ALIGN 16
+#define RECLOG_MAX_RECORD \
+    ROUND_UP(sizeof(struct reclog_header) + RECLOG_MAX_PAYLOAD, RECLOG_MAX_ALIGN)
+
+/* Log state */
+static const struct flash_area *fa;
+static uint32_t sector_count;
+static uint32_t write_align;
+static uint8_t erased_val;
+static uint32_t write_sector;
+static uint32_t write_off;
+static uint32_t next_seq = 1;
+static uint32_t trim_seq;
+static bool mounted;
+
+/* Record assembly buffer, protected by reclog_lock */
+static uint8_t record_buf[RECLOG_MAX_RECORD];
+
+K_MUTEX_DEFINE(reclog_lock);
+
+/* Statistics, updated with the lock held */
+static struct reclog_stats stats;
+
+/**
+ * @brief Get the flash footprint of a record
+ */
+static uint32_t record_size(size_t len)
+{
+    return ROUND_UP(sizeof(struct reclog_header) + len, write_align);
+}
+
+/**
+ * @brief Check that a buffer holds erased flash
+ */
+static bool is_erased(const void *buf, size_t len)
+{
+    const uint8_t *bytes = buf;
+
+    for (size_t i = 0; i < len; i++) {
+        if (bytes[i] != erased_val) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief Check the magic, header CRC and bounds of a header
+ */
+static bool header_valid(const struct reclog_header *hdr, uint32_t off)
+{
+    if (hdr->magic != RECLOG_MAGIC ||
+        (hdr->type != RECLOG_TYPE_DATA && hdr->type != RECLOG_TYPE_TRIM) ||
+        hdr->len > RECLOG_MAX_PAYLOAD) {
+        return false;
+    }
+
+    if (crc8_ccitt(0xFF, hdr, offsetof(struct reclog_header, hdr_crc)) != hdr->hdr_crc) {
+        return false;
+    }
+
+    return off + record_size(hdr->len) <= RECLOG_SECTOR_SIZE;
+}
+
+/**
+ * @brief Read the header at an offset within a sector
+ */
+static int read_header(uint32_t sector, uint32_t off, struct reclog_header *hdr)
+{
+    return flash_area_read(fa, sector * RECLOG_SECTOR_SIZE + off, hdr, sizeof(*hdr));
+}
+
+/**
+ * @brief Erase one sector
+ */
+static int erase_sector(uint32_t sector)
+{
+    int ret = flash_area_erase(fa, sector * RECLOG_SECTOR_SIZE, RECLOG_SECTOR_SIZE);
+
+    if (ret < 0) {
+        LOG_ERR("Failed to erase sector %u: %d", sector, ret);
+        return ret;
+    }
+
+    stats.erases++;
+    return 0;
+}
+
+/**
+ * @brief Write a record at the write position
+ *
+ * The payload is programmed before the header, so a header on flash
+ * always describes a complete payload.
+ */
+static int write_record(uint8_t type, uint32_t arg, const void *data, size_t len)
+{
+    struct reclog_header *hdr = (struct reclog_header *)record_buf;
+    uint32_t size = record_size(len);
+    off_t addr = write_sector * RECLOG_SECTOR_SIZE + write_off;
+    int ret;
+
+    memset(record_buf, erased_val, size);
+    if (len > 0) {
+        memcpy(record_buf + sizeof(*hdr), data, len);
+    }
+
+    hdr->magic = RECLOG_MAGIC;
+    hdr->type = type;
+    hdr->len = len;
+    hdr->seq = next_seq;
+    hdr->arg = arg;
+    hdr->crc = crc16_ccitt(0xFFFF, record_buf + sizeof(*hdr), len);
+    hdr->reserved = erased_val;
+    hdr->hdr_crc = crc8_ccitt(0xFF, hdr, offsetof(struct reclog_header, hdr_crc));
+
+    write_off += size;
+
+    if (size > sizeof(*hdr)) {
+        ret = flash_area_write(fa, addr + sizeof(*hdr), record_buf + sizeof(*hdr),
+                               size - sizeof(*hdr));
+        if (ret < 0) {
+            goto fail;
+        }
+    }
+
+    ret = flash_area_write(fa, addr, hdr, sizeof(*hdr));
+    if (ret < 0) {
+        goto fail;
+    }
+
+    next_seq++;
+    stats.bytes_written += size;
+    return 0;
+
+fail:
+    /*
+     * Mounting and replay stop at an erased or torn header, so no record
+     * may follow this slot in the sector. The next append moves on to
+     * the erased sector.
+     */
+    write_off = RECLOG_SECTOR_SIZE;
+    return ret;
+}
+
+/**
+ * @brief Move the write position to the next sector
+ *
+ * The next sector is already erased. The one after it holds the oldest
+ * records and is erased ahead, and the trim point is carried over so
+ * that it survives the erase of the sector that recorded it.
+ */
+static int advance_sector(void)
+{
+    struct reclog_header hdr;
+    uint32_t ahead;
+    int ret;
+
+    write_sector = (write_sector + 1) % sector_count;
+    write_off = 0;
+
+    ahead = (write_sector + 1) % sector_count;
+    ret = read_header(ahead, 0, &hdr);
+    if (ret < 0) {
+        return ret;
+    }
+
+    if (!is_erased(&hdr, sizeof(hdr))) {
+        if (header_valid(&hdr, 0) && hdr.seq > trim_seq) {
+            LOG_WRN("Record log full, dropping records from sequence %u", hdr.seq);
+            stats.dropped++;
+        }
+
+        ret = erase_sector(ahead);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+
+    if (trim_seq > 0) {
+        return write_record(RECLOG_TYPE_TRIM, trim_seq, NULL, 0);
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Make room for a record of the given size
+ */
+static int reserve(uint32_t size)
+{
+    if (write_off + size <= RECLOG_SECTOR_SIZE) {
+        return 0;
+    }
+
+    return advance_sector();
+}
+
+/**
+ * @brief Check that a sector is erased from an offset on
+ *
+ * A write torn before its header was programmed leaves payload bytes
+ * behind an erased header, so up to one record past the last header is
+ * checked.
+ */
+static bool tail_erased(uint32_t sector, uint32_t off)
+{
+    uint8_t buf[RECLOG_MAX_RECORD];
+    uint32_t len = MIN(sizeof(buf), RECLOG_SECTOR_SIZE - off);
+
+    if (len == 0) {
+        return true;
+    }
+
+    if (flash_area_read(fa, sector * RECLOG_SECTOR_SIZE + off, buf, len) < 0) {
+        return false;
+    }
+
+    return is_erased(buf, len);
+}
+
+/**
+ * @brief Scan the record headers and restore the write position
+ */
+static int scan(void)
+{
+    struct reclog_header hdr;
+    bool found = false;
+    bool damaged = false;
+    uint32_t head_sector = 0;
+    uint32_t head_off = 0;
+    uint32_t last_seq = 0;
+    int ret;
+
+    for (uint32_t sector = 0; sector < sector_count; sector++) {
+        uint32_t off = 0;
+
+        while (off + sizeof(hdr) <= RECLOG_SECTOR_SIZE) {
+            ret = read_header(sector, off, &hdr);
+            if (ret < 0) {
+                return ret;
+            }
+
+            if (is_erased(&hdr, sizeof(hdr))) {
+                break;
+            }
+
+            if (!header_valid(&hdr, off)) {
+                damaged = true;
+                break;
+            }
+
+            found = true;
+
+            if (hdr.seq > last_seq) {
+                last_seq = hdr.seq;
+                head_sector = sector;
+                head_off = off + record_size(hdr.len);
+            }
+
+            if (hdr.type == RECLOG_TYPE_TRIM && hdr.arg > trim_seq) {
+                trim_seq = hdr.arg;
+            }
+
+            off += record_size(hdr.len);
+        }
+    }
+
+    if (!found) {
+        if (damaged) {
+            /* Not a record log, start over */
+            LOG_WRN("Formatting record log partition");
+            ret = flash_area_erase(fa, 0, sector_count * RECLOG_SECTOR_SIZE);
+            if (ret < 0) {
+                return ret;
+            }
+            stats.erases += sector_count;
+        }
+
+        write_sector = 0;
+        write_off = 0;
+        next_seq = 1;
+        trim_seq = 0;
+        return 0;
+    }
+
+    next_seq = last_seq + 1;
+    write_sector = head_sector;
+    write_off = head_off;
+
+    /* Never program over a damaged or torn tail, continue in a fresh sector */
+    if (!tail_erased(write_sector, write_off)) {
+        LOG_WRN("Record log sector %u has a damaged tail", write_sector);
+        write_off = RECLOG_SECTOR_SIZE;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Mount the record log, formatting the partition if it holds no log
+ *
+ * @return 0 on success, negative errno on failure
+ */
+int reclog_init(void)
+{
+    struct reclog_header hdr;
+    int ret;
+
+    k_mutex_lock(&reclog_lock, K_FOREVER);
+
+    if (mounted) {
+        k_mutex_unlock(&reclog_lock);
+        return 0;
+    }
+
+    ret = flash_area_open(RECLOG_PARTITION_ID, &fa);
+    if (ret < 0) {
+        LOG_ERR("Failed to open record log partition: %d", ret);
+        goto out;
+    }
+
+    sector_count = fa->fa_size / RECLOG_SECTOR_SIZE;
+    write_align = MAX(flash_area_align(fa), 1U);
+    erased_val = flash_area_erased_val(fa);
+
+    if (sector_count < RECLOG_MIN_SECTORS || write_align > RECLOG_MAX_ALIGN ||
+        (sizeof(struct reclog_header) % write_align) != 0) {
+        LOG_ERR("Unsupported record log partition (%u sectors, %u byte writes)",
+               sector_count, write_align);
+        ret = -ENOTSUP;
+        goto out;
+    }
+
+    ret = scan();
+    if (ret < 0) {
+        LOG_ERR("Failed to scan record log: %d", ret);
+        goto out;
+    }
+
+    if (write_off > RECLOG_SECTOR_SIZE - RECLOG_MAX_RECORD) {
+        ret = advance_sector();
+    } else {
+        /* Restore the erase-ahead invariant after an interrupted advance */
+        uint32_t ahead = (write_sector + 1) % sector_count;
+
+        ret = read_header(ahead, 0, &hdr);
+        if (ret == 0 && !is_erased(&hdr, sizeof(hdr))) {
+            ret = erase_sector(ahead);
+        }
+    }
+
+    if (ret < 0) {
+        goto out;
+    }
+
+    mounted = true;
+    LOG_INF("Record log mounted (%u sectors, next sequence %u, trimmed to %u)",
+           sector_count, next_seq, trim_seq);
+
+out:
+    k_mutex_unlock(&reclog_lock);
+    return ret;
+}
+
+/**
+ * @brief Append a record
+ *
+ * @param data Payload
+ * @param len Payload length, at most RECLOG_MAX_PAYLOAD
+ * @param seq_out Pointer to store the record's sequence number, may be NULL
+ * @return 0 on success, negative errno on failure
+ */
+int reclog_append(const void *data, size_t len, uint32_t *seq_out)
+{
+    int ret;
+
+    if (!data || len == 0 || len > RECLOG_MAX_PAYLOAD) {
+        return -EINVAL;
+    }
+
+    k_mutex_lock(&reclog_lock, K_FOREVER);
+
+    if (!mounted) {
+        k_mutex_unlock(&reclog_lock);
+        return -ENODEV;
+    }
+
+    uint32_t start = perf_begin();
+
+    ret = reserve(record_size(len));
+    if (ret == 0) {
+        uint32_t seq = next_seq;
+
+        ret = write_record(RECLOG_TYPE_DATA, 0, data, len);
+        if (ret == 0) {
+            stats.appends++;
+            if (seq_out) {
+                *seq_out = seq;
+            }
+        }
+    }
+
+    perf_end(PERF_RECLOG_APPEND, start);
+
+    k_mutex_unlock(&reclog_lock);
+
+    if (ret < 0) {
+        LOG_ERR("Failed to append record: %d", ret);
+    }
+
+    return ret;
+}
+
+/**
+ * @brief Release all records up to and including a sequence number
+ *
+ * @param seq Last consumed sequence number
+ * @return 0 on success, negative errno on failure
+ */
+int reclog_trim(uint32_t seq)
+{
+    int ret = 0;
+
+    k_mutex_lock(&reclog_lock, K_FOREVER);
+
+    if (!mounted) {
+        k_mutex_unlock(&reclog_lock);
+        return -ENODEV;
+    }
+
+    seq = MIN(seq, next_seq - 1);
+
+    if (seq > trim_seq) {
+        ret = reserve(record_size(0));
+        if (ret == 0) {
+            trim_seq = seq;
+            ret = write_record(RECLOG_TYPE_TRIM, seq, NULL, 0);
+        }
+    }
+
+    k_mutex_unlock(&reclog_lock);
+
+    if (ret < 0) {
+        LOG_ERR("Failed to trim record log: %d", ret);
+    }
+
+    return ret;
+}
+
+/**
+ * @brief Visit the records that were not trimmed, oldest first
+ *
+ * @param cb Callback called for each record
+ * @param user_data User data passed to the callback
+ * @return 0 on success, negative errno on failure
+ */
+int reclog_foreach(reclog_cb_t cb, void *user_data)
+{
+    struct reclog_header hdr;
+    uint8_t payload[RECLOG_MAX_PAYLOAD];
+    int ret = 0;
+
+    if (!cb) {
+        return -EINVAL;
+    }
+
+    k_mutex_lock(&reclog_lock, K_FOREVER);
+
+    if (!mounted) {
+        k_mutex_unlock(&reclog_lock);
+        return -ENODEV;
+    }
+
+    /* The sector after the write sector is erased, the one after it is the oldest */
+    for (uint32_t i = 2; i <= sector_count; i++) {
+        uint32_t sector = (write_sector + i) % sector_count;
+        uint32_t off = 0;
+
+        while (off + sizeof(hdr) <= RECLOG_SECTOR_SIZE) {
+            ret = read_header(sector, off, &hdr);
+            if (ret < 0) {
+                goto out;
+            }
+
+            if (!header_valid(&hdr, off)) {
+                break;
+            }
+
+            uint32_t payload_off = off + sizeof(hdr);
+
+            off += record_size(hdr.len);
+
+            if (hdr.type != RECLOG_TYPE_DATA || hdr.seq <= trim_seq) {
+                continue;
+            }
+
+            ret = flash_area_read(fa, sector * RECLOG_SECTOR_SIZE + payload_off,
+                                  payload, hdr.len);
+            if (ret < 0) {
+                goto out;
+            }
+
+            if (crc16_ccitt(0xFFFF, payload, hdr.len) != hdr.crc) {
+                LOG_WRN("Skipping corrupt record %u", hdr.seq);
+                continue;
+            }
+
+            if (cb(hdr.seq, payload, hdr.len, user_data) != 0) {
+                goto out;
+            }
+        }
+    }
+
+out:
+    k_mutex_unlock(&reclog_lock);
+    return ret;
+}
+
+/**
+ * @brief Get the record log statistics
+ *
+ * @param stats_out Pointer to store the statistics
+ */
+void reclog_get_stats(struct reclog_stats *stats_out)
+{
+    if (!stats_out) {
+        return;
+    }
+
+    k_mutex_lock(&reclog_lock, K_FOREVER);
+    *stats_out = stats;
+    k_mutex_unlock(&reclog_lock);
+}
@@ -0,0 +1,83 @@
+#ifndef RECLOG_H
+#define RECLOG_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Append-only record log on the reclog flash partition.
+ *
+ * Records are appended behind a 16-byte header carrying a sequence
+ * number, the payload length and CRCs, and never span a sector. The
+ * sector after the write sector is always kept erased, so moving to a
+ * new sector never waits for an erase; erasing it ahead drops the
+ * oldest sector. Consumed records are released by appending a trim
+ * record. Mounting only reads the record headers.
+ */
+
+/* Largest payload of one record */
+#define RECLOG_MAX_PAYLOAD 64
+
+/* Record log statistics since boot */
+struct reclog_stats {
+    uint32_t appends;        /* Data records appended */
+    uint32_t bytes_written;  /* Bytes written to flash, headers included */
+    uint32_t erases;         /* Sectors erased */
+    uint32_t dropped;        /* Untrimmed sectors erased to make room */
+};
+
+/**
+ * @brief Visit one record
+ *
+ * @param seq Sequence number of the record
+ * @param data Record payload
+ * @param len Payload length
+ * @param user_data User data passed to reclog_foreach()
+ * @return 0 to continue, non-zero to stop
+ */
+typedef int (*reclog_cb_t)(uint32_t seq, const void *data, size_t len, void *user_data);
+
+/**
+ * @brief Mount the record log, formatting the partition if it holds no log
+ *
+ * @return 0 on success, negative errno on failure
+ */
+int reclog_init(void);
+
+/**
+ * @brief Append a record
+ *
+ * @param data Payload
+ * @param len Payload length, at most RECLOG_MAX_PAYLOAD
+ * @param seq_out Pointer to store the record's sequence number, may be NULL
+ * @return 0 on success, negative errno on failure
+ */
+int reclog_append(const void *data, size_t len, uint32_t *seq_out);
+
+/**
+ * @brief Release all records up to and including a sequence number
+ *
+ * @param seq Last consumed sequence number
+ * @return 0 on success, negative errno on failure
+ */
+int reclog_trim(uint32_t seq);
+
+/**
+ * @brief Visit the records that were not trimmed, oldest first
+ *
+ * Records whose payload CRC does not match are skipped.
+ *
+ * @param cb Callback called for each record
+ * @param user_data User data passed to the callback
+ * @return 0 on success, negative errno on failure
+ */
+int reclog_foreach(reclog_cb_t cb, void *user_data);
+
+/**
+ * @brief Get the record log statistics
+ *
+ * @param stats_out Pointer to store the statistics
+ */
+void reclog_get_stats(struct reclog_stats *stats_out);
+
+#endif /* RECLOG_H */
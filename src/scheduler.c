@@ -0,0 +1,276 @@
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/spinlock.h>
+#include <string.h>
+
+#include "scheduler.h"
+
+LOG_MODULE_REGISTER(scheduler, CONFIG_LOG_DEFAULT_LEVEL);
+
+/* Number of log2 jitter buckets (bucket n holds [2^(n-1), 2^n) us) */
+#define JITTER_BUCKETS 32
+
+/* Scheduler state */
+static k_ticks_t next_deadline;
+static k_ticks_t last_wakeup;
+static k_ticks_t period_ticks;
+static uint32_t sched_period_ms;
+static bool scheduler_initialized = false;
+
+/* Period change requested from another thread */
+static atomic_t pending_period_ms;
+K_SEM_DEFINE(period_sem, 0, 1);
+
+/* Statistics */
+static struct k_spinlock stats_lock;
+static uint32_t cycles;
+static uint32_t missed_deadlines;
+static uint32_t period_min_ms;
+static uint32_t period_max_ms;
+static uint64_t period_sum_ms;
+static uint32_t period_samples;
+static uint32_t jitter_min_us;
+static uint32_t jitter_max_us;
+static uint32_t jitter_hist[JITTER_BUCKETS];
+
+/**
+ * @brief Get the log2 bucket for a jitter value
+ */
+static int jitter_bucket(uint32_t jitter_us)
+{
+    int bucket = 0;
+
+    while (jitter_us > 0 && bucket < JITTER_BUCKETS - 1) {
+        jitter_us >>= 1;
+        bucket++;
+    }
+
+    return bucket;
+}
+
+/**
+ * @brief Record one wake-up in the statistics
+ */
+static void record_wakeup(k_ticks_t now, uint32_t missed)
+{
+    k_spinlock_key_t key = k_spin_lock(&stats_lock);
+    uint32_t jitter_us = (uint32_t)k_ticks_to_us_floor64(now - next_deadline);
+
+    cycles++;
+    missed_deadlines += missed;
+
+    if (jitter_us < jitter_min_us) {
+        jitter_min_us = jitter_us;
+    }
+    if (jitter_us > jitter_max_us) {
+        jitter_max_us = jitter_us;
+    }
+    jitter_hist[jitter_bucket(jitter_us)]++;
+
+    if (last_wakeup != 0) {
+        uint32_t achieved_ms = (uint32_t)k_ticks_to_ms_floor64(now - last_wakeup);
+
+        if (achieved_ms < period_min_ms) {
+            period_min_ms = achieved_ms;
+        }
+        if (achieved_ms > period_max_ms) {
+            period_max_ms = achieved_ms;
+        }
+        period_sum_ms += achieved_ms;
+        period_samples++;
+    }
+
+    last_wakeup = now;
+
+    k_spin_unlock(&stats_lock, key);
+}
+
+/**
+ * @brief Initialize the sampling scheduler
+ *
+ * @param period_ms Sampling period in milliseconds
+ * @return 0 on success, negative errno on failure
+ */
+int scheduler_init(uint32_t period_ms)
+{
+    if (period_ms == 0) {
+        return -EINVAL;
+    }
+
+    sched_period_ms = period_ms;
+    atomic_set(&pending_period_ms, period_ms);
+    period_ticks = k_ms_to_ticks_ceil64(period_ms);
+    next_deadline = k_uptime_ticks();
+    last_wakeup = 0;
+    scheduler_reset_stats();
+    scheduler_initialized = true;
+
+    LOG_INF("Sampling scheduler initialized (period %u ms)", sched_period_ms);
+    return 0;
+}
+
+/**
+ * @brief Apply a period change requested by scheduler_set_period()
+ *
+ * The next deadline is re-anchored on the previous wake-up. If that
+ * deadline already passed, the next sample is taken immediately without
+ * being counted as a missed deadline.
+ */
+static void apply_pending_period(void)
+{
+    uint32_t new_period_ms = (uint32_t)atomic_get(&pending_period_ms);
+
+    if (new_period_ms == 0 || new_period_ms == sched_period_ms) {
+        return;
+    }
+
+    period_ticks = k_ms_to_ticks_ceil64(new_period_ms);
+    sched_period_ms = new_period_ms;
+
+    if (last_wakeup != 0) {
+        k_ticks_t now = k_uptime_ticks();
+
+        next_deadline = last_wakeup + period_ticks;
+        if (next_deadline < now) {
+            next_deadline = now;
+        }
+    }
+
+    LOG_INF("Sampling period set to %u ms", sched_period_ms);
+}
+
+/**
+ * @brief Sleep until the next absolute sampling deadline
+ *
+ * @return Number of deadlines missed since the previous call
+ */
+uint32_t scheduler_wait_next(void)
+{
+    uint32_t missed = 0;
+    k_ticks_t now;
+
+    if (!scheduler_initialized) {
+        scheduler_init(CONFIG_GROW_SAMPLE_INTERVAL_SEC * 1000U);
+    }
+
+    apply_pending_period();
+
+    while (1) {
+        now = k_uptime_ticks();
+
+        /* Skip deadlines that already passed while the caller was busy */
+        while (next_deadline + period_ticks <= now) {
+            next_deadline += period_ticks;
+            missed++;
+        }
+
+        /* A period change wakes us early so the new deadline applies now */
+        if (k_sem_take(&period_sem, K_TIMEOUT_ABS_TICKS(next_deadline)) != 0) {
+            break;
+        }
+
+        apply_pending_period();
+    }
+
+    if (missed > 0) {
+        LOG_WRN("Sampler overran, skipped %u deadline(s)", missed);
+    }
+
+    now = k_uptime_ticks();
+    record_wakeup(now, missed);
+
+    next_deadline += period_ticks;
+
+    return missed;
+}
+
+/**
+ * @brief Change the sampling period
+ *
+ * @param period_ms Sampling period in milliseconds
+ * @return 0 on success, negative errno on failure
+ */
+int scheduler_set_period(uint32_t period_ms)
+{
+    if (period_ms == 0) {
+        return -EINVAL;
+    }
+
+    if ((uint32_t)atomic_set(&pending_period_ms, period_ms) != period_ms) {
+        k_sem_give(&period_sem);
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Get the current sampling period
+ *
+ * @return Sampling period in milliseconds
+ */
+uint32_t scheduler_get_period(void)
+{
+    return sched_period_ms;
+}
+
+/**
+ * @brief Get scheduler statistics
+ *
+ * @param stats_out Pointer to store the statistics
+ * @return 0 on success, negative errno on failure
+ */
+int scheduler_get_stats(struct scheduler_stats *stats_out)
+{
+    if (!stats_out) {
+        return -EINVAL;
+    }
+
+    k_spinlock_key_t key = k_spin_lock(&stats_lock);
+
+    stats_out->period_ms = sched_period_ms;
+    stats_out->cycles = cycles;
+    stats_out->missed_deadlines = missed_deadlines;
+    stats_out->achieved_period_min_ms = period_samples ? period_min_ms : 0;
+    stats_out->achieved_period_max_ms = period_max_ms;
+    stats_out->achieved_period_avg_ms = period_samples ?
+                                        (uint32_t)(period_sum_ms / period_samples) : 0;
+    stats_out->jitter_min_us = cycles ? jitter_min_us : 0;
+    stats_out->jitter_max_us = jitter_max_us;
+
+    /* Walk the histogram up to the 99th percentile */
+    uint32_t threshold = cycles - cycles / 100;
+    uint32_t seen = 0;
+
+    stats_out->jitter_p99_us = 0;
+    for (int i = 0; i < JITTER_BUCKETS && cycles > 0; i++) {
+        seen += jitter_hist[i];
+        if (seen >= threshold) {
+            stats_out->jitter_p99_us = (i == 0) ? 0 : (uint32_t)(BIT64(i) - 1);
+            break;
+        }
+    }
+
+    k_spin_unlock(&stats_lock, key);
+
+    return 0;
+}
+
+/**
+ * @brief Reset scheduler statistics
+ */
+void scheduler_reset_stats(void)
+{
+    k_spinlock_key_t key = k_spin_lock(&stats_lock);
+
+    cycles = 0;
+    missed_deadlines = 0;
+    period_min_ms = UINT32_MAX;
+    period_max_ms = 0;
+    period_sum_ms = 0;
+    period_samples = 0;
+    jitter_min_us = UINT32_MAX;
+    jitter_max_us = 0;
+    memset(jitter_hist, 0, sizeof(jitter_hist));
+
+    k_spin_unlock(&stats_lock, key);
+}
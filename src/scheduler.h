@@ -0,0 +1,71 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stdint.h>
+
+/* Sampling scheduler statistics */
+struct scheduler_stats {
+    uint32_t period_ms;              /* Nominal sampling period */
+    uint32_t cycles;                 /* Number of completed cycles */
+    uint32_t missed_deadlines;       /* Deadlines skipped because the sampler overran */
+    uint32_t achieved_period_min_ms; /* Shortest period between two wake-ups */
+    uint32_t achieved_period_max_ms; /* Longest period between two wake-ups */
+    uint32_t achieved_period_avg_ms; /* Average period between two wake-ups */
+    uint32_t jitter_min_us;          /* Smallest wake-up lateness */
+    uint32_t jitter_max_us;          /* Largest wake-up lateness */
+    uint32_t jitter_p99_us;          /* 99th percentile wake-up lateness (bucket upper bound) */
+};
+
+/**
+ * @brief Initialize the sampling scheduler
+ *
+ * The first deadline is the time of the call, so the first call to
+ * scheduler_wait_next() returns immediately.
+ *
+ * @param period_ms Sampling period in milliseconds
+ * @return 0 on success, negative errno on failure
+ */
+int scheduler_init(uint32_t period_ms);
+
+/**
+ * @brief Sleep until the next absolute sampling deadline
+ *
+ * Deadlines are spaced exactly one period apart on the kernel tick
+ * timeline, independent of how long the caller spent between calls.
+ * Deadlines that already passed are counted as missed and skipped.
+ *
+ * @return Number of deadlines missed since the previous call
+ */
+uint32_t scheduler_wait_next(void);
+
+/**
+ * @brief Change the sampling period
+ *
+ * The new period applies from the next deadline onwards.
+ *
+ * @param period_ms Sampling period in milliseconds
+ * @return 0 on success, negative errno on failure
+ */
+int scheduler_set_period(uint32_t period_ms);
+
+/**
+ * @brief Get the current sampling period
+ *
+ * @return Sampling period in milliseconds
+ */
+uint32_t scheduler_get_period(void);
+
+/**
+ * @brief Get scheduler statistics
+ *
+ * @param stats_out Pointer to store the statistics
+ * @return 0 on success, negative errno on failure
+ */
+int scheduler_get_stats(struct scheduler_stats *stats_out);
+
+/**
+ * @brief Reset scheduler statistics
+ */
+void scheduler_reset_stats(void);
+
+#endif /* SCHEDULER_H */
@@ -1,6 +1,8 @@
 #ifndef SENSORS_H
 #define SENSORS_H
 
+#include "grow_reading.h"
+
 /**
  * @brief Initialize sensors
  *
@@ -11,15 +13,12 @@ int sensors_init(void);
 /**
  * @brief Read sensor values
  *
- * @param soil_moisture_out Pointer to store soil moisture value (0-100%)
- * @param light_level_out Pointer to store light level value (0-100%)
- * @param temperature_out Pointer to store temperature value (°C)
- * @param humidity_out Pointer to store humidity value (0-100%)
- * @param air_movement_out Pointer to store air movement value (relative value)
+ * Fills the channel values and timestamp. Health is left as
+ * GROW_HEALTH_UNKNOWN until the reading is analysed.
+ *
+ * @param reading_out Reading to fill
  * @return 0 on success, negative errno on failure
  */
-int sensors_read(float *soil_moisture_out, float *light_level_out,
-                float *temperature_out, float *humidity_out,
-                float *air_movement_out);
+int sensors_read(struct grow_reading *reading_out);
 
 #endif /* SENSORS_H */
\ No newline at end of file
@@ -10,8 +10,6 @@
 
 LOG_MODULE_REGISTER(serial_number, CONFIG_LOG_DEFAULT_LEVEL);
 
-#define SERIAL_NUMBER_KEY "serial_number"
-
 static char serial_number[33];
 static bool serial_number_initialized = false;
 
@@ -51,7 +49,7 @@ static int generate_serial_number(char *serial_out, size_t serial_len)
             mac[0], mac[1], mac[2], mac[3], mac[4], mac[5], random_value);
     
     /* Save the serial number to flash */
-    ret = storage_save_value(SERIAL_NUMBER_KEY, serial_out, strlen(serial_out));
+    ret = storage_save_key(STORAGE_KEY_SERIAL_NUMBER, serial_out, strlen(serial_out));
     if (ret < 0) {
         LOG_ERR("Failed to save serial number: %d", ret);
         return ret;
@@ -79,7 +77,7 @@ int serial_number_init(char *serial_out, size_t serial_len)
     }
     
     /* Try to load serial number from storage */
-    ret = storage_load_value(SERIAL_NUMBER_KEY, serial_out, &len);
+    ret = storage_load_key(STORAGE_KEY_SERIAL_NUMBER, serial_out, &len);
     
     /* If not found or error, generate a new one */
     if (ret < 0) {
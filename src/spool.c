@@ -0,0 +1,805 @@
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/fs/fs.h>
+#include <zephyr/fs/littlefs.h>
+#include <zephyr/storage/flash_map.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "spool.h"
+
+LOG_MODULE_REGISTER(spool, CONFIG_LOG_DEFAULT_LEVEL);
+
+/* Flash partition label for the spool */
+#define SPOOL_PARTITION spool_partition
+#define SPOOL_PARTITION_ID FIXED_PARTITION_ID(SPOOL_PARTITION)
+
+/* Segment file header */
+#define SPOOL_MAGIC 0x324C5053 /* "SPL2" */
+
+struct segment_header {
+    uint32_t magic;
+    uint32_t boot;              /* Boot the segment was written in */
+    int64_t first_timestamp;    /* Uptime timestamp of the first record */
+} __packed;
+
+/* Segment files are named by their number in eight hex digits */
+#define SEGMENT_NAME_LEN 8
+#define SEGMENT_PATH_MAX (sizeof(CONFIG_GROW_SPOOL_MOUNT_POINT) + 1 + SEGMENT_NAME_LEN)
+
+/* Release position file, rewritten in place on every release */
+#define CURSOR_PATH CONFIG_GROW_SPOOL_MOUNT_POINT "/cursor"
+#define CURSOR_MAGIC 0x52535543 /* "CUSR" */
+
+struct cursor_record {
+    uint32_t magic;
+    uint32_t segment;
+    uint32_t offset;
+} __packed;
+
+/* Boot counter, incremented at every mount */
+#define BOOT_PATH CONFIG_GROW_SPOOL_MOUNT_POINT "/boot"
+
+/* Free space kept for the next segment and LittleFS metadata */
+#define SPOOL_FREE_MARGIN (2 * CONFIG_GROW_SPOOL_SEGMENT_SIZE)
+
+FS_LITTLEFS_DECLARE_DEFAULT_CONFIG(spool_fs_data);
+
+static struct fs_mount_t spool_mount = {
+    .type = FS_LITTLEFS,
+    .fs_data = &spool_fs_data,
+    .storage_dev = (void *)SPOOL_PARTITION_ID,
+    .mnt_point = CONFIG_GROW_SPOOL_MOUNT_POINT,
+};
+
+/* Record position */
+struct spool_pos {
+    uint32_t segment;
+    uint32_t offset;
+};
+
+/* Segments are numbered first_segment..last_segment, none if first > last */
+static uint32_t first_segment = 1;
+static uint32_t last_segment;
+static uint32_t write_size;         /* Size of the last segment */
+static bool sealed;                 /* The last segment takes no more records */
+static struct fs_file_t write_file;
+static bool write_open;
+
+/* Reader */
+static struct spool_pos read_pos;
+static struct spool_pos release_pos;
+static struct spool_pos persisted_pos;  /* Release position read at boot */
+static struct fs_file_t read_file;
+static uint32_t read_segment;       /* Segment open in read_file, 0 if none */
+
+static bool mounted;
+static uint32_t boot;
+static struct spool_stats stats;
+static spool_drop_cb_t drop_cb;
+
+/* Record assembly buffer, protected by spool_lock */
+static uint8_t record_buf[1 + SPOOL_MAX_RECORD];
+
+K_MUTEX_DEFINE(spool_lock);
+
+static bool has_segments(void)
+{
+    return first_segment <= last_segment;
+}
+
+static void segment_path(uint32_t segment, char *path)
+{
+    snprintf(path, SEGMENT_PATH_MAX, "%s/%08x", CONFIG_GROW_SPOOL_MOUNT_POINT,
+             (unsigned int)segment);
+}
+
+static void close_read(void)
+{
+    if (read_segment) {
+        fs_close(&read_file);
+        read_segment = 0;
+    }
+}
+
+static void close_write(void)
+{
+    if (write_open) {
+        fs_close(&write_file);
+        write_open = false;
+    }
+}
+
+/**
+ * @brief Pass the records of a segment to the drop handler
+ *
+ * Records before the release position are flagged as released. Uses
+ * record_buf, so it must not run while a record is assembled.
+ */
+static void drain_segment(uint32_t segment, const char *path)
+{
+    struct fs_file_t file;
+    uint32_t offset = sizeof(struct segment_header);
+    uint8_t *record = &record_buf[1];
+    uint8_t len;
+
+    fs_file_t_init(&file);
+    if (fs_open(&file, path, FS_O_READ) < 0) {
+        return;
+    }
+
+    if (fs_seek(&file, offset, FS_SEEK_SET) < 0) {
+        fs_close(&file);
+        return;
+    }
+
+    /* Stops at the end, or at what an interrupted append left */
+    while (fs_read(&file, &len, sizeof(len)) == sizeof(len) && len > 0 &&
+           fs_read(&file, record, len) == len) {
+        bool released = (release_pos.segment == segment && offset < release_pos.offset) ||
+                        (persisted_pos.segment == segment && offset < persisted_pos.offset);
+
+        drop_cb(record, len, released);
+        offset += 1 + len;
+    }
+
+    fs_close(&file);
+}
+
+/**
+ * @brief Delete the oldest segment
+ *
+ * Moves the reader to the next segment if it was in the deleted one.
+ * Records that were not released are passed to the drop handler first.
+ */
+static void drop_oldest(void)
+{
+    char path[SEGMENT_PATH_MAX];
+    struct fs_dirent entry;
+    uint32_t segment = first_segment;
+    size_t size = 0;
+
+    segment_path(segment, path);
+
+    if (read_segment == segment) {
+        close_read();
+    }
+
+    if (segment == last_segment) {
+        close_write();
+        write_size = 0;
+    }
+
+    if (fs_stat(path, &entry) == 0) {
+        size = entry.size;
+    }
+
+    bool unreleased = release_pos.segment == segment && release_pos.offset < size;
+
+    if (unreleased && drop_cb) {
+        drain_segment(segment, path);
+    }
+
+    int ret = fs_unlink(path);
+    if (ret < 0 && ret != -ENOENT) {
+        LOG_WRN("Failed to delete segment %u: %d", segment, ret);
+    }
+
+    stats.bytes -= MIN(size, stats.bytes);
+    first_segment++;
+
+    if (release_pos.segment <= segment) {
+        if (unreleased) {
+            stats.dropped++;
+            LOG_WRN("Spool segment %u dropped before it was uploaded", segment);
+        }
+        release_pos.segment = first_segment;
+        release_pos.offset = sizeof(struct segment_header);
+    }
+
+    if (read_pos.segment <= segment) {
+        read_pos = release_pos;
+    }
+}
+
+/**
+ * @brief Get the free space of the spool partition
+ */
+static uint64_t free_space(void)
+{
+    struct fs_statvfs vfs;
+
+    if (fs_statvfs(CONFIG_GROW_SPOOL_MOUNT_POINT, &vfs) < 0) {
+        return UINT64_MAX;
+    }
+
+    return (uint64_t)vfs.f_bfree * vfs.f_frsize;
+}
+
+/**
+ * @brief Check whether all records of a segment are older than the age limit
+ *
+ * A segment ends where the next one starts. Timestamps are uptime, so they
+ * only compare within one boot. Records written before this boot are at
+ * least as old as the current uptime.
+ */
+static bool segment_expired(uint32_t segment, int64_t now)
+{
+    char path[SEGMENT_PATH_MAX];
+    struct fs_file_t file;
+    struct segment_header hdr;
+
+    if (CONFIG_GROW_SPOOL_MAX_AGE_HOURS == 0 || segment >= last_segment) {
+        return false;
+    }
+
+    segment_path(segment + 1, path);
+    fs_file_t_init(&file);
+
+    if (fs_open(&file, path, FS_O_READ) < 0) {
+        return false;
+    }
+
+    ssize_t n = fs_read(&file, &hdr, sizeof(hdr));
+    fs_close(&file);
+
+    if (n != sizeof(hdr) || hdr.magic != SPOOL_MAGIC) {
+        return false;
+    }
+
+    int64_t age = (hdr.boot == boot) ? now - hdr.first_timestamp : now;
+
+    return age > (int64_t)CONFIG_GROW_SPOOL_MAX_AGE_HOURS * 3600;
+}
+
+/**
+ * @brief Delete the oldest segments until the retention limits are met
+ *
+ * The last segment is never deleted.
+ */
+static void enforce_retention(int64_t now)
+{
+    while (first_segment < last_segment) {
+        bool over_size = CONFIG_GROW_SPOOL_MAX_KB > 0 &&
+                         stats.bytes + CONFIG_GROW_SPOOL_SEGMENT_SIZE >
+                         CONFIG_GROW_SPOOL_MAX_KB * 1024U;
+
+        if (!over_size && free_space() >= SPOOL_FREE_MARGIN &&
+            !segment_expired(first_segment, now)) {
+            break;
+        }
+
+        drop_oldest();
+    }
+}
+
+/**
+ * @brief Start a new segment
+ */
+static int rotate(int64_t timestamp)
+{
+    char path[SEGMENT_PATH_MAX];
+    struct segment_header hdr = {
+        .magic = SPOOL_MAGIC,
+        .boot = boot,
+        .first_timestamp = timestamp,
+    };
+    uint32_t segment = last_segment + 1;
+    int ret;
+
+    close_write();
+    segment_path(segment, path);
+    fs_file_t_init(&write_file);
+
+    ret = fs_open(&write_file, path, FS_O_CREATE | FS_O_WRITE | FS_O_APPEND);
+    if (ret < 0) {
+        return ret;
+    }
+
+    ssize_t n = fs_write(&write_file, &hdr, sizeof(hdr));
+    if (n == sizeof(hdr)) {
+        ret = fs_sync(&write_file);
+    } else {
+        ret = n < 0 ? n : -ENOSPC;
+    }
+
+    if (ret < 0) {
+        fs_close(&write_file);
+        fs_unlink(path);
+        return ret;
+    }
+
+    write_open = true;
+    last_segment = segment;
+    write_size = sizeof(hdr);
+    sealed = false;
+    stats.bytes += sizeof(hdr);
+
+    return 0;
+}
+
+/**
+ * @brief Persist the release position
+ *
+ * LittleFS commits the rewrite atomically when the file is closed.
+ */
+static int save_cursor(void)
+{
+    struct fs_file_t file;
+    struct cursor_record cursor = {
+        .magic = CURSOR_MAGIC,
+        .segment = release_pos.segment,
+        .offset = release_pos.offset,
+    };
+    int ret;
+
+    /* Nothing to resume from an empty spool */
+    if (!has_segments()) {
+        ret = fs_unlink(CURSOR_PATH);
+        return ret == -ENOENT ? 0 : ret;
+    }
+
+    fs_file_t_init(&file);
+    ret = fs_open(&file, CURSOR_PATH, FS_O_CREATE | FS_O_WRITE);
+    if (ret < 0) {
+        return ret;
+    }
+
+    ssize_t n = fs_write(&file, &cursor, sizeof(cursor));
+    ret = fs_close(&file);
+
+    if (n != sizeof(cursor)) {
+        return n < 0 ? n : -ENOSPC;
+    }
+
+    return ret;
+}
+
+/**
+ * @brief Read the release position persisted before the reboot
+ */
+static void load_cursor(void)
+{
+    struct fs_file_t file;
+    struct cursor_record cursor;
+
+    fs_file_t_init(&file);
+    if (fs_open(&file, CURSOR_PATH, FS_O_READ) < 0) {
+        return;
+    }
+
+    ssize_t n = fs_read(&file, &cursor, sizeof(cursor));
+    fs_close(&file);
+
+    if (n != sizeof(cursor) || cursor.magic != CURSOR_MAGIC ||
+        cursor.segment < first_segment || cursor.segment > last_segment) {
+        return;
+    }
+
+    persisted_pos.segment = cursor.segment;
+    persisted_pos.offset = cursor.offset;
+    release_pos.segment = cursor.segment;
+}
+
+/**
+ * @brief Count this boot in the boot counter file
+ *
+ * If the counter cannot be read it restarts at 1, which at worst keeps
+ * older segments until the size limits drop them.
+ */
+static void count_boot(void)
+{
+    struct fs_file_t file;
+
+    fs_file_t_init(&file);
+    if (fs_open(&file, BOOT_PATH, FS_O_CREATE | FS_O_RDWR) < 0) {
+        LOG_WRN("Failed to open spool boot counter");
+        return;
+    }
+
+    if (fs_read(&file, &boot, sizeof(boot)) != sizeof(boot)) {
+        boot = 0;
+    }
+    boot++;
+
+    if (fs_seek(&file, 0, FS_SEEK_SET) < 0 ||
+        fs_write(&file, &boot, sizeof(boot)) != sizeof(boot)) {
+        LOG_WRN("Failed to update spool boot counter");
+    }
+    fs_close(&file);
+}
+
+/**
+ * @brief Mount the spool partition and find the segments
+ *
+ * @return 0 on success, negative errno on failure
+ */
+int spool_init(void)
+{
+    struct fs_dir_t dir;
+    struct fs_dirent entry;
+    uint32_t lowest = UINT32_MAX;
+    uint32_t highest = 0;
+    uint32_t highest_size = 0;
+    uint32_t bytes = 0;
+    int ret;
+
+    k_mutex_lock(&spool_lock, K_FOREVER);
+
+    if (mounted) {
+        k_mutex_unlock(&spool_lock);
+        return 0;
+    }
+
+    ret = fs_mount(&spool_mount);
+    if (ret < 0 && ret != -EBUSY) {
+        LOG_ERR("Failed to mount spool: %d", ret);
+        goto out;
+    }
+
+    count_boot();
+
+    fs_dir_t_init(&dir);
+    ret = fs_opendir(&dir, CONFIG_GROW_SPOOL_MOUNT_POINT);
+    if (ret < 0) {
+        LOG_ERR("Failed to open spool directory: %d", ret);
+        goto out;
+    }
+
+    while (fs_readdir(&dir, &entry) == 0 && entry.name[0] != '\0') {
+        char *end;
+
+        if (entry.type != FS_DIR_ENTRY_FILE || strlen(entry.name) != SEGMENT_NAME_LEN) {
+            continue;
+        }
+
+        unsigned long segment = strtoul(entry.name, &end, 16);
+        if (*end != '\0' || segment == 0) {
+            continue;
+        }
+
+        lowest = MIN(lowest, segment);
+        if (segment > highest) {
+            highest = segment;
+            highest_size = entry.size;
+        }
+        bytes += entry.size;
+    }
+
+    fs_closedir(&dir);
+
+    if (highest > 0) {
+        first_segment = lowest;
+        last_segment = highest;
+        write_size = highest_size;
+
+        /* Records appended after a boot start a new segment */
+        sealed = true;
+    }
+
+    stats.bytes = bytes;
+    release_pos.segment = first_segment;
+    release_pos.offset = sizeof(struct segment_header);
+
+    /* Resume at the start of the segment holding the release position */
+    if (has_segments()) {
+        load_cursor();
+    } else {
+        fs_unlink(CURSOR_PATH);
+    }
+    read_pos = release_pos;
+    mounted = true;
+
+    LOG_INF("Spool mounted at %s (%u segments, %u bytes)", CONFIG_GROW_SPOOL_MOUNT_POINT,
+           has_segments() ? last_segment - first_segment + 1 : 0, bytes);
+    ret = 0;
+
+out:
+    k_mutex_unlock(&spool_lock);
+    return ret;
+}
+
+/**
+ * @brief Append a record
+ *
+ * @param data Record
+ * @param len Record length, at most SPOOL_MAX_RECORD
+ * @param timestamp Record timestamp in seconds, used for age retention
+ * @return 0 on success, negative errno on failure
+ */
+int spool_append(const void *data, size_t len, int64_t timestamp)
+{
+    char path[SEGMENT_PATH_MAX];
+    int ret = 0;
+
+    if (!data || len == 0 || len > SPOOL_MAX_RECORD) {
+        return -EINVAL;
+    }
+
+    k_mutex_lock(&spool_lock, K_FOREVER);
+
+    if (!mounted) {
+        ret = -ENODEV;
+        goto out;
+    }
+
+    if (!has_segments() || sealed || write_size >= CONFIG_GROW_SPOOL_SEGMENT_SIZE) {
+        ret = rotate(timestamp);
+        if (ret < 0) {
+            LOG_ERR("Failed to start spool segment: %d", ret);
+            goto out;
+        }
+        enforce_retention(timestamp);
+    }
+
+    if (!write_open) {
+        segment_path(last_segment, path);
+        fs_file_t_init(&write_file);
+
+        ret = fs_open(&write_file, path, FS_O_WRITE | FS_O_APPEND);
+        if (ret < 0) {
+            LOG_ERR("Failed to open spool segment %u: %d", last_segment, ret);
+            sealed = true;
+            goto out;
+        }
+        write_open = true;
+    }
+
+    record_buf[0] = len;
+    memcpy(&record_buf[1], data, len);
+
+    ssize_t n = fs_write(&write_file, record_buf, len + 1);
+    if (n == (ssize_t)(len + 1)) {
+        ret = fs_sync(&write_file);
+    } else {
+        ret = n < 0 ? n : -ENOSPC;
+    }
+
+    if (ret < 0) {
+        /* A partial record may be left, continue in a new segment */
+        LOG_ERR("Failed to append to spool: %d", ret);
+        sealed = true;
+        if (ret == -ENOSPC && first_segment < last_segment) {
+            drop_oldest();
+        }
+        goto out;
+    }
+
+    write_size += n;
+    stats.bytes += n;
+    stats.appends++;
+
+out:
+    k_mutex_unlock(&spool_lock);
+    return ret;
+}
+
+/**
+ * @brief Set the handler of records deleted before they were released
+ *
+ * @param cb Handler, NULL for none
+ */
+void spool_set_drop_cb(spool_drop_cb_t cb)
+{
+    k_mutex_lock(&spool_lock, K_FOREVER);
+    drop_cb = cb;
+    k_mutex_unlock(&spool_lock);
+}
+
+/**
+ * @brief Check whether the next record starts a new segment
+ *
+ * @return true if the next appended record is the first of its segment
+ */
+bool spool_segment_empty(void)
+{
+    k_mutex_lock(&spool_lock, K_FOREVER);
+    bool empty = !has_segments() || sealed ||
+                 write_size >= CONFIG_GROW_SPOOL_SEGMENT_SIZE ||
+                 write_size <= sizeof(struct segment_header);
+    k_mutex_unlock(&spool_lock);
+
+    return empty;
+}
+
+/**
+ * @brief Open a segment for reading
+ *
+ * The last segment is reopened on every read to see the latest appends.
+ */
+static int open_read(uint32_t segment)
+{
+    char path[SEGMENT_PATH_MAX];
+    struct segment_header hdr;
+    int ret;
+
+    if (read_segment == segment && segment != last_segment) {
+        return 0;
+    }
+
+    close_read();
+    segment_path(segment, path);
+    fs_file_t_init(&read_file);
+
+    ret = fs_open(&read_file, path, FS_O_READ);
+    if (ret < 0) {
+        return ret;
+    }
+
+    ssize_t n = fs_read(&read_file, &hdr, sizeof(hdr));
+    if (n != sizeof(hdr) || hdr.magic != SPOOL_MAGIC) {
+        fs_close(&read_file);
+        return -EBADMSG;
+    }
+
+    read_segment = segment;
+    return 0;
+}
+
+/**
+ * @brief Read the record at the read position of the open segment
+ *
+ * @return 0 on success, -ENODATA at the end of the segment, -EMSGSIZE
+ *         if the record was skipped because it does not fit
+ */
+static int read_record(void *buf, size_t size, size_t *len_out)
+{
+    uint8_t len;
+    int ret;
+
+    ret = fs_seek(&read_file, read_pos.offset, FS_SEEK_SET);
+    if (ret < 0) {
+        return ret;
+    }
+
+    /* A zero length or short record is what an interrupted append leaves */
+    ssize_t n = fs_read(&read_file, &len, sizeof(len));
+    if (n < 0) {
+        return n;
+    }
+    if (n == 0 || len == 0) {
+        return -ENODATA;
+    }
+
+    if (len > size) {
+        read_pos.offset += 1 + len;
+        return -EMSGSIZE;
+    }
+
+    n = fs_read(&read_file, buf, len);
+    if (n < 0) {
+        return n;
+    }
+    if (n < len) {
+        return -ENODATA;
+    }
+
+    read_pos.offset += 1 + len;
+    *len_out = len;
+    return 0;
+}
+
+/**
+ * @brief Read the next record
+ *
+ * @param buf Buffer for the record
+ * @param size Buffer size
+ * @param len_out Pointer to store the record length
+ * @return 0 on success, -ENODATA when all records were read
+ */
+int spool_read(void *buf, size_t size, size_t *len_out, bool *released_out)
+{
+    int ret;
+
+    if (!buf || !len_out || !released_out) {
+        return -EINVAL;
+    }
+
+    k_mutex_lock(&spool_lock, K_FOREVER);
+
+    if (!mounted) {
+        k_mutex_unlock(&spool_lock);
+        return -ENODATA;
+    }
+
+    while (1) {
+        if (!has_segments() || read_pos.segment > last_segment ||
+            (read_pos.segment == last_segment && read_pos.offset >= write_size)) {
+            ret = -ENODATA;
+            break;
+        }
+
+        struct spool_pos pos = read_pos;
+
+        ret = open_read(read_pos.segment);
+        if (ret == 0) {
+            ret = read_record(buf, size, len_out);
+        }
+
+        if (ret == 0) {
+            *released_out = pos.segment < persisted_pos.segment ||
+                            (pos.segment == persisted_pos.segment &&
+                             pos.offset < persisted_pos.offset);
+        }
+
+        if ((ret == -ENODATA || ret == -ENOENT || ret == -EBADMSG) &&
+            read_pos.segment < last_segment) {
+            /* End of a completed segment, or a missing or damaged one */
+            read_pos.segment++;
+            read_pos.offset = sizeof(struct segment_header);
+            continue;
+        }
+
+        break;
+    }
+
+    k_mutex_unlock(&spool_lock);
+    return ret;
+}
+
+/**
+ * @brief Release the records read so far
+ *
+ * @return 0 on success, negative errno on failure
+ */
+int spool_release(void)
+{
+    int ret = 0;
+
+    k_mutex_lock(&spool_lock, K_FOREVER);
+
+    if (!mounted || (release_pos.segment == read_pos.segment &&
+                     release_pos.offset == read_pos.offset)) {
+        goto out;
+    }
+
+    release_pos = read_pos;
+
+    /* Delete the segments that were read completely */
+    while (has_segments() && first_segment < release_pos.segment) {
+        drop_oldest();
+    }
+
+    if (has_segments() && first_segment == last_segment &&
+        release_pos.offset >= write_size) {
+        drop_oldest();
+    }
+
+    ret = save_cursor();
+    if (ret < 0) {
+        LOG_WRN("Failed to persist spool cursor: %d", ret);
+    }
+
+out:
+    k_mutex_unlock(&spool_lock);
+    return ret;
+}
+
+/**
+ * @brief Return the reader to the last release
+ */
+void spool_rewind(void)
+{
+    k_mutex_lock(&spool_lock, K_FOREVER);
+    read_pos = release_pos;
+    k_mutex_unlock(&spool_lock);
+}
+
+/**
+ * @brief Get the spool statistics
+ *
+ * @param stats_out Pointer to store the statistics
+ */
+void spool_get_stats(struct spool_stats *stats_out)
+{
+    if (!stats_out) {
+        return;
+    }
+
+    k_mutex_lock(&spool_lock, K_FOREVER);
+    *stats_out = stats;
+    stats_out->segments = has_segments() ? last_segment - first_segment + 1 : 0;
+    k_mutex_unlock(&spool_lock);
+}
@@ -0,0 +1,173 @@
+#ifndef SPOOL_H
+#define SPOOL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <string.h>
+#include <zephyr/sys/util.h>
+
+/*
+ * Offline spool on a LittleFS partition
+ *
+ * Records are appended to numbered segment files that are rotated once
+ * they reach CONFIG_GROW_SPOOL_SEGMENT_SIZE. Each segment starts with
+ * the timestamp of its first record. The oldest segments are deleted
+ * when the partition runs low on space, the spool exceeds its size
+ * limit, or all of their records are older than the age limit. Records
+ * deleted before they were released are passed to the drop handler.
+ *
+ * A single reader streams the records oldest first, one at a time.
+ * Records it has read are released explicitly, and a rewind returns it
+ * to the last release. The release position is persisted, and after a
+ * reboot the records of its segment that were released already are
+ * read again flagged as released, so delta-encoded records that follow
+ * them can still be decoded.
+ */
+
+/* Largest record */
+#define SPOOL_MAX_RECORD 255
+
+/**
+ * @brief Handle a record of a segment deleted before it was released
+ *
+ * The records of the segment are passed oldest first from its start, so
+ * delta-encoded ones can be decoded. Called with the spool locked from
+ * spool_append(), the handler must not call into the spool.
+ *
+ * @param data Record
+ * @param len Record length
+ * @param released The record was released already
+ */
+typedef void (*spool_drop_cb_t)(const void *data, size_t len, bool released);
+
+/* Spool statistics */
+struct spool_stats {
+    uint32_t segments;      /* Segment files on the partition */
+    uint32_t bytes;         /* Size of the segment files */
+    uint32_t appends;       /* Records appended since boot */
+    uint32_t dropped;       /* Segments deleted before they were read */
+};
+
+#if defined(CONFIG_GROW_SPOOL)
+
+/**
+ * @brief Mount the spool partition and find the segments
+ *
+ * @return 0 on success, negative errno on failure
+ */
+int spool_init(void);
+
+/**
+ * @brief Append a record
+ *
+ * @param data Record
+ * @param len Record length, at most SPOOL_MAX_RECORD
+ * @param timestamp Record timestamp in seconds, used for age retention
+ * @return 0 on success, negative errno on failure
+ */
+int spool_append(const void *data, size_t len, int64_t timestamp);
+
+/**
+ * @brief Set the handler of records deleted before they were released
+ *
+ * @param cb Handler, NULL for none
+ */
+void spool_set_drop_cb(spool_drop_cb_t cb);
+
+/**
+ * @brief Check whether the next record starts a new segment
+ *
+ * Segments are deleted as a whole, so a record that starts a segment
+ * must be readable on its own.
+ *
+ * @return true if the next appended record is the first of its segment
+ */
+bool spool_segment_empty(void);
+
+/**
+ * @brief Read the next record
+ *
+ * @param buf Buffer for the record
+ * @param size Buffer size
+ * @param len_out Pointer to store the record length
+ * @param released_out Pointer to store whether the record was released
+ *                     before the last reboot
+ * @return 0 on success, -ENODATA when all records were read
+ */
+int spool_read(void *buf, size_t size, size_t *len_out, bool *released_out);
+
+/**
+ * @brief Release the records read so far
+ *
+ * Segments that were read completely are deleted and the release
+ * position is persisted.
+ *
+ * @return 0 on success, negative errno on failure
+ */
+int spool_release(void);
+
+/**
+ * @brief Return the reader to the last release
+ */
+void spool_rewind(void);
+
+/**
+ * @brief Get the spool statistics
+ *
+ * @param stats_out Pointer to store the statistics
+ */
+void spool_get_stats(struct spool_stats *stats_out);
+
+#else
+
+static inline int spool_init(void)
+{
+    return 0;
+}
+
+static inline int spool_append(const void *data, size_t len, int64_t timestamp)
+{
+    ARG_UNUSED(data);
+    ARG_UNUSED(len);
+    ARG_UNUSED(timestamp);
+    return -ENOTSUP;
+}
+
+static inline void spool_set_drop_cb(spool_drop_cb_t cb)
+{
+    ARG_UNUSED(cb);
+}
+
+static inline bool spool_segment_empty(void)
+{
+    return true;
+}
+
+static inline int spool_read(void *buf, size_t size, size_t *len_out, bool *released_out)
+{
+    ARG_UNUSED(buf);
+    ARG_UNUSED(size);
+    ARG_UNUSED(len_out);
+    ARG_UNUSED(released_out);
+    return -ENODATA;
+}
+
+static inline int spool_release(void)
+{
+    return 0;
+}
+
+static inline void spool_rewind(void)
+{
+}
+
+static inline void spool_get_stats(struct spool_stats *stats_out)
+{
+    memset(stats_out, 0, sizeof(*stats_out));
+}
+
+#endif /* CONFIG_GROW_SPOOL */
+
+#endif /* SPOOL_H */
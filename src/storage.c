@@ -3,9 +3,12 @@
 #include <zephyr/fs/nvs.h>
 #include <zephyr/logging/log.h>
 #include <zephyr/storage/flash_map.h>
+#include <zephyr/sys/crc.h>
 #include <string.h>
 
 #include "storage.h"
+#include "perf.h"
+#include "mem_monitor.h"
 
 LOG_MODULE_REGISTER(storage, CONFIG_LOG_DEFAULT_LEVEL);
 
@@ -18,148 +21,1745 @@ LOG_MODULE_REGISTER(storage, CONFIG_LOG_DEFAULT_LEVEL);
 #define NVS_SECTOR_COUNT 6
 #define NVS_SECTOR_OFFSET FLASH_AREA_OFFSET(FLASH_PARTITION)
 
-/* Settings keys */
-#define WIFI_SSID_KEY "wifi/ssid"
-#define WIFI_PASSWORD_KEY "wifi/password"
-#define PLANT_NAME_KEY "plant/name"
-#define PLANT_VARIETY_KEY "plant/variety"
-#define PROVISIONED_KEY "device/provisioned"
+/* Key layout, STORAGE_KEY_LAYOUT_VERSION holds the one in flash */
+#define STORAGE_LAYOUT 1
+
+/* Registered keys and the string keys older firmware stored them under */
+static const struct {
+    uint16_t id;
+    const char *legacy;
+} registry[] = {
+#define STORAGE_KEY_ENTRY(name, id, legacy) { id, legacy },
+    STORAGE_KEYS(STORAGE_KEY_ENTRY)
+#undef STORAGE_KEY_ENTRY
+};
+
+/* Dynamic key namespaces */
+struct storage_ns {
+    uint16_t base;
+    uint8_t slots;
+};
+
+static const struct storage_ns namespaces[] = {
+#define STORAGE_NS_ENTRY(name, base, slots) [STORAGE_NS_##name] = { base, slots },
+    STORAGE_NAMESPACES(STORAGE_NS_ENTRY)
+#undef STORAGE_NS_ENTRY
+};
+
+/* NVS IDs of the name and the value of a namespace slot */
+#define NS_NAME_ID(space, slot) ((space)->base + 2 * (slot))
+#define NS_VALUE_ID(space, slot) ((space)->base + 2 * (slot) + 1)
+
+/*
+ * The name entry of a slot holds the name, a NUL and the write sequence
+ * of the slot. Names written by older firmware have no sequence and
+ * count as the oldest.
+ */
+#define NS_ENTRY_MAX (STORAGE_NAME_MAX + 1 + sizeof(uint32_t))
+
+/* Result of probing a namespace */
+struct ns_scan {
+    int free;           /* First free slot, -1 if none */
+    int oldest;         /* Least recently written slot, -1 if none */
+    uint32_t last_seq;  /* Newest write sequence */
+};
+
+#define STORAGE_KEY_CHECK(name, id, legacy) \
+    BUILD_ASSERT(id > 0 && id < STORAGE_REGISTRY_END, "Key " #name " outside the registry");
+STORAGE_KEYS(STORAGE_KEY_CHECK)
+#undef STORAGE_KEY_CHECK
+
+#define STORAGE_NS_CHECK(name, base, slots) \
+    BUILD_ASSERT(slots > 0 && base + 2 * slots <= STORAGE_REGISTRY_END, \
+                 "Namespace " #name " outside the registry");
+STORAGE_NAMESPACES(STORAGE_NS_CHECK)
+#undef STORAGE_NS_CHECK
+
+/* Largest value moved from a legacy key at boot */
+#define MIGRATE_VALUE_MAX 128
 
 /* Static NVS instance */
 static struct nvs_fs nvs;
 static bool storage_initialized = false;
 
+/* Write statistics, updated from several threads */
+static atomic_t stat_writes;
+static atomic_t stat_bytes_written;
+static atomic_t stat_write_errors;
+static atomic_t stat_coalesced;
+
+#if defined(CONFIG_GROW_STORAGE_WRITE_BACK)
+
+/* Pool allocation granularity */
+#define WB_ALIGN 8
+
+/*
+ * Write-back cache entry
+ *
+ * Values live back to back in the pool in entry order, each in a slot
+ * of 'capacity' bytes. A dirty value differs from the one in flash. A
+ * deleted entry holds no value and waits for the worker to delete the
+ * key from flash.
+ */
+struct wb_entry {
+    uint16_t id;
+    uint16_t len;
+    uint16_t capacity;
+    bool dirty;
+    bool deleted;
+};
+
+static struct wb_entry wb_entries[CONFIG_GROW_STORAGE_WRITE_BACK_ENTRIES];
+static uint8_t wb_pool[CONFIG_GROW_STORAGE_WRITE_BACK_SIZE] __aligned(WB_ALIGN);
+static int wb_count;
+static size_t wb_used;
+
+/* Copy of the value the worker is writing, the cache stays unlocked meanwhile */
+static uint8_t wb_staging[CONFIG_GROW_STORAGE_MAX_CACHED_VALUE];
+
+/* Serialises the cache, held briefly */
+K_MUTEX_DEFINE(wb_lock);
+
+/* Serialises flash updates so they land in the order they were made */
+K_MUTEX_DEFINE(flash_lock);
+
+/* Storage worker requests */
+enum storage_op {
+    STORAGE_OP_WRITE,   /* Write a cached value if it is dirty */
+    STORAGE_OP_DELETE,  /* Delete a key marked deleted in the cache */
+    STORAGE_OP_SYNC,    /* Write all dirty values */
+    STORAGE_OP_WAKE,    /* Pick up a new flush deadline */
+};
+
+struct storage_request {
+    uint8_t op;
+    uint16_t id;
+    storage_done_cb_t cb;
+    void *user_data;
+    struct k_sem *done;     /* STORAGE_OP_SYNC */
+    int *result;            /* STORAGE_OP_SYNC */
+};
+
+K_MSGQ_DEFINE(storage_msgq, sizeof(struct storage_request),
+              CONFIG_GROW_STORAGE_QUEUE_DEPTH, 4);
+
+/* Uptime of the next periodic flush, 0 when nothing is dirty */
+static int64_t flush_deadline;
+
+static void storage_thread(void *p1, void *p2, void *p3);
+
+K_THREAD_DEFINE(storage_tid, CONFIG_GROW_STORAGE_STACK_SIZE,
+                storage_thread, NULL, NULL, NULL,
+                CONFIG_GROW_STORAGE_PRIORITY, 0, 0);
+
+#if defined(CONFIG_GROW_STORAGE_SNAPSHOT)
+
+/* Snapshot record format version */
+#define SNAPSHOT_VERSION 1
+
+/* Entry length of a value that did not fit, it is read from its key */
+#define SNAPSHOT_LEN_EXTERNAL 0xFFFF
+
+/* Copy a snapshot sequence number is written to */
+#define SNAPSHOT_ID(seq) ((seq) & 1 ? STORAGE_KEY_SNAPSHOT_B : STORAGE_KEY_SNAPSHOT_A)
+
+/*
+ * Boot state snapshot record
+ *
+ * The header is followed by an entry for each snapshot key that holds a
+ * value, a key without an entry holds none. The CRC covers the header
+ * fields before it and the entries.
+ */
+struct snapshot_header {
+    uint8_t version;
+    uint8_t reserved;
+    uint16_t len;       /* Entry bytes after the header */
+    uint32_t seq;       /* Higher is newer */
+    uint32_t crc;
+} __packed;
+
+struct snapshot_entry {
+    uint16_t id;
+    uint16_t len;       /* Value bytes that follow, or SNAPSHOT_LEN_EXTERNAL */
+} __packed;
+
+static const uint16_t snapshot_ids[] = {
+#define STORAGE_SNAPSHOT_ID(name) STORAGE_KEY_##name,
+    STORAGE_SNAPSHOT_KEYS(STORAGE_SNAPSHOT_ID)
+#undef STORAGE_SNAPSHOT_ID
+};
+
+BUILD_ASSERT(sizeof(struct snapshot_header) +
+             ARRAY_SIZE(snapshot_ids) * sizeof(struct snapshot_entry) <=
+             CONFIG_GROW_STORAGE_SNAPSHOT_SIZE, "Snapshot too small for its keys");
+
+static uint8_t snapshot_buf[CONFIG_GROW_STORAGE_SNAPSHOT_SIZE];
+
+/* Sequence number of the newest snapshot in flash */
+static uint32_t snapshot_seq;
+
+/*
+ * The snapshot in flash holds the current value of every snapshot key.
+ * Guarded by wb_lock.
+ */
+static bool snapshot_current;
+
+/*
+ * snapshot_buf holds the snapshot loaded at boot, which serves loads
+ * until it is replaced. Guarded by wb_lock.
+ */
+static bool snapshot_loaded;
+
+#endif /* CONFIG_GROW_STORAGE_SNAPSHOT */
+
+#endif /* CONFIG_GROW_STORAGE_WRITE_BACK */
+
+static int migrate_layout(void);
+
+#if defined(CONFIG_GROW_STORAGE_SNAPSHOT)
+static void snapshot_load(void);
+#endif
+
+/**
+ * @brief Initialize the storage subsystem
+ *
+ * @return 0 on success, negative errno on failure
+ */
+int storage_init(void)
+{
+    int rc;
+    const struct flash_area *fa;
+    
+    if (storage_initialized) {
+        return 0;
+    }
+    
+    /* Setup NVS */
+    nvs.flash_device = FIXED_PARTITION_DEVICE(FLASH_PARTITION);
+    if (nvs.flash_device == NULL) {
+        LOG_ERR("Failed to get flash device");
+        return -ENODEV;
+    }
+    
+    nvs.offset = NVS_SECTOR_OFFSET;
+    nvs.sector_size = NVS_SECTOR_SIZE;
+    nvs.sector_count = NVS_SECTOR_COUNT;
+    
+    rc = nvs_mount(&nvs);
+    if (rc < 0) {
+        LOG_ERR("Flash init failed: %d", rc);
+        return rc;
+    }
+    
+    /* Initialize settings subsystem */
+    rc = settings_subsys_init();
+    if (rc < 0) {
+        LOG_ERR("Settings init failed: %d", rc);
+        return rc;
+    }
+    
+    rc = migrate_layout();
+    if (rc < 0) {
+        LOG_ERR("Key migration failed: %d", rc);
+        return rc;
+    }
+    
+#if defined(CONFIG_GROW_STORAGE_SNAPSHOT)
+    snapshot_load();
+#endif
+    
+    LOG_INF("Storage subsystem initialized");
+    storage_initialized = true;
+    
+#if defined(CONFIG_GROW_STORAGE_WRITE_BACK)
+    mem_monitor_register("storage", "wb_pool", sizeof(wb_pool));
+    mem_monitor_register("storage", "wb_staging", sizeof(wb_staging));
+#endif
+#if defined(CONFIG_GROW_STORAGE_SNAPSHOT)
+    mem_monitor_register("storage", "snapshot_buf", sizeof(snapshot_buf));
+#endif
+    
+    return 0;
+}
+
+/**
+ * @brief Write a value to NVS
+ */
+static int nvs_save(uint16_t id, const void *value, size_t value_len)
+{
+    uint32_t start = perf_begin();
+    int rc = nvs_write(&nvs, id, value, value_len);
+    perf_end(PERF_STORAGE_SAVE, start);
+    if (rc < 0) {
+        atomic_inc(&stat_write_errors);
+        LOG_ERR("Failed to write to NVS: %d", rc);
+        return rc;
+    }
+    
+    /* NVS returns 0 when the stored value was already identical */
+    atomic_inc(&stat_writes);
+    atomic_add(&stat_bytes_written, rc);
+    
+    return 0;
+}
+
+/**
+ * @brief Delete a value from NVS
+ */
+static int nvs_remove(uint16_t id)
+{
+    int rc = nvs_delete(&nvs, id);
+    if (rc < 0) {
+        LOG_ERR("Failed to delete from NVS: %d", rc);
+        return rc;
+    }
+    
+    return 0;
+}
+
+/**
+ * @brief Check whether an NVS ID belongs to the key registry
+ *
+ * Two keys or namespaces sharing an ID fail to build as duplicate cases.
+ */
+static bool registered_id(uint16_t id)
+{
+    switch (id) {
+#define STORAGE_KEY_CASE(name, id, legacy) case id:
+    STORAGE_KEYS(STORAGE_KEY_CASE)
+#undef STORAGE_KEY_CASE
+#define STORAGE_NS_CASE(name, base, slots) case base ... base + 2 * slots - 1:
+    STORAGE_NAMESPACES(STORAGE_NS_CASE)
+#undef STORAGE_NS_CASE
+        return true;
+    default:
+        return false;
+    }
+}
+
+/**
+ * @brief Move the values of older firmware to the registered keys
+ *
+ * Runs once, before the write-back cache is used. Registered IDs that
+ * receive no value are cleared, older firmware may have stored a hashed
+ * key there.
+ */
+static int migrate_layout(void)
+{
+    uint8_t version;
+    uint8_t value[MIGRATE_VALUE_MAX];
+    int rc;
+    
+    rc = nvs_read(&nvs, STORAGE_KEY_LAYOUT_VERSION, &version, sizeof(version));
+    if (rc == sizeof(version) && version == STORAGE_LAYOUT) {
+        return 0;
+    }
+    
+    for (int i = 0; i < (int)ARRAY_SIZE(registry); i++) {
+        uint16_t id = registry[i].id;
+        
+        rc = -ENOENT;
+        if (registry[i].legacy) {
+            uint16_t old_id = crc16_ccitt(0, (const uint8_t *)registry[i].legacy,
+                                          strlen(registry[i].legacy));
+            
+            rc = nvs_read(&nvs, old_id, value, sizeof(value));
+            if (rc > (int)sizeof(value)) {
+                LOG_WRN("Dropping oversized %s", registry[i].legacy);
+                rc = -ENOENT;
+            }
+            if (rc >= 0) {
+                rc = nvs_save(id, value, rc);
+            }
+            if (rc == 0) {
+                rc = nvs_remove(old_id);
+            }
+        }
+        
+        if (rc == -ENOENT) {
+            rc = nvs_remove(id);
+        }
+        if (rc < 0) {
+            return rc;
+        }
+    }
+    
+    for (int ns = 0; ns < STORAGE_NS_COUNT; ns++) {
+        for (int i = 0; i < 2 * namespaces[ns].slots; i++) {
+            rc = nvs_remove(namespaces[ns].base + i);
+            if (rc < 0) {
+                return rc;
+            }
+        }
+    }
+    
+    version = STORAGE_LAYOUT;
+    rc = nvs_save(STORAGE_KEY_LAYOUT_VERSION, &version, sizeof(version));
+    if (rc < 0) {
+        return rc;
+    }
+    
+    LOG_INF("Moved keys to layout %d", STORAGE_LAYOUT);
+    return 0;
+}
+
+#if defined(CONFIG_GROW_STORAGE_WRITE_BACK)
+
+/**
+ * @brief Get the pool slot of an entry
+ */
+static uint8_t *wb_data(int index)
+{
+    size_t offset = 0;
+    
+    for (int i = 0; i < index; i++) {
+        offset += wb_entries[i].capacity;
+    }
+    
+    return &wb_pool[offset];
+}
+
+/**
+ * @brief Find the entry of an NVS ID
+ *
+ * @return Entry index, -1 if the ID is not cached
+ */
+static int wb_find(uint16_t id)
+{
+    for (int i = 0; i < wb_count; i++) {
+        if (wb_entries[i].id == id) {
+            return i;
+        }
+    }
+    
+    return -1;
+}
+
+/**
+ * @brief Resize the pool slot of an entry, moving the following slots
+ *
+ * @return 0 on success, -ENOMEM if the pool is too small
+ */
+static int wb_resize(int index, size_t capacity)
+{
+    struct wb_entry *entry = &wb_entries[index];
+    uint8_t *next = wb_data(index) + entry->capacity;
+    size_t tail = &wb_pool[wb_used] - next;
+    
+    capacity = ROUND_UP(capacity, WB_ALIGN);
+    if (capacity > UINT16_MAX ||
+        wb_used - entry->capacity + capacity > sizeof(wb_pool)) {
+        return -ENOMEM;
+    }
+    
+    memmove(next - entry->capacity + capacity, next, tail);
+    wb_used = wb_used - entry->capacity + capacity;
+    entry->capacity = capacity;
+    
+    return 0;
+}
+
+/**
+ * @brief Remove an entry and release its pool slot
+ */
+static void wb_remove(int index)
+{
+    wb_resize(index, 0);
+    
+    memmove(&wb_entries[index], &wb_entries[index + 1],
+            (wb_count - index - 1) * sizeof(wb_entries[0]));
+    wb_count--;
+}
+
+/**
+ * @brief Find or add the entry of an NVS ID
+ *
+ * @return Entry index, -ENOMEM if all entries are used
+ */
+static int wb_get(uint16_t id)
+{
+    int index = wb_find(id);
+    
+    if (index < 0) {
+        if (wb_count == ARRAY_SIZE(wb_entries)) {
+            return -ENOMEM;
+        }
+        
+        index = wb_count++;
+        wb_entries[index] = (struct wb_entry){ .id = id };
+    }
+    
+    return index;
+}
+
+/**
+ * @brief Arm the periodic flush for a newly dirty value
+ */
+static void wb_schedule_flush(void)
+{
+    if (flush_deadline == 0) {
+        flush_deadline = k_uptime_get() + CONFIG_GROW_STORAGE_FLUSH_INTERVAL_SEC * 1000LL;
+        
+        /* Wake the worker to pick up the deadline */
+        struct storage_request req = { .op = STORAGE_OP_WAKE };
+        k_msgq_put(&storage_msgq, &req, K_NO_WAIT);
+    }
+}
+
+#if defined(CONFIG_GROW_STORAGE_SNAPSHOT)
+
+static int load_id(uint16_t id, void *value_out, size_t *value_len_inout);
+
+/**
+ * @brief Check whether a key is kept in the snapshot
+ */
+static bool snapshot_key(uint16_t id)
+{
+    switch (id) {
+#define STORAGE_SNAPSHOT_CASE(name) case STORAGE_KEY_##name:
+    STORAGE_SNAPSHOT_KEYS(STORAGE_SNAPSHOT_CASE)
+#undef STORAGE_SNAPSHOT_CASE
+        return true;
+    default:
+        return false;
+    }
+}
+
+/**
+ * @brief Note a change of a cached value
+ *
+ * Called with wb_lock held.
+ */
+static void snapshot_changed(uint16_t id)
+{
+    if (snapshot_key(id)) {
+        snapshot_current = false;
+    }
+}
+
+/**
+ * @brief Check whether a key has to wait for a snapshot update
+ *
+ * Called with wb_lock held.
+ */
+static bool snapshot_stale(uint16_t id)
+{
+    return snapshot_key(id) && !snapshot_current;
+}
+
+/**
+ * @brief Compute the CRC of the record in snapshot_buf
+ */
+static uint32_t snapshot_crc(const struct snapshot_header *hdr)
+{
+    uint32_t crc = crc32_ieee((const uint8_t *)hdr, offsetof(struct snapshot_header, crc));
+    
+    return crc32_ieee_update(crc, &snapshot_buf[sizeof(*hdr)], hdr->len);
+}
+
+/**
+ * @brief Find a key in the record in snapshot_buf
+ *
+ * @return 0 if found, -ENOENT if the key holds no value, -EFBIG if the
+ *         value did not fit and is only in its key
+ */
+static int snapshot_find(uint16_t id, const uint8_t **value_out, size_t *len_out)
+{
+    struct snapshot_header hdr;
+    struct snapshot_entry entry;
+    size_t pos = sizeof(hdr);
+    
+    memcpy(&hdr, snapshot_buf, sizeof(hdr));
+    
+    while (pos + sizeof(entry) <= sizeof(hdr) + hdr.len) {
+        memcpy(&entry, &snapshot_buf[pos], sizeof(entry));
+        pos += sizeof(entry);
+        
+        if (entry.id == id) {
+            if (entry.len == SNAPSHOT_LEN_EXTERNAL) {
+                return -EFBIG;
+            }
+            *value_out = &snapshot_buf[pos];
+            *len_out = entry.len;
+            return 0;
+        }
+        
+        if (entry.len != SNAPSHOT_LEN_EXTERNAL) {
+            pos += entry.len;
+        }
+    }
+    
+    return -ENOENT;
+}
+
+/**
+ * @brief Load a value from the snapshot loaded at boot
+ *
+ * Called with wb_lock held.
+ *
+ * @return true if the snapshot answered, with the result in rc_out
+ */
+static bool snapshot_lookup(uint16_t id, void *value_out, size_t *value_len_inout,
+                            int *rc_out)
+{
+    const uint8_t *value;
+    size_t len;
+    
+    if (!snapshot_loaded || !snapshot_key(id)) {
+        return false;
+    }
+    
+    int rc = snapshot_find(id, &value, &len);
+    if (rc == -EFBIG) {
+        return false;
+    }
+    
+    if (rc == 0) {
+        memcpy(value_out, value, MIN(len, *value_len_inout));
+        *value_len_inout = len;
+    }
+    
+    *rc_out = rc;
+    return true;
+}
+
+/**
+ * @brief Load the newest snapshot at boot
+ *
+ * A copy that is present but invalid may be newer than the keys, so
+ * then both copies are deleted and loads read the keys.
+ */
+static void snapshot_load(void)
+{
+    struct snapshot_header hdr[2];
+    int newest = -1;
+    int in_buf = -1;
+    
+    for (int i = 0; i < 2; i++) {
+        int rc = nvs_read(&nvs, SNAPSHOT_ID(i), &hdr[i], sizeof(hdr[i]));
+        if (rc == -ENOENT) {
+            continue;
+        }
+        
+        bool valid = rc >= (int)sizeof(hdr[i]) && rc <= (int)sizeof(snapshot_buf) &&
+                     hdr[i].version == SNAPSHOT_VERSION &&
+                     rc == (int)(sizeof(hdr[i]) + hdr[i].len);
+        if (valid) {
+            rc = nvs_read(&nvs, SNAPSHOT_ID(i), snapshot_buf, sizeof(snapshot_buf));
+            in_buf = i;
+            valid = rc == (int)(sizeof(hdr[i]) + hdr[i].len) &&
+                    snapshot_crc(&hdr[i]) == hdr[i].crc;
+        }
+        
+        if (!valid) {
+            /* The other copy may be older than the keys */
+            LOG_WRN("Boot snapshot %c invalid, loading keys", 'A' + i);
+            nvs_remove(STORAGE_KEY_SNAPSHOT_A);
+            nvs_remove(STORAGE_KEY_SNAPSHOT_B);
+            newest = -1;
+            break;
+        }
+        
+        if (newest < 0 || hdr[i].seq > hdr[newest].seq) {
+            newest = i;
+        }
+    }
+    
+    if (newest >= 0 && newest != in_buf) {
+        /* Both copies were read, the older one last */
+        nvs_read(&nvs, SNAPSHOT_ID(newest), snapshot_buf, sizeof(snapshot_buf));
+    }
+    
+    k_mutex_lock(&wb_lock, K_FOREVER);
+    if (newest >= 0) {
+        snapshot_seq = hdr[newest].seq;
+        snapshot_loaded = true;
+        snapshot_current = true;
+        LOG_INF("Loaded boot snapshot %u", snapshot_seq);
+    } else {
+        /* Written with the next flush */
+        wb_schedule_flush();
+    }
+    k_mutex_unlock(&wb_lock);
+}
+
+/**
+ * @brief Stop serving loads from the snapshot loaded at boot
+ *
+ * The snapshot may be newer than the keys, so its values are written to
+ * them first. NVS skips the ones that are unchanged. Called with
+ * flash_lock held.
+ */
+static void snapshot_release(void)
+{
+    k_mutex_lock(&wb_lock, K_FOREVER);
+    bool loaded = snapshot_loaded;
+    snapshot_loaded = false;
+    k_mutex_unlock(&wb_lock);
+    
+    if (!loaded) {
+        return;
+    }
+    
+    for (int i = 0; i < (int)ARRAY_SIZE(snapshot_ids); i++) {
+        const uint8_t *value;
+        size_t len;
+        
+        int rc = snapshot_find(snapshot_ids[i], &value, &len);
+        if (rc == 0) {
+            nvs_save(snapshot_ids[i], value, len);
+        } else if (rc == -ENOENT) {
+            nvs_remove(snapshot_ids[i]);
+        }
+    }
+}
+
+/**
+ * @brief Write a snapshot of the current values
+ *
+ * Runs on the storage thread with flash_lock held, before any snapshot
+ * key is written, so the snapshot is never older than the keys. It goes
+ * to the other copy, an interrupted write leaves the previous one.
+ *
+ * @return 0 on success, negative errno on failure
+ */
+static int snapshot_write(void)
+{
+    struct snapshot_header hdr = { .version = SNAPSHOT_VERSION };
+    size_t pos = sizeof(hdr);
+    int rc;
+    
+    snapshot_release();
+    
+    /* A save from here on makes the snapshot stale again */
+    k_mutex_lock(&wb_lock, K_FOREVER);
+    snapshot_current = true;
+    k_mutex_unlock(&wb_lock);
+    
+    for (int i = 0; i < (int)ARRAY_SIZE(snapshot_ids); i++) {
+        struct snapshot_entry entry = { .id = snapshot_ids[i] };
+        
+        /* Keep room for the entries of the remaining keys */
+        size_t room = sizeof(snapshot_buf) - pos -
+                      (ARRAY_SIZE(snapshot_ids) - i) * sizeof(entry);
+        size_t len = room;
+        
+        rc = load_id(entry.id, &snapshot_buf[pos + sizeof(entry)], &len);
+        if (rc == -ENOENT) {
+            continue;
+        }
+        if (rc < 0) {
+            goto fail;
+        }
+        
+        entry.len = len <= room ? len : SNAPSHOT_LEN_EXTERNAL;
+        memcpy(&snapshot_buf[pos], &entry, sizeof(entry));
+        pos += sizeof(entry) + (len <= room ? len : 0);
+    }
+    
+    hdr.len = pos - sizeof(hdr);
+    hdr.seq = snapshot_seq + 1;
+    hdr.crc = snapshot_crc(&hdr);
+    memcpy(snapshot_buf, &hdr, sizeof(hdr));
+    
+    rc = nvs_save(SNAPSHOT_ID(hdr.seq), snapshot_buf, pos);
+    if (rc < 0) {
+        goto fail;
+    }
+    
+    snapshot_seq = hdr.seq;
+    return 0;
+    
+fail:
+    LOG_ERR("Failed to write boot snapshot: %d", rc);
+    k_mutex_lock(&wb_lock, K_FOREVER);
+    snapshot_current = false;
+    k_mutex_unlock(&wb_lock);
+    return rc;
+}
+
+/**
+ * @brief Write the snapshot if a snapshot key changed since the last one
+ *
+ * Called with flash_lock held.
+ */
+static int snapshot_update(void)
+{
+    k_mutex_lock(&wb_lock, K_FOREVER);
+    bool stale = !snapshot_current;
+    k_mutex_unlock(&wb_lock);
+    
+    return stale ? snapshot_write() : 0;
+}
+
+/**
+ * @brief Drop the snapshot before a key is written outside a flush
+ *
+ * Boot reads the keys until the next flush writes a new snapshot.
+ * Called with flash_lock held.
+ *
+ * @return 0 on success, negative errno on failure
+ */
+static int snapshot_invalidate(uint16_t id)
+{
+    if (!snapshot_key(id)) {
+        return 0;
+    }
+    
+    snapshot_release();
+    
+    k_mutex_lock(&wb_lock, K_FOREVER);
+    snapshot_current = false;
+    wb_schedule_flush();
+    k_mutex_unlock(&wb_lock);
+    
+    int rc = nvs_remove(STORAGE_KEY_SNAPSHOT_A);
+    if (rc == 0) {
+        rc = nvs_remove(STORAGE_KEY_SNAPSHOT_B);
+    }
+    
+    return rc;
+}
+
+#else
+
+static void snapshot_changed(uint16_t id)
+{
+    ARG_UNUSED(id);
+}
+
+static bool snapshot_stale(uint16_t id)
+{
+    ARG_UNUSED(id);
+    return false;
+}
+
+static int snapshot_write(void)
+{
+    return 0;
+}
+
+static int snapshot_update(void)
+{
+    return 0;
+}
+
+static int snapshot_invalidate(uint16_t id)
+{
+    ARG_UNUSED(id);
+    return 0;
+}
+
+#endif /* CONFIG_GROW_STORAGE_SNAPSHOT */
+
+/**
+ * @brief Store a value in the cache
+ *
+ * @return 0 if the value is cached, -ENOMEM if it has to be written through
+ */
+static int wb_store(uint16_t id, const void *value, size_t value_len)
+{
+    int index = wb_find(id);
+    
+    if (index >= 0 && !wb_entries[index].deleted &&
+        wb_entries[index].len == value_len &&
+        memcmp(wb_data(index), value, value_len) == 0) {
+        /* Unchanged, nothing to write */
+        atomic_inc(&stat_coalesced);
+        return 0;
+    }
+    
+    if (value_len > sizeof(wb_staging)) {
+        return -ENOMEM;
+    }
+    
+    index = wb_get(id);
+    if (index < 0) {
+        return index;
+    }
+    
+    struct wb_entry *entry = &wb_entries[index];
+    
+    if (entry->capacity < value_len && wb_resize(index, value_len) < 0) {
+        return -ENOMEM;
+    }
+    
+    if (entry->dirty) {
+        /* The previous value never reaches flash */
+        atomic_inc(&stat_coalesced);
+    }
+    
+    memcpy(wb_data(index), value, value_len);
+    entry->len = value_len;
+    entry->deleted = false;
+    snapshot_changed(id);
+    
+    if (!entry->dirty) {
+        entry->dirty = true;
+        wb_schedule_flush();
+    }
+    
+    return 0;
+}
+
+/**
+ * @brief Write one cached value if it is dirty
+ *
+ * Runs on the storage thread. The value is copied out so savers are not
+ * blocked while flash is written or erased.
+ *
+ * @return 0 on success, negative errno on failure
+ */
+static int wb_write(uint16_t id)
+{
+    size_t len = 0;
+    int rc = 0;
+    
+    bool write;
+    
+    k_mutex_lock(&flash_lock, K_FOREVER);
+    
+    for (;;) {
+        k_mutex_lock(&wb_lock, K_FOREVER);
+        int index = wb_find(id);
+        write = index >= 0 && wb_entries[index].dirty;
+        bool stale = write && snapshot_stale(id);
+        if (write && !stale) {
+            len = wb_entries[index].len;
+            memcpy(wb_staging, wb_data(index), len);
+            wb_entries[index].dirty = false;
+        }
+        k_mutex_unlock(&wb_lock);
+        
+        if (!stale) {
+            break;
+        }
+        
+        /* The snapshot goes first, the value may change meanwhile */
+        rc = snapshot_write();
+        if (rc < 0) {
+            write = false;
+            break;
+        }
+    }
+    
+    if (write) {
+        rc = nvs_save(id, wb_staging, len);
+        
+        if (rc < 0) {
+            /* Retried with the next flush unless it was replaced meanwhile */
+            k_mutex_lock(&wb_lock, K_FOREVER);
+            int index = wb_find(id);
+            if (index >= 0 && !wb_entries[index].deleted) {
+                wb_entries[index].dirty = true;
+            }
+            k_mutex_unlock(&wb_lock);
+        }
+    }
+    
+    k_mutex_unlock(&flash_lock);
+    
+    return rc;
+}
+
+/**
+ * @brief Write all dirty cached values
+ *
+ * @return 0 on success, the first error otherwise
+ */
+static int wb_flush(void)
+{
+    int ret = 0;
+    
+    k_mutex_lock(&wb_lock, K_FOREVER);
+    flush_deadline = 0;
+    k_mutex_unlock(&wb_lock);
+    
+    /* Also rewrites a snapshot dropped by a write outside a flush */
+    k_mutex_lock(&flash_lock, K_FOREVER);
+    ret = snapshot_update();
+    k_mutex_unlock(&flash_lock);
+    
+    for (int i = 0; ; i++) {
+        uint16_t id = 0;
+        
+        /* Entries may be added or removed while a value is written */
+        k_mutex_lock(&wb_lock, K_FOREVER);
+        while (i < wb_count && !wb_entries[i].dirty) {
+            i++;
+        }
+        bool found = i < wb_count;
+        if (found) {
+            id = wb_entries[i].id;
+        }
+        k_mutex_unlock(&wb_lock);
+        
+        if (!found) {
+            break;
+        }
+        
+        int rc = wb_write(id);
+        if (rc < 0 && ret == 0) {
+            ret = rc;
+        }
+    }
+    
+    if (ret < 0) {
+        LOG_ERR("Failed to flush cached values: %d", ret);
+        
+        k_mutex_lock(&wb_lock, K_FOREVER);
+        wb_schedule_flush();
+        k_mutex_unlock(&wb_lock);
+    }
+    
+    return ret;
+}
+
+/**
+ * @brief Delete a key marked deleted in the cache
+ *
+ * @return 0 on success, negative errno on failure
+ */
+static int wb_delete(uint16_t id)
+{
+    int rc = 0;
+    
+    k_mutex_lock(&flash_lock, K_FOREVER);
+    
+    k_mutex_lock(&wb_lock, K_FOREVER);
+    int index = wb_find(id);
+    bool pending = index >= 0 && wb_entries[index].deleted;
+    bool stale = pending && snapshot_stale(id);
+    k_mutex_unlock(&wb_lock);
+    
+    if (stale) {
+        rc = snapshot_write();
+    }
+    
+    /* A value saved after the delete is still written afterwards */
+    if (rc == 0) {
+        rc = nvs_remove(id);
+    }
+    
+    if (pending && rc == 0) {
+        k_mutex_lock(&wb_lock, K_FOREVER);
+        index = wb_find(id);
+        if (index >= 0 && wb_entries[index].deleted) {
+            wb_remove(index);
+        }
+        k_mutex_unlock(&wb_lock);
+    }
+    
+    k_mutex_unlock(&flash_lock);
+    
+    return rc;
+}
+
+/**
+ * @brief Storage worker, writes cached values to flash
+ *
+ * Runs at low priority so NVS writes and sector erases never hold up
+ * the pipeline threads.
+ */
+static void storage_thread(void *p1, void *p2, void *p3)
+{
+    struct storage_request req;
+    
+    ARG_UNUSED(p1);
+    ARG_UNUSED(p2);
+    ARG_UNUSED(p3);
+    
+    for (;;) {
+        k_timeout_t timeout = K_FOREVER;
+        
+        k_mutex_lock(&wb_lock, K_FOREVER);
+        if (flush_deadline != 0) {
+            timeout = K_MSEC(MAX(flush_deadline - k_uptime_get(), 0));
+        }
+        k_mutex_unlock(&wb_lock);
+        
+        if (k_msgq_get(&storage_msgq, &req, timeout) < 0) {
+            wb_flush();
+            continue;
+        }
+        
+        int rc = 0;
+        
+        switch (req.op) {
+        case STORAGE_OP_WRITE:
+            rc = wb_write(req.id);
+            break;
+        case STORAGE_OP_DELETE:
+            rc = wb_delete(req.id);
+            break;
+        case STORAGE_OP_SYNC:
+            rc = wb_flush();
+            break;
+        default:
+            break;
+        }
+        
+        if (req.cb) {
+            req.cb(rc, req.user_data);
+        }
+        
+        if (req.done) {
+            *req.result = rc;
+            k_sem_give(req.done);
+        }
+    }
+}
+
+#endif /* CONFIG_GROW_STORAGE_WRITE_BACK */
+
+/**
+ * @brief Initialize storage on first use
+ */
+static int storage_ready(void)
+{
+    return storage_initialized ? 0 : storage_init();
+}
+
+/**
+ * @brief Save a value under an NVS ID
+ *
+ * With the write-back cache the value is kept in RAM and written on the
+ * next flush, saving a value identical to the cached one writes nothing.
+ * Values that do not fit the cache are written through.
+ */
+static int save_id(uint16_t id, const void *value, size_t value_len)
+{
+#if defined(CONFIG_GROW_STORAGE_WRITE_BACK)
+    k_mutex_lock(&wb_lock, K_FOREVER);
+    int rc = wb_store(id, value, value_len);
+    k_mutex_unlock(&wb_lock);
+    
+    if (rc == 0) {
+        return 0;
+    }
+    
+    /* Write through, after any pending update of the key */
+    k_mutex_lock(&flash_lock, K_FOREVER);
+    
+    rc = snapshot_invalidate(id);
+    if (rc == 0) {
+        k_mutex_lock(&wb_lock, K_FOREVER);
+        int index = wb_find(id);
+        if (index >= 0) {
+            wb_remove(index);
+        }
+        k_mutex_unlock(&wb_lock);
+        
+        rc = nvs_save(id, value, value_len);
+    }
+    
+    k_mutex_unlock(&flash_lock);
+    
+    return rc;
+#else
+    return nvs_save(id, value, value_len);
+#endif
+}
+
+/**
+ * @brief Load the value of an NVS ID
+ *
+ * @return 0 on success, -ENOENT if the ID holds no value, negative errno
+ *         on failure
+ */
+static int load_id(uint16_t id, void *value_out, size_t *value_len_inout)
+{
+    int rc;
+    
+#if defined(CONFIG_GROW_STORAGE_WRITE_BACK)
+    /* Cached values and deletes may not have reached flash yet */
+    k_mutex_lock(&wb_lock, K_FOREVER);
+    int index = wb_find(id);
+    if (index >= 0) {
+        struct wb_entry *entry = &wb_entries[index];
+        
+        rc = entry->deleted ? -ENOENT : 0;
+        if (rc == 0) {
+            memcpy(value_out, wb_data(index), MIN(entry->len, *value_len_inout));
+            *value_len_inout = entry->len;
+        }
+        k_mutex_unlock(&wb_lock);
+        return rc;
+    }
+#if defined(CONFIG_GROW_STORAGE_SNAPSHOT)
+    if (snapshot_lookup(id, value_out, value_len_inout, &rc)) {
+        k_mutex_unlock(&wb_lock);
+        return rc;
+    }
+#endif
+    k_mutex_unlock(&wb_lock);
+#endif
+    
+    rc = nvs_read(&nvs, id, value_out, *value_len_inout);
+    if (rc < 0) {
+        if (rc != -ENOENT) {
+            LOG_ERR("Failed to read from NVS: %d", rc);
+        }
+        return rc;
+    }
+    
+    *value_len_inout = rc;
+    return 0;
+}
+
 /**
- * @brief Initialize the storage subsystem
+ * @brief Delete the value of an NVS ID
+ */
+static int delete_id(uint16_t id)
+{
+#if defined(CONFIG_GROW_STORAGE_WRITE_BACK)
+    /* After any pending update of the key */
+    k_mutex_lock(&flash_lock, K_FOREVER);
+    
+    int rc = snapshot_invalidate(id);
+    if (rc == 0) {
+        k_mutex_lock(&wb_lock, K_FOREVER);
+        int index = wb_find(id);
+        if (index >= 0) {
+            wb_remove(index);
+        }
+        k_mutex_unlock(&wb_lock);
+        
+        rc = nvs_remove(id);
+    }
+    
+    k_mutex_unlock(&flash_lock);
+    
+    return rc;
+#else
+    return nvs_remove(id);
+#endif
+}
+
+/**
+ * @brief Get the NVS ID older firmware used for a string key
+ *
+ * @return NVS ID, -EEXIST if it falls on a registered ID
+ */
+static int legacy_id(const char *key)
+{
+    uint16_t id = crc16_ccitt(0, (const uint8_t *)key, strlen(key));
+    
+    if (registered_id(id)) {
+        LOG_ERR("Key %s collides with a registered key", key);
+        return -EEXIST;
+    }
+    
+    return id;
+}
+
+/**
+ * @brief Save a registered value
  *
+ * @param key Registered key
+ * @param value Value to save
+ * @param value_len Length of value
  * @return 0 on success, negative errno on failure
  */
-int storage_init(void)
+int storage_save_key(enum storage_key key, const void *value, size_t value_len)
 {
-    int rc;
-    const struct flash_area *fa;
+    int rc = storage_ready();
+    if (rc < 0) {
+        return rc;
+    }
     
-    if (storage_initialized) {
+    return save_id(key, value, value_len);
+}
+
+/**
+ * @brief Save a registered value without waiting for flash
+ *
+ * Values that do not fit the cache, or when the request queue is full,
+ * are written before returning and the callback is called from the
+ * caller.
+ *
+ * @param key Registered key
+ * @param value Value to save, copied before returning
+ * @param value_len Length of value
+ * @param cb Callback called once the value is in flash, may be NULL
+ * @param user_data User data passed to the callback
+ * @return 0 if the write was queued or done, negative errno on failure
+ */
+int storage_save_async(enum storage_key key, const void *value, size_t value_len,
+                       storage_done_cb_t cb, void *user_data)
+{
+    int rc = storage_ready();
+    if (rc < 0) {
+        return rc;
+    }
+    
+#if defined(CONFIG_GROW_STORAGE_WRITE_BACK)
+    struct storage_request req = {
+        .op = STORAGE_OP_WRITE,
+        .id = key,
+        .cb = cb,
+        .user_data = user_data,
+    };
+    
+    k_mutex_lock(&wb_lock, K_FOREVER);
+    rc = wb_store(key, value, value_len);
+    k_mutex_unlock(&wb_lock);
+    
+    if (rc == 0) {
+        if (k_msgq_put(&storage_msgq, &req, K_NO_WAIT) == 0) {
+            return 0;
+        }
+        
+        /* No room to queue it, written before returning */
+        rc = wb_write(key);
+        if (cb) {
+            cb(rc, user_data);
+        }
+        
+        return rc;
+    }
+#endif
+    
+    /* Too large for the cache, written before returning */
+    rc = save_id(key, value, value_len);
+    if (cb) {
+        cb(rc, user_data);
+    }
+    
+    return rc;
+}
+
+/**
+ * @brief Write all pending values to flash and wait for completion
+ *
+ * @return 0 on success, negative errno on failure
+ */
+int storage_sync(void)
+{
+#if defined(CONFIG_GROW_STORAGE_WRITE_BACK)
+    struct k_sem done;
+    int result = 0;
+    struct storage_request req = {
+        .op = STORAGE_OP_SYNC,
+        .done = &done,
+        .result = &result,
+    };
+    
+    if (!storage_initialized) {
         return 0;
     }
     
-    /* Setup NVS */
-    nvs.flash_device = FIXED_PARTITION_DEVICE(FLASH_PARTITION);
-    if (nvs.flash_device == NULL) {
-        LOG_ERR("Failed to get flash device");
-        return -ENODEV;
+    /* Callbacks run on the worker, which cannot wait for itself */
+    if (k_current_get() == storage_tid) {
+        return wb_flush();
     }
     
-    nvs.offset = NVS_SECTOR_OFFSET;
-    nvs.sector_size = NVS_SECTOR_SIZE;
-    nvs.sector_count = NVS_SECTOR_COUNT;
+    k_sem_init(&done, 0, 1);
+    k_msgq_put(&storage_msgq, &req, K_FOREVER);
+    k_sem_take(&done, K_FOREVER);
     
-    rc = nvs_mount(&nvs);
+    return result;
+#else
+    return 0;
+#endif
+}
+
+/**
+ * @brief Get storage write statistics
+ *
+ * @param stats_out Pointer to store the statistics
+ */
+void storage_get_stats(struct storage_stats *stats_out)
+{
+    if (stats_out) {
+        stats_out->writes = atomic_get(&stat_writes);
+        stats_out->bytes_written = atomic_get(&stat_bytes_written);
+        stats_out->write_errors = atomic_get(&stat_write_errors);
+        stats_out->coalesced = atomic_get(&stat_coalesced);
+    }
+}
+
+/**
+ * @brief Load a registered value
+ *
+ * @param key Registered key
+ * @param value_out Buffer to store the value
+ * @param value_len_inout [in] Size of the buffer, [out] actual size read
+ * @return 0 on success, -ENOENT if the key holds no value, negative
+ *         errno on failure
+ */
+int storage_load_key(enum storage_key key, void *value_out, size_t *value_len_inout)
+{
+    int rc = storage_ready();
     if (rc < 0) {
-        LOG_ERR("Flash init failed: %d", rc);
         return rc;
     }
     
-    /* Initialize settings subsystem */
-    rc = settings_subsys_init();
+    return load_id(key, value_out, value_len_inout);
+}
+
+/**
+ * @brief Load a registered value, moving it from a legacy string key
+ *
+ * @param key Registered key
+ * @param legacy_key String key older firmware stored the value under
+ * @param value_out Buffer to store the value
+ * @param value_len_inout [in] Size of the buffer, [out] actual size read
+ * @return 0 on success, -ENOENT if neither key holds a value, negative
+ *         errno on failure
+ */
+int storage_load_key_legacy(enum storage_key key, const char *legacy_key,
+                            void *value_out, size_t *value_len_inout)
+{
+    size_t size = *value_len_inout;
+    
+    int rc = storage_load_key(key, value_out, value_len_inout);
+    if (rc != -ENOENT) {
+        return rc;
+    }
+    
+    int id = legacy_id(legacy_key);
+    if (id < 0) {
+        return -ENOENT;
+    }
+    
+    rc = load_id(id, value_out, &size);
     if (rc < 0) {
-        LOG_ERR("Settings init failed: %d", rc);
         return rc;
     }
     
-    LOG_INF("Storage subsystem initialized");
-    storage_initialized = true;
+    /* A truncated value is not moved */
+    if (size <= *value_len_inout && save_id(key, value_out, size) == 0) {
+        LOG_INF("Moved %s to key 0x%04x", legacy_key, key);
+        delete_id(id);
+    }
     
+    *value_len_inout = size;
     return 0;
 }
 
 /**
- * @brief Save a value to NVS storage
+ * @brief Delete a registered value
  *
- * @param key Key to save
- * @param value Value to save
- * @param value_len Length of value
+ * @param key Registered key
  * @return 0 on success, negative errno on failure
  */
-int storage_save_value(const char *key, const void *value, size_t value_len)
+int storage_delete_key(enum storage_key key)
 {
-    int rc;
+    int rc = storage_ready();
+    if (rc < 0) {
+        return rc;
+    }
     
-    if (!storage_initialized) {
-        rc = storage_init();
+    return delete_id(key);
+}
+
+/**
+ * @brief Delete a registered value without waiting for flash
+ *
+ * Loads report the key as missing right away.
+ *
+ * @param key Registered key
+ * @param cb Callback called from the storage thread once the key is
+ *           deleted from flash, may be NULL
+ * @param user_data User data passed to the callback
+ * @return 0 if the delete was queued, negative errno on failure
+ */
+int storage_delete_async(enum storage_key key, storage_done_cb_t cb, void *user_data)
+{
+    int rc = storage_ready();
+    if (rc < 0) {
+        return rc;
+    }
+    
+#if defined(CONFIG_GROW_STORAGE_WRITE_BACK)
+    struct storage_request req = {
+        .op = STORAGE_OP_DELETE,
+        .id = key,
+        .cb = cb,
+        .user_data = user_data,
+    };
+    
+    k_mutex_lock(&wb_lock, K_FOREVER);
+    int index = wb_get(key);
+    if (index >= 0) {
+        /* Keep the entry as a marker, a pending value is dropped */
+        wb_resize(index, 0);
+        wb_entries[index].len = 0;
+        wb_entries[index].dirty = false;
+        wb_entries[index].deleted = true;
+        snapshot_changed(key);
+        
+        rc = k_msgq_put(&storage_msgq, &req, K_NO_WAIT);
+        if (rc < 0) {
+            wb_remove(index);
+        }
+    }
+    k_mutex_unlock(&wb_lock);
+    
+    if (index >= 0 && rc == 0) {
+        return 0;
+    }
+#endif
+    
+    /* No room to queue it, deleted before returning */
+    rc = delete_id(key);
+    if (cb) {
+        cb(rc, user_data);
+    }
+    
+    return rc;
+}
+
+/**
+ * @brief Find the slot of a name in a dynamic namespace
+ *
+ * Every slot is probed, names are not moved when another one is deleted.
+ *
+ * @param ns Namespace
+ * @param name Name
+ * @param scan Pointer to store the free and oldest slots
+ * @return Slot, -ENOENT if the name has none, negative errno on failure
+ */
+static int ns_find(enum storage_namespace ns, const char *name, struct ns_scan *scan)
+{
+    const struct storage_ns *space = &namespaces[ns];
+    char stored[NS_ENTRY_MAX];
+    size_t name_len = strlen(name);
+    uint32_t oldest_seq = UINT32_MAX;
+    int found = -ENOENT;
+    
+    scan->free = -1;
+    scan->oldest = -1;
+    scan->last_seq = 0;
+    
+    if (name_len == 0 || name_len > STORAGE_NAME_MAX) {
+        return -EINVAL;
+    }
+    
+    int start = crc16_ccitt(0, (const uint8_t *)name, name_len) % space->slots;
+    
+    for (int i = 0; i < space->slots; i++) {
+        int slot = (start + i) % space->slots;
+        size_t len = sizeof(stored);
+        uint32_t seq = 0;
+        
+        int rc = load_id(NS_NAME_ID(space, slot), stored, &len);
+        if (rc == -ENOENT) {
+            if (scan->free < 0) {
+                scan->free = slot;
+            }
+            continue;
+        }
         if (rc < 0) {
             return rc;
         }
+        
+        const char *end = memchr(stored, '\0', len);
+        if (end && len == (size_t)(end - stored) + 1 + sizeof(seq)) {
+            memcpy(&seq, end + 1, sizeof(seq));
+            len = end - stored;
+        }
+        
+        scan->last_seq = MAX(scan->last_seq, seq);
+        if (seq < oldest_seq) {
+            oldest_seq = seq;
+            scan->oldest = slot;
+        }
+        
+        if (len == name_len && memcmp(stored, name, len) == 0) {
+            found = slot;
+        }
     }
     
-    uint16_t id = crc16_ccitt(0, key, strlen(key));
+    return found;
+}
+
+/**
+ * @brief Save a value under a name in a dynamic namespace
+ *
+ * When every slot holds another name, the least recently written one
+ * is replaced.
+ *
+ * @param ns Namespace
+ * @param name Name, at most STORAGE_NAME_MAX characters
+ * @param value Value to save
+ * @param value_len Length of value
+ * @return 0 on success, negative errno on failure
+ */
+int storage_save_dynamic(enum storage_namespace ns, const char *name,
+                         const void *value, size_t value_len)
+{
+    const struct storage_ns *space = &namespaces[ns];
+    char entry[NS_ENTRY_MAX];
+    size_t name_len = strlen(name);
+    struct ns_scan scan;
     
-    rc = nvs_write(&nvs, id, value, value_len);
+    int rc = storage_ready();
     if (rc < 0) {
-        LOG_ERR("Failed to write to NVS: %d", rc);
         return rc;
     }
     
-    return 0;
+    int slot = ns_find(ns, name, &scan);
+    if (slot == -ENOENT) {
+        slot = scan.free;
+        
+        if (slot < 0) {
+            slot = scan.oldest;
+            LOG_INF("Namespace full, replacing slot %d with %s", slot, name);
+            
+            /* Free the slot first, its value must not go with the old name */
+            rc = delete_id(NS_NAME_ID(space, slot));
+            if (rc < 0) {
+                return rc;
+            }
+        }
+    } else if (slot < 0) {
+        return slot;
+    }
+    
+    /* The name goes last, a slot without it is free */
+    rc = save_id(NS_VALUE_ID(space, slot), value, value_len);
+    if (rc < 0) {
+        return rc;
+    }
+    
+    /* Stamped with the write sequence, the oldest slot is replaced first */
+    uint32_t seq = scan.last_seq + 1;
+    
+    memcpy(entry, name, name_len);
+    entry[name_len] = '\0';
+    memcpy(&entry[name_len + 1], &seq, sizeof(seq));
+    
+    return save_id(NS_NAME_ID(space, slot), entry, name_len + 1 + sizeof(seq));
 }
 
 /**
- * @brief Load a value from NVS storage
+ * @brief Load the value of a name in a dynamic namespace
  *
- * @param key Key to load
+ * @param ns Namespace
+ * @param name Name
  * @param value_out Buffer to store the value
  * @param value_len_inout [in] Size of the buffer, [out] actual size read
+ * @return 0 on success, -ENOENT if the name holds no value, negative
+ *         errno on failure
+ */
+int storage_load_dynamic(enum storage_namespace ns, const char *name,
+                         void *value_out, size_t *value_len_inout)
+{
+    struct ns_scan scan;
+    
+    int rc = storage_ready();
+    if (rc < 0) {
+        return rc;
+    }
+    
+    int slot = ns_find(ns, name, &scan);
+    if (slot < 0) {
+        return slot;
+    }
+    
+    return load_id(NS_VALUE_ID(&namespaces[ns], slot), value_out, value_len_inout);
+}
+
+/**
+ * @brief Delete the value of a name in a dynamic namespace
+ *
+ * @param ns Namespace
+ * @param name Name
  * @return 0 on success, negative errno on failure
  */
-int storage_load_value(const char *key, void *value_out, size_t *value_len_inout)
+int storage_delete_dynamic(enum storage_namespace ns, const char *name)
 {
-    int rc;
+    struct ns_scan scan;
     
-    if (!storage_initialized) {
-        rc = storage_init();
-        if (rc < 0) {
-            return rc;
-        }
+    int rc = storage_ready();
+    if (rc < 0) {
+        return rc;
     }
     
-    uint16_t id = crc16_ccitt(0, key, strlen(key));
+    int slot = ns_find(ns, name, &scan);
+    if (slot == -ENOENT) {
+        return 0;
+    }
+    if (slot < 0) {
+        return slot;
+    }
     
-    rc = nvs_read(&nvs, id, value_out, *value_len_inout);
+    /* The name goes first, a slot without it is free */
+    rc = delete_id(NS_NAME_ID(&namespaces[ns], slot));
     if (rc < 0) {
-        LOG_ERR("Failed to read from NVS: %d", rc);
         return rc;
     }
     
-    *value_len_inout = rc;
-    return 0;
+    return delete_id(NS_VALUE_ID(&namespaces[ns], slot));
 }
 
 /**
- * @brief Delete a value from NVS storage
+ * @brief Save a value under a legacy string key
  *
- * @param key Key to delete
+ * @param key Key to save
+ * @param value Value to save
+ * @param value_len Length of value
  * @return 0 on success, negative errno on failure
  */
-int storage_delete_value(const char *key)
+int storage_save_value(const char *key, const void *value, size_t value_len)
 {
-    int rc;
+    int rc = storage_ready();
+    if (rc < 0) {
+        return rc;
+    }
     
-    if (!storage_initialized) {
-        rc = storage_init();
-        if (rc < 0) {
-            return rc;
-        }
+    int id = legacy_id(key);
+    if (id < 0) {
+        return id;
+    }
+    
+    return save_id(id, value, value_len);
+}
+
+/**
+ * @brief Load a value stored under a legacy string key
+ *
+ * @param key Key to load
+ * @param value_out Buffer to store the value
+ * @param value_len_inout [in] Size of the buffer, [out] actual size read
+ * @return 0 on success, negative errno on failure
+ */
+int storage_load_value(const char *key, void *value_out, size_t *value_len_inout)
+{
+    int rc = storage_ready();
+    if (rc < 0) {
+        return rc;
     }
     
-    uint16_t id = crc16_ccitt(0, key, strlen(key));
+    int id = legacy_id(key);
+    if (id < 0) {
+        return -ENOENT;
+    }
     
-    rc = nvs_delete(&nvs, id);
+    return load_id(id, value_out, value_len_inout);
+}
+
+/**
+ * @brief Delete a value stored under a legacy string key
+ *
+ * @param key Key to delete
+ * @return 0 on success, negative errno on failure
+ */
+int storage_delete_value(const char *key)
+{
+    int rc = storage_ready();
     if (rc < 0) {
-        LOG_ERR("Failed to delete from NVS: %d", rc);
         return rc;
     }
     
-    return 0;
+    int id = legacy_id(key);
+    if (id < 0) {
+        return id;
+    }
+    
+    return delete_id(id);
 }
 
 /**
@@ -177,32 +1777,33 @@ int storage_save_device_config(const char *wifi_ssid, const char *wifi_password,
     int rc;
     bool provisioned = true;
     
-    rc = storage_save_value(WIFI_SSID_KEY, wifi_ssid, strlen(wifi_ssid));
+    rc = storage_save_key(STORAGE_KEY_WIFI_SSID, wifi_ssid, strlen(wifi_ssid));
     if (rc < 0) {
         return rc;
     }
     
-    rc = storage_save_value(WIFI_PASSWORD_KEY, wifi_password, strlen(wifi_password));
+    rc = storage_save_key(STORAGE_KEY_WIFI_PASSWORD, wifi_password, strlen(wifi_password));
     if (rc < 0) {
         return rc;
     }
     
-    rc = storage_save_value(PLANT_NAME_KEY, plant_name, strlen(plant_name));
+    rc = storage_save_key(STORAGE_KEY_PLANT_NAME, plant_name, strlen(plant_name));
     if (rc < 0) {
         return rc;
     }
     
-    rc = storage_save_value(PLANT_VARIETY_KEY, plant_variety, strlen(plant_variety));
+    rc = storage_save_key(STORAGE_KEY_PLANT_VARIETY, plant_variety, strlen(plant_variety));
     if (rc < 0) {
         return rc;
     }
     
-    rc = storage_save_value(PROVISIONED_KEY, &provisioned, sizeof(provisioned));
+    rc = storage_save_key(STORAGE_KEY_PROVISIONED, &provisioned, sizeof(provisioned));
     if (rc < 0) {
         return rc;
     }
     
-    return 0;
+    /* Provisioning must survive a power cut right after it */
+    return storage_sync();
 }
 
 /**
@@ -225,7 +1826,7 @@ int storage_load_device_config(char *plant_name_out, size_t plant_name_len,
     
     /* Check provisioning first */
     len = sizeof(provisioned);
-    rc = storage_load_value(PROVISIONED_KEY, &provisioned, &len);
+    rc = storage_load_key(STORAGE_KEY_PROVISIONED, &provisioned, &len);
     if (rc < 0) {
         /* Not provisioned yet */
         *provisioned_out = false;
@@ -237,7 +1838,7 @@ int storage_load_device_config(char *plant_name_out, size_t plant_name_len,
     
     if (plant_name_out && plant_name_len > 0) {
         len = plant_name_len - 1;
-        rc = storage_load_value(PLANT_NAME_KEY, plant_name_out, &len);
+        rc = storage_load_key(STORAGE_KEY_PLANT_NAME, plant_name_out, &len);
         if (rc < 0) {
             strncpy(plant_name_out, "Unknown", plant_name_len - 1);
         }
@@ -246,7 +1847,7 @@ int storage_load_device_config(char *plant_name_out, size_t plant_name_len,
     
     if (plant_variety_out && plant_variety_len > 0) {
         len = plant_variety_len - 1;
-        rc = storage_load_value(PLANT_VARIETY_KEY, plant_variety_out, &len);
+        rc = storage_load_key(STORAGE_KEY_PLANT_VARIETY, plant_variety_out, &len);
         if (rc < 0) {
             strncpy(plant_variety_out, "Unknown", plant_variety_len - 1);
         }
@@ -265,27 +1866,27 @@ int storage_reset_device_config(void)
 {
     int rc;
     
-    rc = storage_delete_value(WIFI_SSID_KEY);
+    rc = storage_delete_key(STORAGE_KEY_WIFI_SSID);
     if (rc < 0 && rc != -ENOENT) {
         return rc;
     }
     
-    rc = storage_delete_value(WIFI_PASSWORD_KEY);
+    rc = storage_delete_key(STORAGE_KEY_WIFI_PASSWORD);
     if (rc < 0 && rc != -ENOENT) {
         return rc;
     }
     
-    rc = storage_delete_value(PLANT_NAME_KEY);
+    rc = storage_delete_key(STORAGE_KEY_PLANT_NAME);
     if (rc < 0 && rc != -ENOENT) {
         return rc;
     }
     
-    rc = storage_delete_value(PLANT_VARIETY_KEY);
+    rc = storage_delete_key(STORAGE_KEY_PLANT_VARIETY);
     if (rc < 0 && rc != -ENOENT) {
         return rc;
     }
     
-    rc = storage_delete_value(PROVISIONED_KEY);
+    rc = storage_delete_key(STORAGE_KEY_PROVISIONED);
     if (rc < 0 && rc != -ENOENT) {
         return rc;
     }
@@ -3,6 +3,17 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
+
+#include "storage_keys.h"
+
+/* Storage write statistics since boot */
+struct storage_stats {
+    uint32_t writes;        /* Successful storage_save_value() calls */
+    uint32_t bytes_written; /* Bytes written to flash (unchanged values are skipped by NVS) */
+    uint32_t write_errors;  /* Failed writes */
+    uint32_t coalesced;     /* Saves absorbed by the write-back cache */
+};
 
 /**
  * @brief Initialize storage subsystem
@@ -12,17 +23,156 @@
 int storage_init(void);
 
 /**
- * @brief Save a key-value pair to flash
+ * @brief Save a registered value to flash
  *
- * @param key Key to save
+ * With CONFIG_GROW_STORAGE_WRITE_BACK the value is written by the
+ * storage thread on the next flush. Loads see it immediately.
+ *
+ * @param key Registered key
  * @param value Value to save
  * @param value_len Length of value
  * @return 0 on success, negative errno on failure
  */
+int storage_save_key(enum storage_key key, const void *value, size_t value_len);
+
+/**
+ * @brief Storage completion callback
+ *
+ * Called from the storage thread.
+ *
+ * @param result 0 on success, negative errno on failure
+ * @param user_data User data passed with the request
+ */
+typedef void (*storage_done_cb_t)(int result, void *user_data);
+
+/**
+ * @brief Save a registered value to flash without waiting for it
+ *
+ * The value is copied and written by the storage thread. Loads see it
+ * immediately. Values too large for the write-back cache, or saved while
+ * the request queue is full, are written before returning.
+ *
+ * @param key Registered key
+ * @param value Value to save
+ * @param value_len Length of value
+ * @param cb Callback called once the value is in flash, may be NULL
+ * @param user_data User data passed to the callback
+ * @return 0 if the write was queued or done, negative errno on failure
+ */
+int storage_save_async(enum storage_key key, const void *value, size_t value_len,
+                       storage_done_cb_t cb, void *user_data);
+
+/**
+ * @brief Write all pending values to flash and wait for completion
+ *
+ * Pending values are written every CONFIG_GROW_STORAGE_FLUSH_INTERVAL_SEC.
+ * Call it before a reboot or power off.
+ *
+ * @return 0 on success, negative errno on failure
+ */
+int storage_sync(void);
+
+/**
+ * @brief Load a registered value from flash
+ *
+ * @param key Registered key
+ * @param value_out Buffer to store the value
+ * @param value_len_inout [in] Size of the buffer, [out] actual size read
+ * @return 0 on success, -ENOENT if the key holds no value, negative
+ *         errno on failure
+ */
+int storage_load_key(enum storage_key key, void *value_out, size_t *value_len_inout);
+
+/**
+ * @brief Load a registered value, moving it from a legacy string key
+ *
+ * For keys whose legacy string was built at run time, such as from the
+ * serial number. A value found under the string key is saved under the
+ * registered key and the string key is deleted.
+ *
+ * @param key Registered key
+ * @param legacy_key String key older firmware stored the value under
+ * @param value_out Buffer to store the value
+ * @param value_len_inout [in] Size of the buffer, [out] actual size read
+ * @return 0 on success, -ENOENT if neither key holds a value, negative
+ *         errno on failure
+ */
+int storage_load_key_legacy(enum storage_key key, const char *legacy_key,
+                            void *value_out, size_t *value_len_inout);
+
+/**
+ * @brief Delete a registered value from flash
+ *
+ * @param key Registered key
+ * @return 0 on success, negative errno on failure
+ */
+int storage_delete_key(enum storage_key key);
+
+/**
+ * @brief Delete a registered value from flash without waiting for it
+ *
+ * Loads report the key as missing immediately.
+ *
+ * @param key Registered key
+ * @param cb Callback called once the key is deleted, may be NULL
+ * @param user_data User data passed to the callback
+ * @return 0 if the delete was queued, negative errno on failure
+ */
+int storage_delete_async(enum storage_key key, storage_done_cb_t cb, void *user_data);
+
+/**
+ * @brief Save a value under a name in a dynamic namespace
+ *
+ * When all slots of the namespace hold other names, the least recently
+ * written one is replaced, so the namespace acts as a cache.
+ *
+ * @param ns Namespace
+ * @param name Name, at most STORAGE_NAME_MAX characters
+ * @param value Value to save
+ * @param value_len Length of value
+ * @return 0 on success, negative errno on failure
+ */
+int storage_save_dynamic(enum storage_namespace ns, const char *name,
+                         const void *value, size_t value_len);
+
+/**
+ * @brief Load the value of a name in a dynamic namespace
+ *
+ * @param ns Namespace
+ * @param name Name
+ * @param value_out Buffer to store the value
+ * @param value_len_inout [in] Size of the buffer, [out] actual size read
+ * @return 0 on success, -ENOENT if the name holds no value, negative
+ *         errno on failure
+ */
+int storage_load_dynamic(enum storage_namespace ns, const char *name,
+                         void *value_out, size_t *value_len_inout);
+
+/**
+ * @brief Delete the value of a name in a dynamic namespace
+ *
+ * @param ns Namespace
+ * @param name Name
+ * @return 0 on success, negative errno on failure
+ */
+int storage_delete_dynamic(enum storage_namespace ns, const char *name);
+
+/**
+ * @brief Save a value under a legacy string key
+ *
+ * The NVS ID is a CRC-16 of the key, as older firmware computed it.
+ * New values belong in storage_keys.h.
+ *
+ * @param key Key to save
+ * @param value Value to save
+ * @param value_len Length of value
+ * @return 0 on success, -EEXIST if the key hashes to a registered ID,
+ *         negative errno on failure
+ */
 int storage_save_value(const char *key, const void *value, size_t value_len);
 
 /**
- * @brief Load a value from flash
+ * @brief Load a value stored under a legacy string key
  *
  * @param key Key to load
  * @param value_out Buffer to store the value
@@ -32,13 +182,21 @@ int storage_save_value(const char *key, const void *value, size_t value_len);
 int storage_load_value(const char *key, void *value_out, size_t *value_len_inout);
 
 /**
- * @brief Delete a key-value pair from flash
+ * @brief Delete a value stored under a legacy string key
  *
  * @param key Key to delete
- * @return 0 on success, negative errno on failure
+ * @return 0 on success, -EEXIST if the key hashes to a registered ID,
+ *         negative errno on failure
  */
 int storage_delete_value(const char *key);
 
+/**
+ * @brief Get storage write statistics
+ *
+ * @param stats_out Pointer to store the statistics
+ */
+void storage_get_stats(struct storage_stats *stats_out);
+
 /**
  * @brief Save device configuration to flash
  *
@@ -0,0 +1,80 @@
+#ifndef STORAGE_KEYS_H
+#define STORAGE_KEYS_H
+
+/*
+ * Storage key registry
+ *
+ * Every persisted value has its NVS ID assigned here at build time.
+ * IDs are stored in flash, so an ID is never renumbered or reused: a
+ * key that is no longer needed keeps its line, commented out.
+ *
+ * Older firmware derived the ID from a CRC-16 of a string key. Keys
+ * with a legacy string are moved to their ID on the first boot with
+ * this layout. Registered IDs stay below STORAGE_REGISTRY_END, which
+ * none of the legacy strings hash to.
+ *
+ * X(name, NVS ID, legacy string key or NULL)
+ */
+#define STORAGE_REGISTRY_END 0x0200
+
+#define STORAGE_KEYS(X) \
+    X(LAYOUT_VERSION,       0x0001, NULL) \
+    X(WIFI_SSID,            0x0002, "wifi/ssid") \
+    X(WIFI_PASSWORD,        0x0003, "wifi/password") \
+    X(PLANT_NAME,           0x0004, "plant/name") \
+    X(PLANT_VARIETY,        0x0005, "plant/variety") \
+    X(PROVISIONED,          0x0006, "device/provisioned") \
+    X(SERIAL_NUMBER,        0x0007, "serial_number") \
+    X(SAMPLING_INTERVAL,    0x0008, "sampling/interval") \
+    X(SENSOR_HISTORY,       0x0009, NULL) \
+    X(WATER_HISTORY,        0x000A, NULL) \
+    X(SNAPSHOT_A,           0x000B, NULL) \
+    X(SNAPSHOT_B,           0x000C, NULL)
+
+/*
+ * Keys read at boot, kept together in the boot state snapshot
+ *
+ * X(name)
+ */
+#define STORAGE_SNAPSHOT_KEYS(X) \
+    X(PROVISIONED) \
+    X(PLANT_NAME) \
+    X(PLANT_VARIETY) \
+    X(SERIAL_NUMBER) \
+    X(SAMPLING_INTERVAL) \
+    X(WIFI_SSID) \
+    X(WIFI_PASSWORD) \
+    X(SENSOR_HISTORY) \
+    X(WATER_HISTORY)
+
+/*
+ * Dynamic key namespaces
+ *
+ * A namespace holds up to 'slots' values under run-time names. Each
+ * slot takes two IDs from 'base', one for the name and one for the
+ * value. A name is placed by its hash and probed through the whole
+ * namespace, so two names never share a slot. A new name in a full
+ * namespace replaces the least recently written one.
+ *
+ * X(name, first NVS ID, slots)
+ */
+#define STORAGE_NAMESPACES(X) \
+    X(HABITAT,              0x0100, 8)
+
+/* Longest name in a dynamic namespace */
+#define STORAGE_NAME_MAX 64
+
+enum storage_key {
+#define STORAGE_KEY_ENUM(name, id, legacy) STORAGE_KEY_##name = id,
+    STORAGE_KEYS(STORAGE_KEY_ENUM)
+#undef STORAGE_KEY_ENUM
+};
+
+enum storage_namespace {
+#define STORAGE_NS_ENUM(name, base, slots) STORAGE_NS_##name,
+    STORAGE_NAMESPACES(STORAGE_NS_ENUM)
+#undef STORAGE_NS_ENUM
+    STORAGE_NS_COUNT
+};
+
+#endif /* STORAGE_KEYS_H */
@@ -3,6 +3,24 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <math.h>
+
+/* Model file in the tflite partition, see CONFIG_GROW_MODEL_INT8 */
+#if defined(CONFIG_GROW_MODEL_INT8)
+#define TFLITE_MODEL_FILE "plant_health_model_int8.tflite"
+#else
+#define TFLITE_MODEL_FILE "plant_health_model.tflite"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(CONFIG_GROW_MODEL_EMBED)
+/* Model linked into flash from CONFIG_GROW_MODEL_FILE */
+extern const uint8_t tflite_model_data[];
+extern const size_t tflite_model_size;
+#endif
 
 /**
  * @brief TensorFlow Lite context structure
@@ -13,9 +31,44 @@ struct tflite_context {
     void *input_tensor;     /* Input tensor pointer */
     void *output_tensor;    /* Output tensor pointer */
     size_t arena_size;      /* Size of tensor arena */
+    size_t arena_used;      /* Arena bytes used by the model */
     uint8_t *tensor_arena;  /* Memory area for tensor allocations */
 };
 
+/**
+ * @brief Quantize a value for an int8 tensor
+ *
+ * @param value Real value
+ * @param scale Tensor quantization scale
+ * @param zero_point Tensor quantization zero point
+ * @return Quantized value, saturated to the int8 range
+ */
+static inline int8_t tflite_quantize(float value, float scale, int32_t zero_point)
+{
+    int32_t q = (int32_t)lroundf(value / scale) + zero_point;
+    
+    if (q < INT8_MIN) {
+        return INT8_MIN;
+    }
+    if (q > INT8_MAX) {
+        return INT8_MAX;
+    }
+    return (int8_t)q;
+}
+
+/**
+ * @brief Dequantize a value from an int8 tensor
+ *
+ * @param value Quantized value
+ * @param scale Tensor quantization scale
+ * @param zero_point Tensor quantization zero point
+ * @return Real value
+ */
+static inline float tflite_dequantize(int8_t value, float scale, int32_t zero_point)
+{
+    return (float)((int32_t)value - zero_point) * scale;
+}
+
 /**
  * @brief Initialize TensorFlow Lite
  * 
@@ -29,6 +82,9 @@ int tflite_init(struct tflite_context *ctx);
 /**
  * @brief Run inference on input data
  * 
+ * Float and int8 models are both accepted. For an int8 model the input
+ * is quantized and the output dequantized with the tensor parameters.
+ * 
  * @param ctx TFLite context
  * @param input_data Input sensor data array
  * @param input_size Size of input data array
@@ -48,4 +104,8 @@ int tflite_run_inference(struct tflite_context *ctx,
  */
 int tflite_deinit(struct tflite_context *ctx);
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif /* TFLITE_INTERFACE_H */
\ No newline at end of file
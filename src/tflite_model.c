@@ -0,0 +1,20 @@
+#include <zephyr/toolchain.h>
+
+#include "tflite_interface.h"
+#include "tflite_model_ops.h"
+
+/*
+ * Model flatbuffer, generated from CONFIG_GROW_MODEL_FILE at build time
+ *
+ * It stays in flash and TFLite Micro reads it in place. The flatbuffer
+ * tables need their natural alignment, 16 bytes covers all of them.
+ */
+const uint8_t tflite_model_data[] __aligned(16) = {
+#include "plant_health_model.inc"
+};
+
+const size_t tflite_model_size = sizeof(tflite_model_data);
+
+/* The op resolver must come from the same model */
+BUILD_ASSERT(sizeof(tflite_model_data) == TFLITE_MODEL_FILE_SIZE,
+             "tflite_model_ops.h was generated from a different model");
@@ -13,8 +13,6 @@
 LOG_MODULE_REGISTER(wifi, CONFIG_LOG_DEFAULT_LEVEL);
 
 /* WiFi connection definitions */
-#define WIFI_SSID_KEY "wifi/ssid"
-#define WIFI_PASSWORD_KEY "wifi/password"
 #define MAX_WIFI_SSID_LEN 32
 #define MAX_WIFI_PSK_LEN 64
 
@@ -78,7 +76,7 @@ int wifi_connect(void)
     
     /* Load WiFi credentials from storage */
     len = sizeof(wifi_ssid) - 1;
-    ret = storage_load_value(WIFI_SSID_KEY, wifi_ssid, &len);
+    ret = storage_load_key(STORAGE_KEY_WIFI_SSID, wifi_ssid, &len);
     if (ret < 0) {
         LOG_ERR("Failed to load WiFi SSID: %d", ret);
         return ret;
@@ -86,7 +84,7 @@ int wifi_connect(void)
     wifi_ssid[len] = '\0';
     
     len = sizeof(wifi_psk) - 1;
-    ret = storage_load_value(WIFI_PASSWORD_KEY, wifi_psk, &len);
+    ret = storage_load_key(STORAGE_KEY_WIFI_PASSWORD, wifi_psk, &len);
     if (ret < 0) {
         LOG_ERR("Failed to load WiFi password: %d", ret);
         return ret;